@@ -0,0 +1,226 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QtTest>
+
+#include "../part/colortransform.h"
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QRandomGenerator>
+
+#include <functional>
+
+typedef std::function<void(QRgb *, int)> Kernel;
+
+// The per pixel loops PagePainter used before the kernels, which they must match exactly
+namespace Reference
+{
+static void recolor(QRgb *data, int pixels, const QColor &foreground, const QColor &background)
+{
+    const float scaleRed = background.redF() - foreground.redF();
+    const float scaleGreen = background.greenF() - foreground.greenF();
+    const float scaleBlue = background.blueF() - foreground.blueF();
+
+    for (int i = 0; i < pixels; ++i) {
+        const int lightness = qGray(data[i]);
+        const float r = scaleRed * lightness + foreground.red();
+        const float g = scaleGreen * lightness + foreground.green();
+        const float b = scaleBlue * lightness + foreground.blue();
+        data[i] = qRgba(r, g, b, qAlpha(data[i]));
+    }
+}
+
+static void blackWhite(QRgb *data, int pixels, int contrast, int threshold)
+{
+    const int thr = 255 - threshold;
+    for (int i = 0; i < pixels; ++i) {
+        int val = qGray(data[i]);
+        if (val > thr)
+            val = 128 + (127 * (val - thr)) / (255 - thr);
+        else if (val < thr)
+            val = (128 * val) / thr;
+
+        if (contrast > 2) {
+            val = thr + (val - thr) * contrast / 2;
+            val = qBound(0, val, 255);
+        }
+        data[i] = qRgba(val, val, val, qAlpha(data[i]));
+    }
+}
+
+static void invertLightness(QRgb *data, int pixels)
+{
+    for (int i = 0; i < pixels; ++i) {
+        uchar R = qRed(data[i]);
+        uchar G = qGreen(data[i]);
+        uchar B = qBlue(data[i]);
+        const uchar m = qMin(R, qMin(G, B));
+        R -= m;
+        G -= m;
+        B -= m;
+        const uchar C = qMax(R, qMax(G, B));
+        const uchar m_ = 255 - C - m;
+        R += m_;
+        G += m_;
+        B += m_;
+        data[i] = qRgba(R, G, B, qAlpha(data[i]));
+    }
+}
+
+static void invertLuma(QRgb *data, int pixels, float Y_R, float Y_G, float Y_B)
+{
+    for (int i = 0; i < pixels; ++i) {
+        uchar R = qRed(data[i]);
+        uchar G = qGreen(data[i]);
+        uchar B = qBlue(data[i]);
+        ColorTransform::invertLumaPixel(R, G, B, Y_R, Y_G, Y_B);
+        data[i] = qRgba(R, G, B, qAlpha(data[i]));
+    }
+}
+
+static void hueShiftPositive(QRgb *data, int pixels)
+{
+    for (int i = 0; i < pixels; ++i)
+        data[i] = qRgba(qBlue(data[i]), qRed(data[i]), qGreen(data[i]), qAlpha(data[i]));
+}
+
+static void hueShiftNegative(QRgb *data, int pixels)
+{
+    for (int i = 0; i < pixels; ++i)
+        data[i] = qRgba(qGreen(data[i]), qBlue(data[i]), qRed(data[i]), qAlpha(data[i]));
+}
+}
+
+class ColorTransformTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void cleanup();
+    void testKernels_data();
+    void testKernels();
+    void benchmarkKernels_data();
+    void benchmarkKernels();
+};
+
+Q_DECLARE_METATYPE(Kernel)
+Q_DECLARE_METATYPE(ColorTransform::Implementation)
+
+// premultiplied pixels, a third of them gray and some with the whole range of alpha
+static QVector<QRgb> testPixels(int count)
+{
+    QRandomGenerator random(42);
+    QVector<QRgb> pixels(count);
+    for (int i = 0; i < count; ++i) {
+        QRgb pixel = qPremultiply(random.generate());
+        if (i % 3 == 0)
+            pixel = qRgba(qBlue(pixel), qBlue(pixel), qBlue(pixel), qAlpha(pixel));
+        else if (i % 3 == 1)
+            pixel |= 0xff000000;
+        pixels[i] = pixel;
+    }
+    return pixels;
+}
+
+void ColorTransformTest::cleanup()
+{
+    ColorTransform::setImplementation(ColorTransform::availableImplementations().constLast());
+}
+
+void ColorTransformTest::testKernels_data()
+{
+    QTest::addColumn<ColorTransform::Implementation>("implementation");
+    QTest::addColumn<Kernel>("kernel");
+    QTest::addColumn<Kernel>("reference");
+
+    const QColor foreground(30, 200, 10);
+    const QColor background(250, 5, 128);
+
+    const QList<QPair<QByteArray, QPair<Kernel, Kernel>>> kernels = {
+        {"recolor", {[=](QRgb *d, int n) { ColorTransform::recolor(d, n, foreground, background); }, [=](QRgb *d, int n) { Reference::recolor(d, n, foreground, background); }}},
+        {"blackWhite", {[](QRgb *d, int n) { ColorTransform::blackWhite(d, n, 2, 127); }, [](QRgb *d, int n) { Reference::blackWhite(d, n, 2, 127); }}},
+        {"blackWhite contrast", {[](QRgb *d, int n) { ColorTransform::blackWhite(d, n, 7, 40); }, [](QRgb *d, int n) { Reference::blackWhite(d, n, 7, 40); }}},
+        {"blackWhite threshold 0", {[](QRgb *d, int n) { ColorTransform::blackWhite(d, n, 4, 0); }, [](QRgb *d, int n) { Reference::blackWhite(d, n, 4, 0); }}},
+        {"blackWhite threshold 255", {[](QRgb *d, int n) { ColorTransform::blackWhite(d, n, 4, 255); }, [](QRgb *d, int n) { Reference::blackWhite(d, n, 4, 255); }}},
+        {"invertLightness", {ColorTransform::invertLightness, Reference::invertLightness}},
+        {"invertLuma", {[](QRgb *d, int n) { ColorTransform::invertLuma(d, n, 0.2126, 0.7152, 0.0722); }, [](QRgb *d, int n) { Reference::invertLuma(d, n, 0.2126, 0.7152, 0.0722); }}},
+        {"invertLumaSymmetric", {[](QRgb *d, int n) { ColorTransform::invertLuma(d, n, 0.3333, 0.3334, 0.3333); }, [](QRgb *d, int n) { Reference::invertLuma(d, n, 0.3333, 0.3334, 0.3333); }}},
+        {"hueShiftPositive", {ColorTransform::hueShiftPositive, Reference::hueShiftPositive}},
+        {"hueShiftNegative", {ColorTransform::hueShiftNegative, Reference::hueShiftNegative}},
+    };
+
+    const QVector<ColorTransform::Implementation> implementations = ColorTransform::availableImplementations();
+    for (const ColorTransform::Implementation implementation : implementations) {
+        for (const auto &kernel : kernels) {
+            const QByteArray name = kernel.first + ' ' + ColorTransform::implementationName(implementation);
+            QTest::newRow(name.constData()) << implementation << kernel.second.first << kernel.second.second;
+        }
+    }
+}
+
+void ColorTransformTest::testKernels()
+{
+    QFETCH(ColorTransform::Implementation, implementation);
+    QFETCH(Kernel, kernel);
+    QFETCH(Kernel, reference);
+
+    ColorTransform::setImplementation(implementation);
+
+    // an odd count, so that the tails after the last full vector are covered too
+    const QVector<QRgb> original = testPixels(100003);
+    QVector<QRgb> expected = original;
+    reference(expected.data(), expected.size());
+
+    // every length up to a few vectors, at every alignment
+    for (int offset = 0; offset < 8; ++offset) {
+        for (int length = 0; length < 40; ++length) {
+            QVector<QRgb> pixels = original.mid(0, 64);
+            kernel(pixels.data() + offset, length);
+            for (int i = 0; i < pixels.size(); ++i)
+                QCOMPARE(pixels[i], (i >= offset && i < offset + length) ? expected[i] : original[i]);
+        }
+    }
+
+    QVector<QRgb> pixels = original;
+    kernel(pixels.data(), pixels.size());
+    for (int i = 0; i < pixels.size(); ++i) {
+        if (pixels[i] != expected[i])
+            QFAIL(qPrintable(QStringLiteral("Pixel %1 (%2) became %3 instead of %4").arg(i).arg(original[i], 8, 16).arg(pixels[i], 8, 16).arg(expected[i], 8, 16)));
+    }
+}
+
+void ColorTransformTest::benchmarkKernels_data()
+{
+    testKernels_data();
+}
+
+void ColorTransformTest::benchmarkKernels()
+{
+    QFETCH(ColorTransform::Implementation, implementation);
+    QFETCH(Kernel, kernel);
+    QFETCH(Kernel, reference);
+
+    // an A4 page at 150 dpi
+    const QVector<QRgb> original = testPixels(1240 * 1754);
+    const int rounds = 3;
+
+    auto megapixelsPerSecond = [&original](const Kernel &k) {
+        QVector<QRgb> pixels = original;
+        QElapsedTimer timer;
+        timer.start();
+        for (int round = 0; round < rounds; ++round)
+            k(pixels.data(), pixels.size());
+        return double(original.size()) * rounds / qMax<qint64>(timer.nsecsElapsed(), 1) * 1000;
+    };
+
+    ColorTransform::setImplementation(implementation);
+    const double kernelSpeed = megapixelsPerSecond(kernel);
+    const double referenceSpeed = megapixelsPerSecond(reference);
+    qInfo("%s: %.1f Mpx/s, per pixel loop %.1f Mpx/s", QTest::currentDataTag(), kernelSpeed, referenceSpeed);
+}
+
+QTEST_MAIN(ColorTransformTest)
+#include "colortransformtest.moc"
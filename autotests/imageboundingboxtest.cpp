@@ -0,0 +1,165 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QtTest>
+
+#include "../core/area.h"
+#include "../core/utils.h"
+#include "../settings_core.h"
+
+#include <QImage>
+#include <QRandomGenerator>
+
+class ImageBoundingBoxTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanup();
+    void testBoundingBox_data();
+    void testBoundingBox();
+    void testBlank_data();
+    void testBlank();
+};
+
+// the loop over QImage::pixel() that Utils::imageBoundingBox used to be
+static Okular::NormalizedRect referenceBoundingBox(const QImage &image, QRgb paperColor)
+{
+    int left = image.width(), top = image.height(), right = -1, bottom = -1;
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            if ((image.pixel(x, y) & 0xFFFFFF) != (paperColor & 0xFFFFFF)) {
+                left = qMin(left, x);
+                right = qMax(right, x);
+                top = qMin(top, y);
+                bottom = qMax(bottom, y);
+            }
+        }
+    }
+    if (right == -1)
+        return Okular::NormalizedRect(0, 0, 0, 0);
+
+    return Okular::NormalizedRect(QRect(left, top, right - left + 1, bottom - top + 1), image.width(), image.height());
+}
+
+// paper with a few pixels of other colors, and pixels that only differ from the paper in alpha
+static QImage testImage(QImage::Format format, int width, int height, int inkPixels, QRgb paperColor, quint32 seed)
+{
+    QRandomGenerator random(seed);
+    QImage image(width, height, format);
+
+    if (format == QImage::Format_Indexed8) {
+        image.setColorTable({paperColor, qRgb(255, 0, 0), qRgb(0, 0, 0), paperColor & 0x80FFFFFF});
+        image.fill(0);
+        for (int i = 0; i < inkPixels; ++i)
+            image.setPixel(random.bounded(width), random.bounded(height), 1 + random.bounded(3));
+        return image;
+    }
+
+    image.fill(paperColor);
+    const bool hasAlpha = format != QImage::Format_RGB32;
+    for (int i = 0; i < inkPixels; ++i) {
+        QRgb pixel = random.generate();
+        if (i % 3 == 0)
+            pixel = (pixel & 0xFF000000) | (paperColor & 0x00FFFFFF);
+        if (!hasAlpha)
+            pixel |= 0xFF000000;
+        else if (format == QImage::Format_ARGB32_Premultiplied)
+            pixel = qPremultiply(pixel);
+        reinterpret_cast<QRgb *>(image.scanLine(random.bounded(height)))[random.bounded(width)] = pixel;
+    }
+    return image;
+}
+
+void ImageBoundingBoxTest::initTestCase()
+{
+    Okular::SettingsCore::instance(QStringLiteral("imageboundingboxtest"));
+}
+
+void ImageBoundingBoxTest::cleanup()
+{
+    Okular::SettingsCore::setPaperColor(Qt::white);
+}
+
+void ImageBoundingBoxTest::testBoundingBox_data()
+{
+    QTest::addColumn<QImage::Format>("format");
+    QTest::addColumn<int>("width");
+    QTest::addColumn<int>("height");
+    QTest::addColumn<int>("inkPixels");
+    QTest::addColumn<QColor>("paperColor");
+
+    const QList<QPair<const char *, QImage::Format>> formats = {
+        {"RGB32", QImage::Format_RGB32},
+        {"ARGB32", QImage::Format_ARGB32},
+        {"ARGB32_Premultiplied", QImage::Format_ARGB32_Premultiplied},
+        {"Indexed8", QImage::Format_Indexed8},
+    };
+    // widths that aren't a multiple of the vector width too
+    for (const auto &format : formats) {
+        for (const int width : {1, 3, 4, 17, 64, 133}) {
+            for (const int inkPixels : {1, 3, 40}) {
+                for (const QColor &paperColor : {QColor(Qt::white), QColor(250, 240, 200)}) {
+                    const QByteArray name = QByteArray(format.first) + " width " + QByteArray::number(width) + " ink " + QByteArray::number(inkPixels) + ' ' + paperColor.name().toLatin1();
+                    QTest::newRow(name.constData()) << format.second << width << 23 << inkPixels << paperColor;
+                }
+            }
+        }
+    }
+}
+
+void ImageBoundingBoxTest::testBoundingBox()
+{
+    QFETCH(QImage::Format, format);
+    QFETCH(int, width);
+    QFETCH(int, height);
+    QFETCH(int, inkPixels);
+    QFETCH(QColor, paperColor);
+
+    Okular::SettingsCore::setPaperColor(paperColor);
+
+    for (quint32 seed = 1; seed <= 20; ++seed) {
+        const QImage image = testImage(format, width, height, inkPixels, paperColor.rgb(), seed);
+        const Okular::NormalizedRect expected = referenceBoundingBox(image, paperColor.rgb());
+        const Okular::NormalizedRect bbox = Okular::Utils::imageBoundingBox(&image);
+        QVERIFY2(bbox == expected,
+                 qPrintable(QStringLiteral("seed %1: %2,%3 %4,%5 instead of %6,%7 %8,%9")
+                                .arg(seed)
+                                .arg(bbox.left)
+                                .arg(bbox.top)
+                                .arg(bbox.right)
+                                .arg(bbox.bottom)
+                                .arg(expected.left)
+                                .arg(expected.top)
+                                .arg(expected.right)
+                                .arg(expected.bottom)));
+    }
+}
+
+void ImageBoundingBoxTest::testBlank_data()
+{
+    QTest::addColumn<QImage::Format>("format");
+    QTest::addColumn<int>("width");
+
+    QTest::newRow("RGB32 width 1") << QImage::Format_RGB32 << 1;
+    QTest::newRow("RGB32 width 17") << QImage::Format_RGB32 << 17;
+    QTest::newRow("ARGB32 width 3") << QImage::Format_ARGB32 << 3;
+    QTest::newRow("ARGB32_Premultiplied width 17") << QImage::Format_ARGB32_Premultiplied << 17;
+    QTest::newRow("Indexed8 width 3") << QImage::Format_Indexed8 << 3;
+}
+
+void ImageBoundingBoxTest::testBlank()
+{
+    QFETCH(QImage::Format, format);
+    QFETCH(int, width);
+
+    const QImage image = testImage(format, width, 9, 0, qRgb(255, 255, 255), 1);
+    QVERIFY(referenceBoundingBox(image, qRgb(255, 255, 255)) == Okular::NormalizedRect(0, 0, 0, 0));
+    QVERIFY(Okular::Utils::imageBoundingBox(&image) == Okular::NormalizedRect(0, 0, 0, 0));
+}
+
+QTEST_MAIN(ImageBoundingBoxTest)
+#include "imageboundingboxtest.moc"
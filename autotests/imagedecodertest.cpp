@@ -0,0 +1,196 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include <QtTest>
+
+#include "../core/imagedecoder.h"
+
+#include <QBuffer>
+#include <QPainter>
+
+Q_DECLARE_METATYPE(QImageIOHandler::Transformations)
+
+class ImageDecoderTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testTransformation_data();
+    void testTransformation();
+    void testClip_data();
+    void testClip();
+    void testReducedSize();
+    void testReleaseCachedImages();
+    void testInvalid();
+};
+
+// four flat quadrants, so that a wrong orientation or part shows
+static QImage testImage()
+{
+    QImage image(64, 32, QImage::Format_RGB32);
+    QPainter p(&image);
+    p.fillRect(0, 0, 32, 16, Qt::red);
+    p.fillRect(32, 0, 32, 16, Qt::green);
+    p.fillRect(0, 16, 32, 16, Qt::blue);
+    p.fillRect(32, 16, 32, 16, Qt::yellow);
+    return image;
+}
+
+static QByteArray encoded(const QImage &image, const char *format)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, format, 100);
+    return data;
+}
+
+// what QImageReader would give with the transformation applied
+static QImage transformed(const QImage &image, QImageIOHandler::Transformations transformation)
+{
+    QImage result = image.mirrored(transformation & QImageIOHandler::TransformationMirror, transformation & QImageIOHandler::TransformationFlip);
+    if (transformation & QImageIOHandler::TransformationRotate90)
+        result = result.transformed(QTransform().rotate(90));
+    return result;
+}
+
+// compares the pixels away from the borders of the quadrants, which the scaling blurs
+static bool sameQuadrants(const QImage &image, const QImage &expected)
+{
+    if (image.size() != expected.size())
+        return false;
+    for (int y = 0; y < image.height(); ++y) {
+        for (int x = 0; x < image.width(); ++x) {
+            const QRgb a = image.pixel(x, y);
+            const QRgb b = expected.pixel(x, y);
+            if (qAbs(qRed(a) - qRed(b)) > 48 || qAbs(qGreen(a) - qGreen(b)) > 48 || qAbs(qBlue(a) - qBlue(b)) > 48) {
+                bool nearBorder = false;
+                for (int dy = -4; dy <= 4 && !nearBorder; ++dy) {
+                    for (int dx = -4; dx <= 4 && !nearBorder; ++dx) {
+                        const QPoint p(qBound(0, x + dx, image.width() - 1), qBound(0, y + dy, image.height() - 1));
+                        nearBorder = expected.pixel(p) != b;
+                    }
+                }
+                if (!nearBorder)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+void ImageDecoderTest::testTransformation_data()
+{
+    QTest::addColumn<QByteArray>("format");
+    QTest::addColumn<QImageIOHandler::Transformations>("transformation");
+
+    const QList<QPair<const char *, QImageIOHandler::Transformations>> transformations = {
+        {"none", QImageIOHandler::TransformationNone},
+        {"mirror", QImageIOHandler::TransformationMirror},
+        {"flip", QImageIOHandler::TransformationFlip},
+        {"rotate180", QImageIOHandler::TransformationRotate180},
+        {"rotate90", QImageIOHandler::TransformationRotate90},
+        {"mirrorAndRotate90", QImageIOHandler::TransformationMirrorAndRotate90},
+        {"flipAndRotate90", QImageIOHandler::TransformationFlipAndRotate90},
+        {"rotate270", QImageIOHandler::TransformationRotate270},
+    };
+    for (const QByteArray &format : {QByteArray("png"), QByteArray("jpeg")}) {
+        for (const auto &transformation : transformations)
+            QTest::newRow((format + ' ' + transformation.first).constData()) << format << transformation.second;
+    }
+}
+
+void ImageDecoderTest::testTransformation()
+{
+    QFETCH(QByteArray, format);
+    QFETCH(QImageIOHandler::Transformations, transformation);
+
+    const QImage original = testImage();
+    Okular::ImageDecoder decoder(encoded(original, format.constData()));
+    QVERIFY(decoder.isValid());
+    decoder.setTransformation(transformation);
+
+    const QImage expected = transformed(original, transformation);
+    QCOMPARE(decoder.size(), expected.size());
+    QVERIFY(sameQuadrants(decoder.image().convertToFormat(QImage::Format_RGB32), expected));
+
+    const QSize half = expected.size() / 2;
+    QVERIFY(sameQuadrants(decoder.image(half).convertToFormat(QImage::Format_RGB32), expected.scaled(half)));
+}
+
+void ImageDecoderTest::testClip_data()
+{
+    testTransformation_data();
+}
+
+void ImageDecoderTest::testClip()
+{
+    QFETCH(QByteArray, format);
+    QFETCH(QImageIOHandler::Transformations, transformation);
+
+    const QImage original = testImage();
+    Okular::ImageDecoder decoder(encoded(original, format.constData()));
+    decoder.setTransformation(transformation);
+
+    const QImage expected = transformed(original, transformation);
+    // the whole size, half of it and twice it, parts crossing the quadrants
+    for (const int scale : {2, 4, 8}) {
+        const QSize size = expected.size() * scale / 4;
+        const QImage whole = expected.scaled(size);
+        const QVector<QRect> clips = {QRect(0, 0, size.width() / 2, size.height() / 3), QRect(size.width() / 4, size.height() / 4, size.width() / 2, size.height() / 2), QRect(size.width() / 3, size.height() / 2, size.width() * 2 / 3, size.height() / 2)};
+        for (const QRect &clip : clips) {
+            const QImage part = decoder.image(size, clip);
+            QCOMPARE(part.size(), clip.size());
+            QVERIFY2(sameQuadrants(part.convertToFormat(QImage::Format_RGB32), whole.copy(clip)), qPrintable(QStringLiteral("scale %1/4, clip %2,%3 %4x%5").arg(scale).arg(clip.x()).arg(clip.y()).arg(clip.width()).arg(clip.height())));
+        }
+    }
+}
+
+void ImageDecoderTest::testReducedSize()
+{
+    QImage original(1000, 600, QImage::Format_RGB32);
+    original.fill(qRgb(10, 100, 200));
+    Okular::ImageDecoder decoder(original);
+    QCOMPARE(decoder.size(), QSize(1000, 600));
+
+    // from the cached reduced copies, again and at other sizes
+    for (const QSize &size : {QSize(100, 60), QSize(100, 60), QSize(37, 20), QSize(500, 300), QSize(1200, 720), QSize(3, 2)}) {
+        const QImage image = decoder.image(size);
+        QCOMPARE(image.size(), size);
+        QCOMPARE(image.convertToFormat(QImage::Format_RGB32).pixel(size.width() / 2, size.height() / 2), qRgb(10, 100, 200));
+    }
+}
+
+void ImageDecoderTest::testReleaseCachedImages()
+{
+    const QImage original = testImage();
+    Okular::ImageDecoder decoder(encoded(original, "png"));
+    QCOMPARE(decoder.cachedMemory(), Q_UINT64_C(0));
+
+    // the tiles are cut from the level decoded for the first one
+    const QSize size = original.size() / 2;
+    decoder.image(size, QRect(0, 0, 8, 8));
+    const qulonglong memory = decoder.cachedMemory();
+    QVERIFY(memory > 0);
+    decoder.image(size, QRect(8, 8, 8, 8));
+    QCOMPARE(decoder.cachedMemory(), memory);
+
+    QVERIFY(decoder.tryReleaseCachedImages());
+    QCOMPARE(decoder.cachedMemory(), Q_UINT64_C(0));
+    QVERIFY(sameQuadrants(decoder.image(size).convertToFormat(QImage::Format_RGB32), original.scaled(size)));
+}
+
+void ImageDecoderTest::testInvalid()
+{
+    Okular::ImageDecoder decoder(QByteArray("not an image"));
+    QVERIFY(!decoder.isValid());
+    QVERIFY(decoder.image(QSize(10, 10)).isNull());
+
+    Okular::ImageDecoder nullDecoder((QImage()));
+    QVERIFY(!nullDecoder.isValid());
+}
+
+QTEST_MAIN(ImageDecoderTest)
+#include "imagedecodertest.moc"
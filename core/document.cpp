@@ -28,6 +28,7 @@
 
 // qt/kde/system includes
 #include <QApplication>
+#include <QCryptographicHash>
 #include <QDesktopServices>
 #include <QDir>
 #include <QFile>
@@ -82,6 +83,7 @@
 #include "page.h"
 #include "page_p.h"
 #include "pagecontroller_p.h"
+#include "rendercache_p.h"
 #include "script/event_p.h"
 #include "scripter.h"
 #include "settings_core.h"
@@ -103,20 +105,6 @@
 
 using namespace Okular;
 
-struct AllocatedPixmap {
-    // owner of the page
-    DocumentObserver *observer;
-    int page;
-    qulonglong memory;
-    // public constructor: initialize data
-    AllocatedPixmap(DocumentObserver *o, int p, qulonglong m)
-        : observer(o)
-        , page(p)
-        , memory(m)
-    {
-    }
-};
-
 struct ArchiveData {
     ArchiveData()
     {
@@ -250,35 +238,43 @@ QString DocumentPrivate::localizedSize(const QSizeF size) const
 
 qulonglong DocumentPrivate::calculateMemoryToFree()
 {
+    // [MEM] count in what the generator keeps in caches of its own
+    const qulonglong cachedMemory = m_allocatedPixmapsTotalMemory + generatorCachedMemory();
+
+    // [MEM] an explicit budget replaces the configuration profiles
+    const qulonglong budget = pixmapCacheBudget();
+    if (budget)
+        return cachedMemory > budget ? cachedMemory - budget : 0;
+
     // [MEM] choose memory parameters based on configuration profile
     qulonglong clipValue = 0;
     qulonglong memoryToFree = 0;
 
     switch (SettingsCore::memoryLevel()) {
     case SettingsCore::EnumMemoryLevel::Low:
-        memoryToFree = m_allocatedPixmapsTotalMemory;
+        memoryToFree = cachedMemory;
         break;
 
     case SettingsCore::EnumMemoryLevel::Normal: {
         qulonglong thirdTotalMemory = getTotalMemory() / 3;
         qulonglong freeMemory = getFreeMemory();
-        if (m_allocatedPixmapsTotalMemory > thirdTotalMemory)
-            memoryToFree = m_allocatedPixmapsTotalMemory - thirdTotalMemory;
-        if (m_allocatedPixmapsTotalMemory > freeMemory)
-            clipValue = (m_allocatedPixmapsTotalMemory - freeMemory) / 2;
+        if (cachedMemory > thirdTotalMemory)
+            memoryToFree = cachedMemory - thirdTotalMemory;
+        if (cachedMemory > freeMemory)
+            clipValue = (cachedMemory - freeMemory) / 2;
     } break;
 
     case SettingsCore::EnumMemoryLevel::Aggressive: {
         qulonglong freeMemory = getFreeMemory();
-        if (m_allocatedPixmapsTotalMemory > freeMemory)
-            clipValue = (m_allocatedPixmapsTotalMemory - freeMemory) / 2;
+        if (cachedMemory > freeMemory)
+            clipValue = (cachedMemory - freeMemory) / 2;
     } break;
     case SettingsCore::EnumMemoryLevel::Greedy: {
         qulonglong freeSwap;
         qulonglong freeMemory = getFreeMemory(&freeSwap);
         const qulonglong memoryLimit = qMin(qMax(freeMemory, getTotalMemory() / 2), freeMemory + freeSwap);
-        if (m_allocatedPixmapsTotalMemory > memoryLimit)
-            clipValue = (m_allocatedPixmapsTotalMemory - memoryLimit) / 2;
+        if (cachedMemory > memoryLimit)
+            clipValue = (cachedMemory - memoryLimit) / 2;
     } break;
     }
 
@@ -288,6 +284,12 @@ qulonglong DocumentPrivate::calculateMemoryToFree()
     return memoryToFree;
 }
 
+// the memory the generator uses for caches it can free on request, see Generator::metaData()
+qulonglong DocumentPrivate::generatorCachedMemory() const
+{
+    return m_generator ? m_generator->metaData(QStringLiteral("CachedMemory"), QVariant()).toULongLong() : 0;
+}
+
 void DocumentPrivate::cleanupPixmapMemory()
 {
     cleanupPixmapMemory(calculateMemoryToFree());
@@ -306,10 +308,19 @@ void DocumentPrivate::cleanupPixmapMemory(qulonglong memoryToFree)
     for (; vIt != vEnd; ++vIt)
         visibleRects.insert((*vIt)->pageNumber, (*vIt));
 
-    // Free memory starting from pages that are farthest from the current one
+    // Free memory starting from pages that are farthest from the current one,
+    // with an explicit budget also weighing how long ago they were last used
+    const bool useRecency = pixmapCacheBudget() > 0;
     int pagesFreed = 0;
     while (memoryToFree > 0) {
-        AllocatedPixmap *p = searchLowestPriorityPixmap(true, true);
+        AllocatedPixmap *p = nullptr;
+        if (useRecency) {
+            p = m_allocatedPixmaps.leastValuable(currentViewportPage);
+            if (p)
+                m_allocatedPixmaps.remove(p);
+        } else {
+            p = searchLowestPriorityPixmap(true, true);
+        }
         if (!p) // No pixmap to remove
             break;
 
@@ -324,7 +335,8 @@ void DocumentPrivate::cleanupPixmapMemory(qulonglong memoryToFree)
         else
             memoryToFree -= p->memory;
         pagesFreed++;
-        // delete pixmap
+        // keep a smaller copy around and delete pixmap
+        keepDownscaledPixmap(p);
         m_pagesVector.at(p->page)->deletePixmap(p->observer);
         // delete allocation descriptor
         delete p;
@@ -334,7 +346,7 @@ void DocumentPrivate::cleanupPixmapMemory(qulonglong memoryToFree)
 
     // Store pages that weren't completely removed
 
-    QLinkedList<AllocatedPixmap *> pixmapsToKeep;
+    QVector<AllocatedPixmap *> pixmapsToKeep;
     while (memoryToFree > 0) {
         int clean_hits = 0;
         for (DocumentObserver *observer : qAsConst(m_observers)) {
@@ -371,7 +383,15 @@ void DocumentPrivate::cleanupPixmapMemory(qulonglong memoryToFree)
             break;
     }
 
-    m_allocatedPixmaps += pixmapsToKeep;
+    for (AllocatedPixmap *p : qAsConst(pixmapsToKeep))
+        m_allocatedPixmaps.insert(p);
+
+    // What is left, if any, is taken from the caches of the generator and the views
+    if (memoryToFree > 0) {
+        if (m_generator)
+            m_generator->metaData(QStringLiteral("FreeCachedMemory"), memoryToFree);
+        emit m_parent->freeCachedMemoryRequested();
+    }
     // p--rintf("freeMemory A:[%d -%d = %d] \n", m_allocatedPixmaps.count() + pagesFreed, pagesFreed, m_allocatedPixmaps.count() );
 }
 
@@ -382,36 +402,90 @@ void DocumentPrivate::cleanupPixmapMemory(qulonglong memoryToFree)
  */
 AllocatedPixmap *DocumentPrivate::searchLowestPriorityPixmap(bool unloadableOnly, bool thenRemoveIt, DocumentObserver *observer)
 {
-    QLinkedList<AllocatedPixmap *>::iterator pIt = m_allocatedPixmaps.begin();
-    QLinkedList<AllocatedPixmap *>::iterator pEnd = m_allocatedPixmaps.end();
-    QLinkedList<AllocatedPixmap *>::iterator farthestPixmap = pEnd;
     const int currentViewportPage = (*m_viewportIterator).pageNumber;
 
     /* Find the pixmap that is farthest from the current viewport */
-    int maxDistance = -1;
-    while (pIt != pEnd) {
-        const AllocatedPixmap *p = *pIt;
-        // Filter by observer
-        if (observer == nullptr || p->observer == observer) {
-            const int distance = qAbs(p->page - currentViewportPage);
-            if (maxDistance < distance && (!unloadableOnly || p->observer->canUnloadPixmap(p->page))) {
-                maxDistance = distance;
-                farthestPixmap = pIt;
-            }
-        }
-        ++pIt;
-    }
+    AllocatedPixmap *selectedPixmap = m_allocatedPixmaps.farthest(currentViewportPage, unloadableOnly, observer);
 
     /* No pixmap to remove */
-    if (farthestPixmap == pEnd)
+    if (!selectedPixmap)
         return nullptr;
 
-    AllocatedPixmap *selectedPixmap = *farthestPixmap;
     if (thenRemoveIt)
-        m_allocatedPixmaps.erase(farthestPixmap);
+        m_allocatedPixmaps.remove(selectedPixmap);
     return selectedPixmap;
 }
 
+#if defined(Q_OS_LINUX)
+/* Returns the number in the given cgroup file, or 0 if it can't be read or
+ * there is no limit */
+static qulonglong readCgroupValue(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    bool ok = false;
+    const qulonglong value = file.readAll().trimmed().toULongLong(&ok);
+    return ok ? value : 0;
+}
+
+/* Returns the file holding the given value of the memory cgroup the process
+ * is in, or an empty string if there is none. cgroup v1 names are mapped to
+ * their v2 counterparts */
+static QString memoryCgroupFile(const QString &v2Name)
+{
+    static QString v2Directory;
+    static QString v1Directory;
+    static bool initialized = false;
+    if (!initialized) {
+        initialized = true;
+
+        QFile cgroupFile(QStringLiteral("/proc/self/cgroup"));
+        if (cgroupFile.open(QIODevice::ReadOnly)) {
+            QTextStream readStream(&cgroupFile);
+            while (true) {
+                const QString entry = readStream.readLine();
+                if (entry.isNull())
+                    break;
+                // hierarchy-ID:controller-list:cgroup-path
+                const QString controllers = entry.section(QLatin1Char(':'), 1, 1);
+                const QString path = entry.section(QLatin1Char(':'), 2);
+                if (controllers.isEmpty())
+                    v2Directory = QStringLiteral("/sys/fs/cgroup") + path;
+                else if (controllers.split(QLatin1Char(',')).contains(QLatin1String("memory")))
+                    v1Directory = QStringLiteral("/sys/fs/cgroup/memory") + path;
+            }
+        }
+
+        // inside containers the cgroup of the process is usually mounted as the root one
+        if (!v2Directory.isEmpty() && !QFile::exists(v2Directory + QStringLiteral("/memory.max")))
+            v2Directory = QStringLiteral("/sys/fs/cgroup");
+        if (!v1Directory.isEmpty() && !QFile::exists(v1Directory + QStringLiteral("/memory.limit_in_bytes")))
+            v1Directory = QStringLiteral("/sys/fs/cgroup/memory");
+    }
+
+    if (!v2Directory.isEmpty() && QFile::exists(v2Directory + QStringLiteral("/memory.max")))
+        return v2Directory + QLatin1Char('/') + v2Name;
+
+    if (!v1Directory.isEmpty()) {
+        if (v2Name == QLatin1String("memory.max"))
+            return v1Directory + QStringLiteral("/memory.limit_in_bytes");
+        if (v2Name == QLatin1String("memory.current"))
+            return v1Directory + QStringLiteral("/memory.usage_in_bytes");
+    }
+
+    return QString();
+}
+
+/* Returns the memory limit of the cgroup the process is in, or 0 if there is none */
+static qulonglong cgroupMemoryLimit()
+{
+    const QString fileName = memoryCgroupFile(QStringLiteral("memory.max"));
+    return fileName.isEmpty() ? 0 : readCgroupValue(fileName);
+}
+#endif
+
 qulonglong DocumentPrivate::getTotalMemory()
 {
     static qulonglong cachedValue = 0;
@@ -429,8 +503,14 @@ qulonglong DocumentPrivate::getTotalMemory()
         QString entry = readStream.readLine();
         if (entry.isNull())
             break;
-        if (entry.startsWith(QLatin1String("MemTotal:")))
-            return (cachedValue = (Q_UINT64_C(1024) * entry.section(QLatin1Char(' '), -2, -2).toULongLong()));
+        if (entry.startsWith(QLatin1String("MemTotal:"))) {
+            cachedValue = Q_UINT64_C(1024) * entry.section(QLatin1Char(' '), -2, -2).toULongLong();
+            // a cgroup limit is all we can get, unlimited ones are bigger than the physical memory
+            const qulonglong cgroupLimit = cgroupMemoryLimit();
+            if (cgroupLimit > 0 && cgroupLimit < cachedValue)
+                cachedValue = cgroupLimit;
+            return cachedValue;
+        }
     }
 #elif defined(Q_OS_FREEBSD)
     qulonglong physmem;
@@ -509,9 +589,17 @@ qulonglong DocumentPrivate::getFreeMemory(qulonglong *freeSwap)
 
     lastUpdate = QTime::currentTime();
 
+    // the cgroup may run out of memory long before the system does
+    qulonglong bytesFree = Q_UINT64_C(1024) * memoryFree;
+    const qulonglong cgroupLimit = cgroupMemoryLimit();
+    if (cgroupLimit > 0) {
+        const qulonglong cgroupUsage = readCgroupValue(memoryCgroupFile(QStringLiteral("memory.current")));
+        bytesFree = qMin(bytesFree, cgroupLimit > cgroupUsage ? cgroupLimit - cgroupUsage : 0);
+    }
+
     if (freeSwap)
         *freeSwap = (cachedFreeSwap = (Q_UINT64_C(1024) * values[3]));
-    return (cachedValue = (Q_UINT64_C(1024) * memoryFree));
+    return (cachedValue = bytesFree);
 #elif defined(Q_OS_FREEBSD)
     qulonglong cache, inact, free, psize;
     size_t cachelen, inactlen, freelen, psizelen;
@@ -543,6 +631,98 @@ qulonglong DocumentPrivate::getFreeMemory(qulonglong *freeSwap)
 #endif
 }
 
+void DocumentPrivate::keepDownscaledPixmap(const AllocatedPixmap *p)
+{
+    m_downscaledPixmaps.setBudget(SettingsCore::memoryLevel() == SettingsCore::EnumMemoryLevel::Low ? 0 : Q_UINT64_C(1024) * 1024 * SettingsCore::downscaledPixmapCacheSize());
+    if (!m_downscaledPixmaps.budget())
+        return;
+
+    // tiled pages are only partially rendered, and partial pixmaps are placeholders already
+    const Page *page = m_pagesVector.at(p->page);
+    if (page->d->tilesManager(p->observer))
+        return;
+    const auto it = page->d->m_pixmaps.constFind(p->observer);
+    if (it == page->d->m_pixmaps.constEnd() || it->m_isPartialPixmap)
+        return;
+
+    // this runs for every evicted pixmap in the GUI thread, and the copy is only shown
+    // until the page is rendered again, so it's not worth smoothing it
+    const QPixmap *pixmap = it->m_pixmap;
+    m_downscaledPixmaps.insert(p->observer, p->page, pixmap->scaled(pixmap->size() / 2, Qt::IgnoreAspectRatio, Qt::FastTransformation), it->m_rotation);
+}
+
+bool DocumentPrivate::restoreDownscaledPixmap(DocumentObserver *observer, int pageNumber)
+{
+    QPixmap pixmap;
+    Rotation rotation;
+    if (!m_downscaledPixmaps.take(observer, pageNumber, &pixmap, &rotation))
+        return false;
+
+    Page *page = m_pagesVector.at(pageNumber);
+    if (rotation != page->rotation() || pixmap.isNull() || m_allocatedPixmaps.find(observer, pageNumber))
+        return false;
+
+    // a partial pixmap is shown scaled but doesn't satisfy hasPixmap() for any size,
+    // so it is replaced when the requested pixmap is done
+    PagePrivate::PixmapObject object;
+    object.m_pixmap = new QPixmap(pixmap);
+    object.m_rotation = rotation;
+    object.m_isPartialPixmap = true;
+    page->d->m_pixmaps.insert(observer, object);
+
+    const qulonglong memoryBytes = qulonglong(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+    m_allocatedPixmaps.insert(new AllocatedPixmap(observer, pageNumber, memoryBytes));
+    m_allocatedPixmapsTotalMemory += memoryBytes;
+    return true;
+}
+
+void DocumentPrivate::setupRenderCache(bool passwordProtected)
+{
+    delete m_renderCache;
+    m_renderCache = nullptr;
+
+    // the images are keyed by the file, so only local files that aren't
+    // temporary copies can use it, and only if the generator opts in
+    const qulonglong maximumSize = Q_UINT64_C(1024) * 1024 * SettingsCore::renderCacheSize();
+    if (!maximumSize || m_archiveData || !m_url.isLocalFile() || m_xmlFileName.isEmpty())
+        return;
+    if (!m_generator->metaData(QStringLiteral("RenderHints"), QVariant()).isValid())
+        return;
+
+    // the images are stored in clear, which would defeat the encryption
+    if (passwordProtected || m_generator->metaData(QStringLiteral("DocumentHasPassword"), QVariant()).toString() == QLatin1String("yes"))
+        return;
+
+    m_renderCache = new RenderCache(m_docFileName, m_localContentsDigest, maximumSize);
+    m_renderCache->setRenderHints(renderCacheHints());
+}
+
+QString DocumentPrivate::renderCacheHints() const
+{
+    const QColor paperColor = documentMetaData(Generator::PaperColorMetaData, true).value<QColor>();
+    return QStringLiteral("%1/%2/%3/%4/%5/%6")
+        .arg(m_generatorName, paperColor.name(QColor::HexArgb))
+        .arg(documentMetaData(Generator::TextAntialiasMetaData, QVariant()).toBool())
+        .arg(documentMetaData(Generator::GraphicsAntialiasMetaData, QVariant()).toBool())
+        .arg(documentMetaData(Generator::TextHintingMetaData, QVariant()).toBool())
+        .arg(m_generator->metaData(QStringLiteral("RenderHints"), QVariant()).toString());
+}
+
+qulonglong DocumentPrivate::pixmapCacheBudget()
+{
+    // in MiB, the environment overrides the configuration
+    static const QByteArray environmentBudget = qgetenv("OKULAR_PIXMAP_CACHE_SIZE");
+    bool ok = false;
+    qulonglong budget = environmentBudget.toULongLong(&ok);
+    if (!ok)
+        budget = SettingsCore::pixmapCacheSize();
+    if (!budget)
+        return 0;
+
+    // leave at least half of the memory (or of the cgroup limit) for everything else
+    return qMin(budget * 1024 * 1024, getTotalMemory() / 2);
+}
+
 bool DocumentPrivate::loadDocumentInfo(LoadDocumentInfoFlags loadWhat)
 // note: load data and stores it internally (document or pages). observers
 // are still uninitialized at this point so don't access them
@@ -583,6 +763,12 @@ bool DocumentPrivate::loadDocumentInfo(QFile &infoFile, LoadDocumentInfoFlags lo
 
         // Restore page attributes (bookmark, annotations, ...) from the DOM
         if (catName == QLatin1String("pageList") && (loadWhat & LoadPageInfo)) {
+            // the annotations and forms may be rendered into the pages, see RenderCache
+            QString pageList;
+            QTextStream pageListStream(&pageList);
+            topLevelNode.save(pageListStream, 0);
+            m_localContentsDigest = QCryptographicHash::hash(pageList.toUtf8(), QCryptographicHash::Sha1);
+
             QDomNode pageNode = topLevelNode.firstChild();
             while (pageNode.isElement()) {
                 QDomElement pageElement = pageNode.toElement();
@@ -1257,7 +1443,7 @@ void DocumentPrivate::saveDocumentInfo() const
 void DocumentPrivate::slotTimedMemoryCheck()
 {
     // [MEM] clean memory (for 'free mem dependent' profiles only)
-    if (SettingsCore::memoryLevel() != SettingsCore::EnumMemoryLevel::Low && m_allocatedPixmapsTotalMemory > 1024 * 1024)
+    if (SettingsCore::memoryLevel() != SettingsCore::EnumMemoryLevel::Low && m_allocatedPixmapsTotalMemory + generatorCachedMemory() > 1024 * 1024)
         cleanupPixmapMemory();
 }
 
@@ -1276,46 +1462,43 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
             maxDistance = qAbs(pixmapToReplace->page - currentViewportPage);
     }
 
+    const QScreen *screen = nullptr;
+    if (m_widget) {
+        const QWindow *window = m_widget->window()->windowHandle();
+        if (window)
+            screen = window->screen();
+    }
+    if (!screen)
+        screen = QGuiApplication::primaryScreen();
+    const long screenSize = screen->devicePixelRatio() * screen->size().width() * screen->devicePixelRatio() * screen->size().height();
+
     // find a request
     PixmapRequest *request = nullptr;
     m_pixmapRequestsMutex.lock();
-    while (!m_pixmapRequestsStack.isEmpty() && !request) {
-        PixmapRequest *r = m_pixmapRequestsStack.last();
-        if (!r) {
-            m_pixmapRequestsStack.pop_back();
-            continue;
-        }
+    while (!m_pixmapRequestsQueue.isEmpty() && !request) {
+        PixmapRequest *r = m_pixmapRequestsQueue.top();
 
         QRect requestRect = r->isTile() ? r->normalizedRect().geometry(r->width(), r->height()) : QRect(0, 0, r->width(), r->height());
         TilesManager *tilesManager = r->d->tilesManager();
         const double normalizedArea = r->normalizedRect().width() * r->normalizedRect().height();
-        const QScreen *screen = nullptr;
-        if (m_widget) {
-            const QWindow *window = m_widget->window()->windowHandle();
-            if (window)
-                screen = window->screen();
-        }
-        if (!screen)
-            screen = QGuiApplication::primaryScreen();
-        const long screenSize = screen->devicePixelRatio() * screen->size().width() * screen->devicePixelRatio() * screen->size().height();
 
         // If it's a preload but the generator is not threaded no point in trying to preload
         if (r->preload() && !m_generator->hasFeature(Generator::Threaded)) {
-            m_pixmapRequestsStack.pop_back();
+            m_pixmapRequestsQueue.remove(r);
             delete r;
         }
         // request only if page isn't already present and request has valid id
         else if ((!r->d->mForce && r->page()->hasPixmap(r->observer(), r->width(), r->height(), r->normalizedRect())) || !m_observers.contains(r->observer())) {
-            m_pixmapRequestsStack.pop_back();
+            m_pixmapRequestsQueue.remove(r);
             delete r;
         } else if (!r->d->mForce && r->preload() && qAbs(r->pageNumber() - currentViewportPage) >= maxDistance) {
-            m_pixmapRequestsStack.pop_back();
+            m_pixmapRequestsQueue.remove(r);
             // qCDebug(OkularCoreDebug) << "Ignoring request that doesn't fit in cache";
             delete r;
         }
         // Ignore requests for pixmaps that are already being generated
         else if (tilesManager && tilesManager->isRequesting(r->normalizedRect(), r->width(), r->height())) {
-            m_pixmapRequestsStack.pop_back();
+            m_pixmapRequestsQueue.remove(r);
             delete r;
         }
         // If the requested area is above 4*screenSize pixels, and we're not rendering most of the page,  switch on the tile manager
@@ -1361,7 +1544,7 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
                 // preload requests issued by PageView if the requested page is
                 // not visible and the user has just switched from a non-tiled
                 // zoom level to a tiled one
-                m_pixmapRequestsStack.pop_back();
+                m_pixmapRequestsQueue.remove(r);
                 delete r;
             }
         }
@@ -1375,7 +1558,7 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
 
             request = r;
         } else if ((long)requestRect.width() * (long)requestRect.height() > 100L * screenSize && (SettingsCore::memoryLevel() != SettingsCore::EnumMemoryLevel::Greedy)) {
-            m_pixmapRequestsStack.pop_back();
+            m_pixmapRequestsQueue.remove(r);
             if (!m_warnedOutOfMemory) {
                 qCWarning(OkularCoreDebug).nospace() << "Running out of memory on page " << r->pageNumber() << " (" << r->width() << "x" << r->height() << " px);";
                 qCWarning(OkularCoreDebug) << "this message will be reported only once.";
@@ -1401,15 +1584,23 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
     else
         pixmapBytes = 4 * request->width() * request->height();
 
-    if (pixmapBytes > (1024 * 1024))
+    const qulonglong budget = pixmapCacheBudget();
+    if (budget) {
+        // make room for the new pixmap so that the budget is never exceeded,
+        // the caches of the generator count against it too
+        const qulonglong usedMemory = m_allocatedPixmapsTotalMemory + generatorCachedMemory();
+        if (usedMemory + pixmapBytes > budget)
+            cleanupPixmapMemory(usedMemory + pixmapBytes - budget);
+    } else if (pixmapBytes > (1024 * 1024)) {
         cleanupPixmapMemory(memoryToFree /* previously calculated value */);
+    }
 
     // submit the request to the generator
     if (m_generator->canGeneratePixmap()) {
         QRect requestRect = !request->isTile() ? QRect(0, 0, request->width(), request->height()) : request->normalizedRect().geometry(request->width(), request->height());
+        m_pixmapRequestsQueue.removeDispatched(request);
         qCDebug(OkularCoreDebug).nospace() << "sending request observer=" << request->observer() << " " << requestRect.width() << "x" << requestRect.height() << "@" << request->pageNumber() << " async == " << request->asynchronous()
-                                           << " isTile == " << request->isTile();
-        m_pixmapRequestsStack.removeAll(request);
+                                           << " isTile == " << request->isTile() << " queued == " << m_pixmapRequestsQueue.count() << " waited == " << m_pixmapRequestsQueue.lastWaitTime() << "ms";
 
         if (tm)
             tm->setRequest(request->normalizedRect(), request->width(), request->height());
@@ -1430,7 +1621,18 @@ void DocumentPrivate::sendGeneratorPixmapRequest()
         // we can not really know if the generator can do async requests
         m_executingPixmapRequests.push_back(request);
         m_pixmapRequestsMutex.unlock();
+        const bool threadedRequest = request->asynchronous() && m_generator->hasFeature(Generator::Threaded);
         m_generator->generatePixmap(request);
+
+        // Generators rendering concurrently accept more than one request at
+        // a time, keep feeding them until all their threads are busy
+        if (threadedRequest && m_generator->hasFeature(Generator::ConcurrentRendering) && m_generator->canGeneratePixmap()) {
+            m_pixmapRequestsMutex.lock();
+            const bool hasPixmaps = !m_pixmapRequestsQueue.isEmpty();
+            m_pixmapRequestsMutex.unlock();
+            if (hasPixmaps)
+                sendGeneratorPixmapRequest();
+        }
     } else {
         m_pixmapRequestsMutex.unlock();
         // pino (7/4/2006): set the polling interval from 10 to 30
@@ -1486,6 +1688,10 @@ void DocumentPrivate::slotGeneratorConfigChanged()
         }
     }
     if (configchanged) {
+        // the images on disk were rendered with the old settings
+        if (m_renderCache)
+            m_renderCache->setRenderHints(renderCacheHints());
+
         // invalidate pixmaps
         QVector<Page *>::const_iterator it = m_pagesVector.constBegin(), end = m_pagesVector.constEnd();
         for (; it != end; ++it) {
@@ -1493,8 +1699,8 @@ void DocumentPrivate::slotGeneratorConfigChanged()
         }
 
         // [MEM] remove allocation descriptors
-        qDeleteAll(m_allocatedPixmaps);
-        m_allocatedPixmaps.clear();
+        qDeleteAll(m_allocatedPixmaps.takeAll());
+        m_downscaledPixmaps.clear();
         m_allocatedPixmapsTotalMemory = 0;
 
         // send reload signals to observers
@@ -1512,6 +1718,15 @@ void DocumentPrivate::refreshPixmaps(int pageNumber)
     if (!page)
         return;
 
+    // the downscaled copies and the rendered images on disk show the old contents,
+    // and the new ones are not what the file shows if the changes are discarded
+    for (DocumentObserver *observer : qAsConst(m_observers))
+        m_downscaledPixmaps.remove(observer, pageNumber);
+    if (m_renderCache) {
+        m_renderCache->stopStoring();
+        m_renderCache->removePage(pageNumber);
+    }
+
     QMap<DocumentObserver *, PagePrivate::PixmapObject>::ConstIterator it = page->d->m_pixmaps.constBegin(), itEnd = page->d->m_pixmaps.constEnd();
     QVector<Okular::PixmapRequest *> pixmapsToRequest;
     for (; it != itEnd; ++it) {
@@ -1930,6 +2145,9 @@ QVariant DocumentPrivate::documentMetaData(const Generator::DocumentMetaDataKey
             break;
         }
         break;
+
+    case Generator::RenderCacheMetaData:
+        return m_renderCache != nullptr;
     }
     return QVariant();
 }
@@ -2057,11 +2275,7 @@ void DocumentPrivate::loadSyncFile(const QString &filePath)
 void DocumentPrivate::clearAndWaitForRequests()
 {
     m_pixmapRequestsMutex.lock();
-    QLinkedList<PixmapRequest *>::const_iterator sIt = m_pixmapRequestsStack.constBegin();
-    QLinkedList<PixmapRequest *>::const_iterator sEnd = m_pixmapRequestsStack.constEnd();
-    for (; sIt != sEnd; ++sIt)
-        delete *sIt;
-    m_pixmapRequestsStack.clear();
+    qDeleteAll(m_pixmapRequestsQueue.takeAll());
     m_pixmapRequestsMutex.unlock();
 
     QEventLoop loop;
@@ -2405,6 +2619,9 @@ Document::OpenResult Document::openDocument(const QString &docFile, const QUrl &
     d->m_metadataLoadingCompleted = true;
     d->m_bookmarkManager->setUrl(d->m_url);
 
+    // the rendered pages depend on the annotations and forms loaded above
+    d->setupRenderCache(!password.isEmpty());
+
     // 3. setup observers internal lists and data
     foreachObserver(notifySetup(d->m_pagesVector, DocumentObserver::DocumentChanged | DocumentObserver::UrlChanged));
 
@@ -2579,6 +2796,9 @@ void Document::closeDocument()
     delete d->m_archiveData;
     d->m_archiveData = nullptr;
     d->m_docSize = -1;
+    d->m_localContentsDigest.clear();
+    delete d->m_renderCache;
+    d->m_renderCache = nullptr;
     d->m_exportCached = false;
     d->m_exportFormats.clear();
     d->m_exportToText = ExportFormat();
@@ -2597,8 +2817,8 @@ void Document::closeDocument()
     d->m_pagesVector.clear();
 
     // clear 'memory allocation' descriptors
-    qDeleteAll(d->m_allocatedPixmaps);
-    d->m_allocatedPixmaps.clear();
+    qDeleteAll(d->m_allocatedPixmaps.takeAll());
+    d->m_downscaledPixmaps.clear();
 
     // clear 'running searches' descriptors
     QMap<int, RunningSearch *>::const_iterator rIt = d->m_searches.constBegin();
@@ -2663,16 +2883,12 @@ void Document::removeObserver(DocumentObserver *pObserver)
             (*it)->deletePixmap(pObserver);
 
         // [MEM] free observer's allocation descriptors
-        QLinkedList<AllocatedPixmap *>::iterator aIt = d->m_allocatedPixmaps.begin();
-        QLinkedList<AllocatedPixmap *>::iterator aEnd = d->m_allocatedPixmaps.end();
-        while (aIt != aEnd) {
-            AllocatedPixmap *p = *aIt;
-            if (p->observer == pObserver) {
-                aIt = d->m_allocatedPixmaps.erase(aIt);
-                delete p;
-            } else
-                ++aIt;
+        const QVector<AllocatedPixmap *> observerPixmaps = d->m_allocatedPixmaps.take(pObserver);
+        for (AllocatedPixmap *p : observerPixmaps) {
+            d->m_allocatedPixmapsTotalMemory -= p->memory;
+            delete p;
         }
+        d->m_downscaledPixmaps.remove(pObserver);
 
         for (PixmapRequest *executingRequest : qAsConst(d->m_executingPixmapRequests)) {
             if (executingRequest->observer() == pObserver) {
@@ -2695,6 +2911,10 @@ void Document::reparseConfig()
             configchanged = iface->reparseConfig();
     }
     if (configchanged) {
+        // the images on disk were rendered with the old settings
+        if (d->m_renderCache)
+            d->m_renderCache->setRenderHints(d->renderCacheHints());
+
         // invalidate pixmaps
         QVector<Page *>::const_iterator it = d->m_pagesVector.constBegin(), end = d->m_pagesVector.constEnd();
         for (; it != end; ++it) {
@@ -2702,8 +2922,8 @@ void Document::reparseConfig()
         }
 
         // [MEM] remove allocation descriptors
-        qDeleteAll(d->m_allocatedPixmaps);
-        d->m_allocatedPixmaps.clear();
+        qDeleteAll(d->m_allocatedPixmaps.takeAll());
+        d->m_downscaledPixmaps.clear();
         d->m_allocatedPixmapsTotalMemory = 0;
 
         // send reload signals to observers
@@ -2862,11 +3082,26 @@ const QVector<VisiblePageRect *> &Document::visiblePageRects() const
 
 void Document::setVisiblePageRects(const QVector<VisiblePageRect *> &visiblePageRects, DocumentObserver *excludeObserver)
 {
+    QSet<int> previouslyVisiblePages;
     QVector<VisiblePageRect *>::const_iterator vIt = d->m_pageRects.constBegin();
     QVector<VisiblePageRect *>::const_iterator vEnd = d->m_pageRects.constEnd();
-    for (; vIt != vEnd; ++vIt)
+    for (; vIt != vEnd; ++vIt) {
+        previouslyVisiblePages.insert((*vIt)->pageNumber);
         delete *vIt;
+    }
     d->m_pageRects = visiblePageRects;
+
+    // [MEM] the pixmaps of the visible pages were just used, count the
+    // pages that come into view and already have one as cache hits
+    if (excludeObserver) {
+        for (const VisiblePageRect *rect : visiblePageRects) {
+            AllocatedPixmap *p = d->m_allocatedPixmaps.find(excludeObserver, rect->pageNumber);
+            if (!previouslyVisiblePages.contains(rect->pageNumber))
+                d->m_allocatedPixmaps.recordLookup(p != nullptr);
+            if (p)
+                d->m_allocatedPixmaps.touch(p);
+        }
+    }
     // notify change to all other (different from id) observers
     foreach (DocumentObserver *o, d->m_observers)
         if (o != excludeObserver)
@@ -3164,7 +3399,7 @@ void Document::requestPixmaps(const QLinkedList<PixmapRequest *> &requests, Pixm
 
     QSet<DocumentObserver *> observersPixmapCleared;
 
-    // 1. [CLEAN STACK] remove previous requests of requesterID
+    // 1. [CLEAN QUEUE] remove previous requests of requesterID
     DocumentObserver *requesterObserver = requests.first()->observer();
     QSet<int> requestedPages;
     {
@@ -3175,16 +3410,9 @@ void Document::requestPixmaps(const QLinkedList<PixmapRequest *> &requests, Pixm
         }
     }
     const bool removeAllPrevious = reqOptions & RemoveAllPrevious;
+    QVector<int> downscaledPages;
     d->m_pixmapRequestsMutex.lock();
-    QLinkedList<PixmapRequest *>::iterator sIt = d->m_pixmapRequestsStack.begin(), sEnd = d->m_pixmapRequestsStack.end();
-    while (sIt != sEnd) {
-        if ((*sIt)->observer() == requesterObserver && (removeAllPrevious || requestedPages.contains((*sIt)->pageNumber()))) {
-            // delete request and remove it from stack
-            delete *sIt;
-            sIt = d->m_pixmapRequestsStack.erase(sIt);
-        } else
-            ++sIt;
-    }
+    qDeleteAll(removeAllPrevious ? d->m_pixmapRequestsQueue.takeRequests(requesterObserver) : d->m_pixmapRequestsQueue.takeRequests(requesterObserver, requestedPages));
 
     // 1.B [PREPROCESS REQUESTS] tweak some values of the requests
     for (PixmapRequest *request : requests) {
@@ -3198,6 +3426,10 @@ void Document::requestPixmaps(const QLinkedList<PixmapRequest *> &requests, Pixm
 
         request->d->mPage = d->m_pagesVector.value(request->pageNumber());
 
+        // [MEM] pages about to be shown can use the downscaled copy of their evicted pixmap until they are rendered again
+        if (!request->preload() && !request->isTile() && !request->page()->hasTilesManager(request->observer()) && !request->page()->hasPixmap(request->observer()))
+            downscaledPages << request->pageNumber();
+
         if (request->isTile()) {
             // Change the current request rect so that only invalid tiles are
             // requested. Also make sure the rect is tile-aligned.
@@ -3249,23 +3481,19 @@ void Document::requestPixmaps(const QLinkedList<PixmapRequest *> &requests, Pixm
         }
     }
 
-    // 2. [ADD TO STACK] add requests to stack
-    for (PixmapRequest *request : requests) {
-        // add request to the 'stack' at the right place
-        if (!request->priority())
-            // add priority zero requests to the top of the stack
-            d->m_pixmapRequestsStack.append(request);
-        else {
-            // insert in stack sorted by priority
-            sIt = d->m_pixmapRequestsStack.begin();
-            sEnd = d->m_pixmapRequestsStack.end();
-            while (sIt != sEnd && (*sIt)->priority() > request->priority())
-                ++sIt;
-            d->m_pixmapRequestsStack.insert(sIt, request);
-        }
-    }
+    // 2. [ADD TO QUEUE] add requests to the queue, sorted by priority and distance from the viewport
+    const int currentViewportPage = (*d->m_viewportIterator).pageNumber;
+    for (PixmapRequest *request : requests)
+        d->m_pixmapRequestsQueue.enqueue(request, currentViewportPage);
     d->m_pixmapRequestsMutex.unlock();
 
+    // restore them before any request is sent, a synchronous one replaces the copy right away
+    QVector<int> restoredPages;
+    for (int pageNumber : qAsConst(downscaledPages)) {
+        if (d->restoreDownscaledPixmap(requesterObserver, pageNumber))
+            restoredPages << pageNumber;
+    }
+
     // 3. [START FIRST GENERATION] if <NO>generator is ready, start a new generation,
     // or else (if gen is running) it will be started when the new contents will
     // come from generator (in requestDone())</NO>
@@ -3275,6 +3503,34 @@ void Document::requestPixmaps(const QLinkedList<PixmapRequest *> &requests, Pixm
 
     for (DocumentObserver *o : qAsConst(observersPixmapCleared))
         o->notifyContentsCleared(Okular::DocumentObserver::Pixmap);
+
+    for (int pageNumber : qAsConst(restoredPages))
+        requesterObserver->notifyPageChanged(pageNumber, DocumentObserver::Pixmap);
+}
+
+qulonglong Document::pixmapCacheMemoryUsage() const
+{
+    return d->m_allocatedPixmapsTotalMemory;
+}
+
+qulonglong Document::pixmapCacheMemoryBudget() const
+{
+    return d->pixmapCacheBudget();
+}
+
+double Document::pixmapCacheHitRate() const
+{
+    return d->m_allocatedPixmaps.hitRate();
+}
+
+qulonglong Document::downscaledPixmapCacheMemoryUsage() const
+{
+    return d->m_downscaledPixmaps.memoryUsage();
+}
+
+double Document::downscaledPixmapCacheHitRate() const
+{
+    return d->m_downscaledPixmaps.hitRate();
 }
 
 void Document::requestTextPage(uint pageNumber)
@@ -4995,20 +5251,15 @@ void DocumentPrivate::requestDone(PixmapRequest *req)
 
     if (!req->shouldAbortRender()) {
         // [MEM] 1.1 find and remove a previous entry for the same page and id
-        QLinkedList<AllocatedPixmap *>::iterator aIt = m_allocatedPixmaps.begin();
-        QLinkedList<AllocatedPixmap *>::iterator aEnd = m_allocatedPixmaps.end();
-        for (; aIt != aEnd; ++aIt)
-            if ((*aIt)->page == req->pageNumber() && (*aIt)->observer == req->observer()) {
-                AllocatedPixmap *p = *aIt;
-                m_allocatedPixmaps.erase(aIt);
-                m_allocatedPixmapsTotalMemory -= p->memory;
-                delete p;
-                break;
-            }
+        if (AllocatedPixmap *p = m_allocatedPixmaps.find(req->observer(), req->pageNumber())) {
+            m_allocatedPixmaps.remove(p);
+            m_allocatedPixmapsTotalMemory -= p->memory;
+            delete p;
+        }
 
         DocumentObserver *observer = req->observer();
         if (m_observers.contains(observer)) {
-            // [MEM] 1.2 append memory allocation descriptor to the FIFO
+            // [MEM] 1.2 add memory allocation descriptor to the cache
             qulonglong memoryBytes = 0;
             const TilesManager *tm = req->d->tilesManager();
             if (tm)
@@ -5017,7 +5268,7 @@ void DocumentPrivate::requestDone(PixmapRequest *req)
                 memoryBytes = 4 * req->width() * req->height();
 
             AllocatedPixmap *memoryPage = new AllocatedPixmap(req->observer(), req->pageNumber(), memoryBytes);
-            m_allocatedPixmaps.append(memoryPage);
+            m_allocatedPixmaps.insert(memoryPage);
             m_allocatedPixmapsTotalMemory += memoryBytes;
 
             // 2. notify an observer that its pixmap changed
@@ -5037,7 +5288,7 @@ void DocumentPrivate::requestDone(PixmapRequest *req)
 
     // 4. start a new generation if some is pending
     m_pixmapRequestsMutex.lock();
-    bool hasPixmaps = !m_pixmapRequestsStack.isEmpty();
+    bool hasPixmaps = !m_pixmapRequestsQueue.isEmpty();
     m_pixmapRequestsMutex.unlock();
     if (hasPixmaps)
         sendGeneratorPixmapRequest();
@@ -5062,6 +5313,54 @@ void DocumentPrivate::setPageBoundingBox(int page, const NormalizedRect &boundin
     // TODO: Don't compute the bounding box if no one needs it (e.g., Trim Borders is off).
 }
 
+void DocumentPrivate::addGeneratedPageAnnotations(int page, const QList<Annotation *> &annotations)
+{
+    Page *kp = m_pagesVector.value(page);
+    if (!m_generator || !kp) {
+        qDeleteAll(annotations);
+        return;
+    }
+
+    for (Annotation *annotation : annotations)
+        kp->addAnnotation(annotation);
+
+    // notify observers about the change
+    notifyAnnotationChanges(page);
+}
+
+void DocumentPrivate::setPageSizes(const QHash<int, QSizeF> &sizes)
+{
+    if (!m_generator)
+        return;
+
+    bool changed = false;
+    for (auto it = sizes.constBegin(); it != sizes.constEnd(); ++it) {
+        Page *kp = m_pagesVector.value(it.key());
+        if (!kp)
+            continue;
+
+        const QSizeF size = (kp->rotation() % 2) ? it.value().transposed() : it.value();
+        if (size.isEmpty() || (size.width() == kp->width() && size.height() == kp->height()))
+            continue;
+
+        // the pixmaps have the old aspect ratio, forget them
+        kp->d->changeSize(PageSize(it.value().width(), it.value().height(), QString()));
+        for (DocumentObserver *observer : qAsConst(m_observers)) {
+            if (AllocatedPixmap *p = m_allocatedPixmaps.find(observer, it.key())) {
+                m_allocatedPixmaps.remove(p);
+                m_allocatedPixmapsTotalMemory -= p->memory;
+                delete p;
+            }
+            m_downscaledPixmaps.remove(observer, it.key());
+        }
+        changed = true;
+    }
+
+    // a single relayout for all of them
+    if (changed)
+        foreachObserverD(notifySetup(m_pagesVector, DocumentObserver::NewLayoutForPages));
+}
+
 void DocumentPrivate::calculateMaxTextPages()
 {
     int multipliers = qMax(1, qRound(getTotalMemory() / 536870912.0)); // 512 MB
@@ -5149,8 +5448,8 @@ void Document::setPageSize(const PageSize &size)
     for (; pIt != pEnd; ++pIt)
         (*pIt)->d->changeSize(size);
     // clear 'memory allocation' descriptors
-    qDeleteAll(d->m_allocatedPixmaps);
-    d->m_allocatedPixmaps.clear();
+    qDeleteAll(d->m_allocatedPixmaps.takeAll());
+    d->m_downscaledPixmaps.clear();
     d->m_allocatedPixmapsTotalMemory = 0;
     // notify the generator that the current page size has changed
     d->m_generator->pageSizeChanged(size, d->m_pageSize);
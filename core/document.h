@@ -502,6 +502,47 @@ public:
      */
     void requestPixmaps(const QLinkedList<PixmapRequest *> &requests, PixmapRequestFlags reqOptions);
 
+    /**
+     * Returns the memory in bytes used by the pixmaps of all the observers.
+     *
+     * @since 22.04
+     */
+    qulonglong pixmapCacheMemoryUsage() const;
+
+    /**
+     * Returns the memory in bytes the pixmaps of all the observers are
+     * allowed to use, or 0 if it depends on the memory usage profile and
+     * the free memory.
+     *
+     * @since 22.04
+     */
+    qulonglong pixmapCacheMemoryBudget() const;
+
+    /**
+     * Returns the fraction, between 0 and 1, of the pages scrolled into the
+     * main view that already had a pixmap in memory.
+     *
+     * @since 22.04
+     */
+    double pixmapCacheHitRate() const;
+
+    /**
+     * Returns the memory in bytes used by the downscaled copies of the
+     * pixmaps evicted from the cache, which are shown while their pages
+     * are rendered again.
+     *
+     * @since 22.04
+     */
+    qulonglong downscaledPixmapCacheMemoryUsage() const;
+
+    /**
+     * Returns the fraction, between 0 and 1, of the pixmap requests for
+     * pages without a pixmap that could show a downscaled copy.
+     *
+     * @since 22.04
+     */
+    double downscaledPixmapCacheHitRate() const;
+
     /**
      * Sends a request for text page generation for the given page @p pageNumber.
      */
@@ -1294,6 +1335,14 @@ Q_SIGNALS:
      */
     void refreshFormWidget(Okular::FormField *field);
 
+    /**
+     * This signal is emitted when freeing the pixmaps of the document wasn't enough
+     * to get below the memory limits, so the caches kept outside of the document,
+     * like the ones of the views, should be emptied too.
+     * @since 22.04
+     */
+    void freeCachedMemoryRequested();
+
 private:
     /// @cond PRIVATE
     friend class DocumentPrivate;
@@ -27,6 +27,8 @@
 // local includes
 #include "fontinfo.h"
 #include "generator.h"
+#include "pixmapcache_p.h"
+#include "pixmaprequestqueue_p.h"
 
 class QUndoStack;
 class QEventLoop;
@@ -35,7 +37,6 @@ class QTimer;
 class QTemporaryFile;
 class KPluginMetaData;
 
-struct AllocatedPixmap;
 struct ArchiveData;
 struct RunningSearch;
 
@@ -44,6 +45,7 @@ namespace Okular
 class ScriptAction;
 class ConfigInterface;
 class PageController;
+class RenderCache;
 class SaveInterface;
 class Scripter;
 class View;
@@ -110,6 +112,7 @@ public:
         , m_tempFile(nullptr)
         , m_docSize(-1)
         , m_allocatedPixmapsTotalMemory(0)
+        , m_renderCache(nullptr)
         , m_maxAllocatedTextPages(0)
         , m_warnedOutOfMemory(false)
         , m_rotation(Rotation0)
@@ -139,12 +142,18 @@ public:
     QString namePaperSize(double inchesWidth, double inchesHeight) const;
     QString localizedSize(const QSizeF size) const;
     qulonglong calculateMemoryToFree();
+    qulonglong generatorCachedMemory() const;
     void cleanupPixmapMemory();
     void cleanupPixmapMemory(qulonglong memoryToFree);
     AllocatedPixmap *searchLowestPriorityPixmap(bool unloadableOnly = false, bool thenRemoveIt = false, DocumentObserver *observer = nullptr /* any */);
     void calculateMaxTextPages();
     qulonglong getTotalMemory();
     qulonglong getFreeMemory(qulonglong *freeSwap = nullptr);
+    qulonglong pixmapCacheBudget();
+    void keepDownscaledPixmap(const AllocatedPixmap *p);
+    bool restoreDownscaledPixmap(DocumentObserver *observer, int pageNumber);
+    void setupRenderCache(bool passwordProtected);
+    QString renderCacheHints() const;
     bool loadDocumentInfo(LoadDocumentInfoFlags loadWhat);
     bool loadDocumentInfo(QFile &infoFile, LoadDocumentInfoFlags loadWhat);
     void loadViewsInfo(View *view, const QDomElement &e);
@@ -214,6 +223,16 @@ public:
      */
     void setPageBoundingBox(int page, const NormalizedRect &boundingBox);
 
+    /**
+     * Adds the @p annotations the generator loaded for @p page after opening the document.
+     */
+    void addGeneratedPageAnnotations(int page, const QList<Annotation *> &annotations);
+
+    /**
+     * Changes the size of the pages in @p sizes (in terms of upright orientation), that the generator only guessed.
+     */
+    void setPageSizes(const QHash<int, QSizeF> &sizes);
+
     /**
      * Request a particular metadata of the Document itself (ie, not something
      * depending on the document type/backend).
@@ -258,6 +277,8 @@ public:
     QString m_xmlFileName;
     QTemporaryFile *m_tempFile;
     qint64 m_docSize;
+    // hash of the annotations and forms loaded from the docdata file
+    QByteArray m_localContentsDigest;
 
     // viewport stuff
     QLinkedList<DocumentViewport> m_viewportHistory;
@@ -267,11 +288,14 @@ public:
 
     // observers / requests / allocator stuff
     QSet<DocumentObserver *> m_observers;
-    QLinkedList<PixmapRequest *> m_pixmapRequestsStack;
+    PixmapRequestQueue m_pixmapRequestsQueue;
     QLinkedList<PixmapRequest *> m_executingPixmapRequests;
     QMutex m_pixmapRequestsMutex;
-    QLinkedList<AllocatedPixmap *> m_allocatedPixmaps;
+    PixmapCache m_allocatedPixmaps;
+    DownscaledPixmapCache m_downscaledPixmaps;
     qulonglong m_allocatedPixmapsTotalMemory;
+    // rendered pages kept on disk, only for local files and if enabled
+    RenderCache *m_renderCache;
     QList<int> m_allocatedTextPagesFifo;
     int m_maxAllocatedTextPages;
     bool m_warnedOutOfMemory;
@@ -26,9 +26,12 @@
 #include <KWallet>
 #endif
 
+#include "annotations.h"
 #include "document_p.h"
 #include "page.h"
 #include "page_p.h"
+#include "rendercache_p.h"
+#include "settings_core.h"
 #include "textpage.h"
 #include "utils.h"
 
@@ -36,8 +39,8 @@ using namespace Okular;
 
 GeneratorPrivate::GeneratorPrivate()
     : m_document(nullptr)
-    , mPixmapGenerationThread(nullptr)
     , mTextPageGenerationThread(nullptr)
+    , mRunningPixmapGenerations(0)
     , mPixmapReady(true)
     , mTextPageReady(true)
     , m_closing(false)
@@ -49,10 +52,10 @@ GeneratorPrivate::GeneratorPrivate()
 
 GeneratorPrivate::~GeneratorPrivate()
 {
-    if (mPixmapGenerationThread)
-        mPixmapGenerationThread->wait();
-
-    delete mPixmapGenerationThread;
+    for (PixmapGenerationThread *thread : qAsConst(mPixmapGenerationThreads)) {
+        thread->wait();
+        delete thread;
+    }
 
     if (mTextPageGenerationThread)
         mTextPageGenerationThread->wait();
@@ -62,15 +65,22 @@ GeneratorPrivate::~GeneratorPrivate()
 
 PixmapGenerationThread *GeneratorPrivate::pixmapGenerationThread()
 {
-    if (mPixmapGenerationThread)
-        return mPixmapGenerationThread;
+    // reuse an idle thread if there is one
+    for (PixmapGenerationThread *thread : qAsConst(mPixmapGenerationThreads)) {
+        if (!thread->request())
+            return thread;
+    }
+
+    if (mPixmapGenerationThreads.count() >= maxPixmapGenerationThreads())
+        return nullptr;
 
     Q_Q(Generator);
-    mPixmapGenerationThread = new PixmapGenerationThread(q);
+    PixmapGenerationThread *thread = new PixmapGenerationThread(q);
     QObject::connect(
-        mPixmapGenerationThread, &PixmapGenerationThread::finished, q, [this] { pixmapGenerationFinished(); }, Qt::QueuedConnection);
+        thread, &PixmapGenerationThread::finished, q, [this, thread] { pixmapGenerationFinished(thread); }, Qt::QueuedConnection);
+    mPixmapGenerationThreads.append(thread);
 
-    return mPixmapGenerationThread;
+    return thread;
 }
 
 TextPageGenerationThread *GeneratorPrivate::textPageGenerationThread()
@@ -86,19 +96,36 @@ TextPageGenerationThread *GeneratorPrivate::textPageGenerationThread()
     return mTextPageGenerationThread;
 }
 
-void GeneratorPrivate::pixmapGenerationFinished()
+int GeneratorPrivate::maxPixmapGenerationThreads() const
+{
+    // without a document there are no settings to read from
+    if (!m_document || !m_features.contains(Generator::Threaded) || !m_features.contains(Generator::ConcurrentRendering))
+        return 1;
+
+    const int configuredThreads = SettingsCore::renderingThreads();
+    if (configuredThreads > 0)
+        return configuredThreads;
+
+    return qMax(1, QThread::idealThreadCount());
+}
+
+void GeneratorPrivate::pixmapGenerationFinished(PixmapGenerationThread *thread)
 {
     Q_Q(Generator);
-    PixmapRequest *request = mPixmapGenerationThread->request();
-    const QImage &img = mPixmapGenerationThread->image();
-    mPixmapGenerationThread->endGeneration();
+    PixmapRequest *request = thread->request();
+    QImage img = thread->takeImage();
+    const bool calcBoundingBox = thread->calcBoundingBox();
+    const NormalizedRect boundingBox = thread->boundingBox();
+    thread->endGeneration();
 
     QMutexLocker locker(threadsLock());
 
+    --mRunningPixmapGenerations;
+    mPixmapReady = (mRunningPixmapGenerations == 0);
+
     if (m_closing) {
-        mPixmapReady = true;
         delete request;
-        if (mTextPageReady) {
+        if (mPixmapReady && mTextPageReady) {
             locker.unlock();
             m_closingLoop->quit();
         }
@@ -106,20 +133,20 @@ void GeneratorPrivate::pixmapGenerationFinished()
     }
 
     if (!request->shouldAbortRender()) {
-        request->page()->setPixmap(request->observer(), new QPixmap(QPixmap::fromImage(img)), request->normalizedRect());
+        PagePrivate::get(request->page())->setImage(request->observer(), std::move(img), request->normalizedRect(), false /*isPartialPixmap*/);
         const int pageNumber = request->page()->number();
 
-        if (mPixmapGenerationThread->calcBoundingBox())
-            q->updatePageBoundingBox(pageNumber, mPixmapGenerationThread->boundingBox());
+        if (calcBoundingBox)
+            q->updatePageBoundingBox(pageNumber, boundingBox);
     } else {
-        // Cancel the text page generation too if it's still running
-        if (mTextPageGenerationThread && mTextPageGenerationThread->isRunning()) {
+        // Cancel the text page generation too if it's still running for this page,
+        // it may be working on another one for a request that is still wanted
+        if (mTextPageGenerationThread && mTextPageGenerationThread->isRunning() && mTextPageGenerationThread->page() == request->page()) {
             mTextPageGenerationThread->abortExtraction();
             mTextPageGenerationThread->wait();
         }
     }
 
-    mPixmapReady = true;
     q->signalPixmapRequestDone(request);
 }
 
@@ -163,6 +190,34 @@ QImage GeneratorPrivate::image(PixmapRequest *)
     return QImage();
 }
 
+QImage GeneratorPrivate::toPixmapFormat(QImage &&image)
+{
+    // the formats the raster QPixmap backend keeps as they are
+    const QImage::Format format = image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+    if (image.isNull() || image.format() == format)
+        return std::move(image);
+
+    return std::move(image).convertToFormat(format);
+}
+
+QImage GeneratorPrivate::renderImage(PixmapRequest *request)
+{
+    Q_Q(Generator);
+    // tiles are only a part of the page, they are rendered again when zooming anyway
+    RenderCache *cache = m_document && !request->isTile() ? m_document->m_renderCache : nullptr;
+    if (cache) {
+        const QImage cached = cache->load(request->pageNumber(), request->width(), request->height(), request->page()->rotation());
+        if (!cached.isNull())
+            return cached;
+    }
+
+    const QImage img = q->image(request);
+    if (cache && !img.isNull() && !request->shouldAbortRender())
+        cache->store(request->pageNumber(), request->page()->rotation(), img);
+
+    return img;
+}
+
 Generator::Generator(QObject *parent, const QVariantList &args)
     : Generator(*new GeneratorPrivate(), parent, args)
 {
@@ -240,7 +295,7 @@ bool Generator::closeDocument()
 bool Generator::canGeneratePixmap() const
 {
     Q_D(const Generator);
-    return d->mPixmapReady;
+    return d->mRunningPixmapGenerations < d->maxPixmapGenerationThreads();
 }
 
 bool Generator::canSign() const
@@ -261,6 +316,7 @@ CertificateStore *Generator::certificateStore() const
 void Generator::generatePixmap(PixmapRequest *request)
 {
     Q_D(Generator);
+    ++d->mRunningPixmapGenerations;
     d->mPixmapReady = false;
 
     const bool calcBoundingBox = !request->isTile() && !request->page()->isBoundingBoxKnown();
@@ -270,10 +326,17 @@ void Generator::generatePixmap(PixmapRequest *request)
             // It can happen that the text generation has already finished but
             // mTextPageReady is still false because textpageGenerationFinished
             // didn't have time to run, if so queue ourselves
-            QTimer::singleShot(0, this, [this, request] { generatePixmap(request); });
+            QTimer::singleShot(0, this, [this, request] {
+                // we will be accounted again when re-entering generatePixmap
+                --d_ptr->mRunningPixmapGenerations;
+                generatePixmap(request);
+            });
             return;
         }
 
+        PixmapGenerationThread *pixmapThread = d->pixmapGenerationThread();
+        Q_ASSERT(pixmapThread);
+
         /**
          * We create the text page for every page that is visible to the
          * user, so he can use the text extraction tools without a delay.
@@ -285,26 +348,28 @@ void Generator::generatePixmap(PixmapRequest *request)
             // dummy is used as a way to make sure the lambda gets disconnected each time it is executed
             // since not all the times the pixmap generation thread starts we want the text generation thread to also start
             QObject *dummy = new QObject();
-            connect(d_ptr->pixmapGenerationThread(), &QThread::started, dummy, [this, dummy] {
+            connect(pixmapThread, &QThread::started, dummy, [this, dummy] {
                 delete dummy;
                 d_ptr->textPageGenerationThread()->startGeneration();
             });
         }
         // pixmap generation thread must be started *after* connect(), else we may miss the start signal and get lock-ups (see bug 396137)
-        d->pixmapGenerationThread()->startGeneration(request, calcBoundingBox);
+        pixmapThread->startGeneration(request, calcBoundingBox);
 
         return;
     }
 
-    const QImage &img = image(request);
-    request->page()->setPixmap(request->observer(), new QPixmap(QPixmap::fromImage(img)), request->normalizedRect());
+    QImage img = d->renderImage(request);
+    const NormalizedRect boundingBox = calcBoundingBox ? Utils::imageBoundingBox(&img) : NormalizedRect();
+    PagePrivate::get(request->page())->setImage(request->observer(), std::move(img), request->normalizedRect(), false /*isPartialPixmap*/);
     const int pageNumber = request->page()->number();
 
-    d->mPixmapReady = true;
+    --d->mRunningPixmapGenerations;
+    d->mPixmapReady = (d->mRunningPixmapGenerations == 0);
 
     signalPixmapRequestDone(request);
     if (calcBoundingBox)
-        updatePageBoundingBox(pageNumber, Utils::imageBoundingBox(&img));
+        updatePageBoundingBox(pageNumber, boundingBox);
 }
 
 bool Generator::canGenerateTextPage() const
@@ -492,6 +557,22 @@ void Generator::updatePageBoundingBox(int page, const NormalizedRect &boundingBo
         d->m_document->setPageBoundingBox(page, boundingBox);
 }
 
+void Generator::addPageAnnotations(int page, const QList<Annotation *> &annotations)
+{
+    Q_D(Generator);
+    if (d->m_document) // still connected to document?
+        d->m_document->addGeneratedPageAnnotations(page, annotations);
+    else
+        qDeleteAll(annotations);
+}
+
+void Generator::updatePageSizes(const QHash<int, QSizeF> &sizes)
+{
+    Q_D(Generator);
+    if (d->m_document) // still connected to document?
+        d->m_document->setPageSizes(sizes);
+}
+
 QByteArray Generator::requestFontData(const Okular::FontInfo & /*font*/)
 {
     return {};
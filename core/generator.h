@@ -19,6 +19,7 @@
 #include "pagesize.h"
 #include "signatureutils.h"
 
+#include <QHash>
 #include <QList>
 #include <QObject>
 #include <QSharedDataPointer>
@@ -199,17 +200,18 @@ public:
      * provide.
      */
     enum GeneratorFeature {
-        Threaded,          ///< Whether the Generator supports asynchronous generation of pictures or text pages
-        TextExtraction,    ///< Whether the Generator can extract text from the document in the form of TextPage's
-        ReadRawData,       ///< Whether the Generator can read a document directly from its raw data.
-        FontInfo,          ///< Whether the Generator can provide information about the fonts used in the document
-        PageSizes,         ///< Whether the Generator can change the size of the document pages.
-        PrintNative,       ///< Whether the Generator supports native cross-platform printing (QPainter-based).
-        PrintPostscript,   ///< Whether the Generator supports postscript-based file printing.
-        PrintToFile,       ///< Whether the Generator supports export to PDF & PS through the Print Dialog
-        TiledRendering,    ///< Whether the Generator can render tiles @since 0.16 (KDE 4.10)
-        SwapBackingFile,   ///< Whether the Generator can hot-swap the file it's reading from @since 1.3
-        SupportsCancelling ///< Whether the Generator can cancel requests @since 1.4
+        Threaded,           ///< Whether the Generator supports asynchronous generation of pictures or text pages
+        TextExtraction,     ///< Whether the Generator can extract text from the document in the form of TextPage's
+        ReadRawData,        ///< Whether the Generator can read a document directly from its raw data.
+        FontInfo,           ///< Whether the Generator can provide information about the fonts used in the document
+        PageSizes,          ///< Whether the Generator can change the size of the document pages.
+        PrintNative,        ///< Whether the Generator supports native cross-platform printing (QPainter-based).
+        PrintPostscript,    ///< Whether the Generator supports postscript-based file printing.
+        PrintToFile,        ///< Whether the Generator supports export to PDF & PS through the Print Dialog
+        TiledRendering,     ///< Whether the Generator can render tiles @since 0.16 (KDE 4.10)
+        SwapBackingFile,    ///< Whether the Generator can hot-swap the file it's reading from @since 1.3
+        SupportsCancelling, ///< Whether the Generator can cancel requests @since 1.4
+        ConcurrentRendering ///< Whether the Generator can render different pages at the same time from several threads, requires Threaded @since 22.04
     };
 
     /**
@@ -302,6 +304,9 @@ public:
     /**
      * This method returns whether the generator is ready to
      * handle a new pixmap request.
+     *
+     * Generators with the @ref ConcurrentRendering feature are ready as long
+     * as one of their rendering threads is idle.
      */
     virtual bool canGeneratePixmap() const;
 
@@ -404,6 +409,15 @@ public:
     /**
      * This method returns the meta data of the given @p key with the given @p option
      * of the document.
+     *
+     * Generators that keep caches of their own they can free on request, e.g.
+     * decoded pages, can handle these keys, both called from the main thread,
+     * so they should be cheap and not wait for a rendering to end:
+     *
+     * - "CachedMemory": the memory in bytes those caches use, as a qulonglong.
+     *   The Document counts it in when deciding how much memory to free.
+     * - "FreeCachedMemory": memory is running low and freeing pixmaps was not
+     *   enough, free about @p option (a qulonglong) bytes of those caches.
      */
     virtual QVariant metaData(const QString &key, const QVariant &option) const;
 
@@ -510,7 +524,8 @@ protected:
      * Must return a null image if the request was cancelled and the generator supports cancelling
      *
      * @warning this method may be executed in its own separated thread if the
-     * @ref Threaded is enabled!
+     * @ref Threaded is enabled! If @ref ConcurrentRendering is enabled too it
+     * may be executed by several threads at the same time for different requests.
      */
     virtual QImage image(PixmapRequest *request);
 
@@ -543,7 +558,8 @@ protected:
         PaperColorMetaData,        ///< Returns (QColor) the paper color if set in Settings or the default color (white) if option is true (otherwise returns a non initialized QColor)
         TextAntialiasMetaData,     ///< Returns (bool) text antialias from Settings (option is not used)
         GraphicsAntialiasMetaData, ///< Returns (bool)graphic antialias from Settings (option is not used)
-        TextHintingMetaData        ///< Returns (bool)text hinting from Settings (option is not used)
+        TextHintingMetaData,       ///< Returns (bool)text hinting from Settings (option is not used)
+        RenderCacheMetaData        ///< Returns (bool) whether pixmap requests may be served from the on-disk cache without calling image() (option is not used) @since 22.04
     };
 
     /**
@@ -568,6 +584,27 @@ protected:
      */
     void updatePageBoundingBox(int page, const NormalizedRect &boundingBox);
 
+    /**
+     * Add annotations of a page after the page has already been handed
+     * to the Document, for generators that load them on demand. Call this
+     * instead of Page::addAnnotation() to ensure that all observers are
+     * notified. The Document takes ownership of the annotations.
+     *
+     * @since 22.04
+     */
+    void addPageAnnotations(int page, const QList<Annotation *> &annotations);
+
+    /**
+     * Set the sizes of some pages after they have already been handed to
+     * the Document, for generators that only guess them when loading the
+     * document. @p sizes maps page numbers to their sizes, in terms of upright
+     * orientation. Call this instead of creating new pages to ensure that
+     * all observers are notified. Must be called from the main thread.
+     *
+     * @since 22.04
+     */
+    void updatePageSizes(const QHash<int, QSizeF> &sizes);
+
     /**
      * Returns DPI, previously set via setDPI()
      * @since 0.19 (KDE 4.13)
@@ -38,9 +38,9 @@ PixmapRequest *PixmapGenerationThread::request() const
     return mRequest;
 }
 
-QImage PixmapGenerationThread::image() const
+QImage PixmapGenerationThread::takeImage()
 {
-    return mRequest ? PixmapRequestPrivate::get(mRequest)->mResultImage : QImage();
+    return mRequest ? std::move(PixmapRequestPrivate::get(mRequest)->mResultImage) : QImage();
 }
 
 bool PixmapGenerationThread::calcBoundingBox() const
@@ -56,10 +56,13 @@ NormalizedRect PixmapGenerationThread::boundingBox() const
 void PixmapGenerationThread::run()
 {
     if (mRequest) {
-        PixmapRequestPrivate::get(mRequest)->mResultImage = mGenerator->image(mRequest);
+        QImage image = mGenerator->d_func()->renderImage(mRequest);
 
         if (mCalcBoundingBox)
-            mBoundingBox = Utils::imageBoundingBox(&PixmapRequestPrivate::get(mRequest)->mResultImage);
+            mBoundingBox = Utils::imageBoundingBox(&image);
+
+        // leave the GUI thread only the pixmap creation, which doesn't copy anything then
+        PixmapRequestPrivate::get(mRequest)->mResultImage = GeneratorPrivate::toPixmapFormat(std::move(image));
     }
 }
 
@@ -16,6 +16,7 @@
 #include <QMutex>
 #include <QSet>
 #include <QThread>
+#include <QVector>
 
 class QEventLoop;
 
@@ -47,8 +48,9 @@ public:
 
     PixmapGenerationThread *pixmapGenerationThread();
     TextPageGenerationThread *textPageGenerationThread();
+    int maxPixmapGenerationThreads() const;
 
-    void pixmapGenerationFinished();
+    void pixmapGenerationFinished(PixmapGenerationThread *thread);
     void textpageGenerationFinished();
 
     QMutex *threadsLock();
@@ -56,14 +58,23 @@ public:
     virtual QVariant metaData(const QString &key, const QVariant &option) const;
     virtual QImage image(PixmapRequest *);
 
+    // Generator::image(), taken from or added to the document's render cache if it has one
+    QImage renderImage(PixmapRequest *request);
+
+    // converts @p image to the format QPixmap uses, so that QPixmap::fromImage() doesn't need to
+    static QImage toPixmapFormat(QImage &&image);
+
     DocumentPrivate *m_document;
     // NOTE: the following should be a QSet< GeneratorFeature >,
     // but it is not to avoid #include'ing generator.h
     QSet<int> m_features;
-    PixmapGenerationThread *mPixmapGenerationThread;
+    // pool of rendering threads, it only grows beyond one thread
+    // for generators with the ConcurrentRendering feature
+    QVector<PixmapGenerationThread *> mPixmapGenerationThreads;
     TextPageGenerationThread *mTextPageGenerationThread;
     mutable QMutex m_mutex;
     QMutex m_threadsMutex;
+    int mRunningPixmapGenerations;
     bool mPixmapReady : 1;
     bool mTextPageReady : 1;
     bool m_closing : 1;
@@ -116,7 +127,8 @@ public:
 
     PixmapRequest *request() const;
 
-    QImage image() const;
+    // moves the rendered image out of the request
+    QImage takeImage();
     bool calcBoundingBox() const;
     NormalizedRect boundingBox() const;
 
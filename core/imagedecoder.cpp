@@ -0,0 +1,264 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "imagedecoder.h"
+
+#include <QBuffer>
+#include <QImageReader>
+#include <QMap>
+#include <QMutex>
+#include <QPainter>
+#include <QTransform>
+
+using namespace Okular;
+
+class Okular::ImageDecoderPrivate
+{
+public:
+    ImageDecoderPrivate()
+        : m_valid(false)
+        , m_scalable(false)
+        , m_transformation(QImageIOHandler::TransformationNone)
+    {
+    }
+
+    QSize size() const;
+    QSize levelSize(int level) const;
+    int levelFor(const QSize &size) const;
+    QImage level(int level);
+    QImage decode(const QSize &size);
+    QImage transformed(const QImage &image) const;
+
+    QByteArray m_data;
+    // the image as stored, when it is decoded already or its size can only be known by decoding it
+    QImage m_fileImage;
+    QSize m_fileSize;
+    bool m_valid;
+    // whether QImageReader can decode a reduced image
+    bool m_scalable;
+    QImageIOHandler::Transformations m_transformation;
+    // level n is scaled to 1/2^n of the size
+    QMap<int, QImage> m_levels;
+    QString m_errorString;
+    QMutex m_mutex;
+};
+
+QSize ImageDecoderPrivate::size() const
+{
+    return (m_transformation & QImageIOHandler::TransformationRotate90) ? m_fileSize.transposed() : m_fileSize;
+}
+
+QSize ImageDecoderPrivate::levelSize(int level) const
+{
+    const QSize fullSize = size();
+    return QSize(qMax(1, fullSize.width() >> level), qMax(1, fullSize.height() >> level));
+}
+
+int ImageDecoderPrivate::levelFor(const QSize &size) const
+{
+    int level = 0;
+    while (true) {
+        const QSize smaller = levelSize(level + 1);
+        if (smaller == levelSize(level) || smaller.width() < size.width() || smaller.height() < size.height())
+            return level;
+        ++level;
+    }
+}
+
+QImage ImageDecoderPrivate::level(int level)
+{
+    QImage image = m_levels.value(level);
+    if (!image.isNull())
+        return image;
+
+    if (m_scalable && m_fileImage.isNull()) {
+        image = decode(levelSize(level));
+    } else {
+        // halve the nearest larger level until there, it's faster and smoother than scaling the whole image at once
+        int source = level;
+        while (source > 0 && !m_levels.contains(source))
+            --source;
+        image = m_levels.value(source);
+        if (image.isNull()) {
+            image = m_fileImage.isNull() ? decode(size()) : transformed(m_fileImage);
+            if (image.isNull())
+                return image;
+            m_levels.insert(0, image);
+        }
+        while (source < level)
+            image = image.scaled(levelSize(++source), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    if (!image.isNull())
+        m_levels.insert(level, image);
+    return image;
+}
+
+QImage ImageDecoderPrivate::decode(const QSize &size)
+{
+    QBuffer buffer;
+    buffer.setData(m_data);
+    buffer.open(QIODevice::ReadOnly);
+
+    QImageReader reader(&buffer);
+    reader.setAutoTransform(false);
+    const QSize fileSize = (m_transformation & QImageIOHandler::TransformationRotate90) ? size.transposed() : size;
+    if (fileSize != m_fileSize)
+        reader.setScaledSize(fileSize);
+
+    QImage image;
+    if (reader.read(&image))
+        m_errorString.clear();
+    else
+        m_errorString = reader.errorString();
+
+    return transformed(image);
+}
+
+QImage ImageDecoderPrivate::transformed(const QImage &image) const
+{
+    // the order of QImageReader: mirror, then rotate
+    QImage result = image;
+    if (!result.isNull() && (m_transformation & (QImageIOHandler::TransformationMirror | QImageIOHandler::TransformationFlip)))
+        result = result.mirrored(m_transformation & QImageIOHandler::TransformationMirror, m_transformation & QImageIOHandler::TransformationFlip);
+    if (!result.isNull() && (m_transformation & QImageIOHandler::TransformationRotate90))
+        result = result.transformed(QTransform().rotate(90));
+    return result;
+}
+
+ImageDecoder::ImageDecoder(const QByteArray &data, bool autoTransform)
+    : d(new ImageDecoderPrivate)
+{
+    d->m_data = data;
+
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    QImageReader reader(&buffer);
+    reader.setAutoTransform(false);
+    d->m_valid = reader.canRead();
+    if (!d->m_valid) {
+        d->m_errorString = reader.errorString();
+        return;
+    }
+
+    if (autoTransform)
+        d->m_transformation = reader.transformation();
+    d->m_scalable = reader.supportsOption(QImageIOHandler::ScaledSize);
+    d->m_fileSize = reader.size();
+    if (!d->m_fileSize.isValid()) {
+        // there is no way but decoding it
+        if (!reader.read(&d->m_fileImage))
+            d->m_errorString = reader.errorString();
+        d->m_valid = !d->m_fileImage.isNull();
+        d->m_fileSize = d->m_fileImage.size();
+    }
+}
+
+ImageDecoder::ImageDecoder(const QImage &image)
+    : d(new ImageDecoderPrivate)
+{
+    d->m_fileImage = image;
+    d->m_fileSize = image.size();
+    d->m_valid = !image.isNull();
+}
+
+ImageDecoder::~ImageDecoder()
+{
+    delete d;
+}
+
+bool ImageDecoder::isValid() const
+{
+    return d->m_valid;
+}
+
+void ImageDecoder::setTransformation(QImageIOHandler::Transformations transformation)
+{
+    QMutexLocker locker(&d->m_mutex);
+    if (d->m_transformation == transformation)
+        return;
+
+    d->m_transformation = transformation;
+    d->m_levels.clear();
+}
+
+QSize ImageDecoder::size() const
+{
+    QMutexLocker locker(&d->m_mutex);
+    return d->size();
+}
+
+QImage ImageDecoder::image() const
+{
+    return image(size());
+}
+
+QImage ImageDecoder::image(const QSize &size, const QRect &clip) const
+{
+    QMutexLocker locker(&d->m_mutex);
+    if (!d->m_valid || size.isEmpty())
+        return QImage();
+
+    const QRect rect = clip.isValid() ? clip & QRect(QPoint(0, 0), size) : QRect(QPoint(0, 0), size);
+    if (rect.isEmpty())
+        return QImage();
+
+    // the level is decoded once and kept even when only a part is wanted,
+    // the other tiles at this zoom level are cut from it too
+    const QImage source = d->level(d->levelFor(size));
+    if (source.isNull())
+        return QImage();
+
+    if (source.size() == size)
+        return rect.size() == size ? source : source.copy(rect);
+
+    if (rect.size() == size)
+        return source.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+    const qreal xScale = qreal(source.width()) / size.width();
+    const qreal yScale = qreal(source.height()) / size.height();
+    const QRectF sourceRect(rect.x() * xScale, rect.y() * yScale, rect.width() * xScale, rect.height() * yScale);
+
+    QImage part(rect.size(), source.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    part.fill(Qt::transparent);
+    QPainter p(&part);
+    p.setRenderHint(QPainter::SmoothPixmapTransform);
+    p.drawImage(QRectF(part.rect()), source, sourceRect);
+    p.end();
+    return part;
+}
+
+qulonglong ImageDecoder::cachedMemory() const
+{
+    QMutexLocker locker(&d->m_mutex);
+    qulonglong memory = 0;
+    for (const QImage &image : qAsConst(d->m_levels))
+        memory += image.sizeInBytes();
+    // unless level 0 shares it
+    if (!d->m_fileImage.isNull() && d->m_levels.value(0).constBits() != d->m_fileImage.constBits())
+        memory += d->m_fileImage.sizeInBytes();
+    return memory;
+}
+
+bool ImageDecoder::tryReleaseCachedImages()
+{
+    if (!d->m_mutex.tryLock())
+        return false;
+
+    d->m_levels.clear();
+    // an image that was given decoded can't be decoded again
+    if (!d->m_data.isEmpty())
+        d->m_fileImage = QImage();
+    d->m_mutex.unlock();
+    return true;
+}
+
+QString ImageDecoder::errorString() const
+{
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_errorString;
+}
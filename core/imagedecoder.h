@@ -0,0 +1,114 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef _OKULAR_IMAGEDECODER_H_
+#define _OKULAR_IMAGEDECODER_H_
+
+#include "okularcore_export.h"
+
+#include <QImage>
+#include <QImageIOHandler>
+
+class QByteArray;
+class QRect;
+class QSize;
+
+namespace Okular
+{
+class ImageDecoderPrivate;
+
+/**
+ * @short Decodes the image of an image based page at the size it is shown.
+ *
+ * Scaling the whole image down for every request, thumbnails included, is
+ * what makes image based documents slow to show. Formats like JPEG can
+ * decode a reduced image for a fraction of the cost of the whole one, so
+ * for them ImageDecoder asks QImageReader for that.
+ *
+ * The images are also kept at a few levels of detail, halving the size
+ * each time: a request is scaled from the smallest level that is at least
+ * as large as it, so that only the first request at a given zoom level
+ * decodes or scales the whole image. The tiles of a zoomed in image are cut
+ * from the level too, so it is decoded once rather than once per tile.
+ *
+ * All the sizes and rects are of the image with its transformation applied.
+ * The methods are thread safe.
+ *
+ * @since 22.04
+ */
+class OKULARCORE_EXPORT ImageDecoder
+{
+public:
+    /**
+     * Creates a decoder for the image encoded in @p data. If @p autoTransform
+     * is set the transformation stored in the image (e.g. the Exif orientation)
+     * is applied, see QImageReader::transformation(). Only the header of the
+     * image is read.
+     */
+    explicit ImageDecoder(const QByteArray &data, bool autoTransform = true);
+
+    /**
+     * Creates a decoder for an image that is already decoded, which only
+     * keeps the levels of detail.
+     */
+    explicit ImageDecoder(const QImage &image);
+
+    ~ImageDecoder();
+
+    ImageDecoder(const ImageDecoder &) = delete;
+    ImageDecoder &operator=(const ImageDecoder &) = delete;
+
+    /**
+     * Whether the image can be decoded, as far as its header tells.
+     */
+    bool isValid() const;
+
+    /**
+     * Makes the decoder apply @p transformation instead of the one stored in
+     * the image, for who reads it in other ways.
+     */
+    void setTransformation(QImageIOHandler::Transformations transformation);
+
+    /**
+     * The size of the whole image.
+     */
+    QSize size() const;
+
+    /**
+     * The whole image at its size.
+     */
+    QImage image() const;
+
+    /**
+     * The image scaled to @p size, or only the part @p clip of it, if @p clip is valid.
+     * Returns a null image if it can't be decoded.
+     */
+    QImage image(const QSize &size, const QRect &clip = QRect()) const;
+
+    /**
+     * The memory taken by the decoded images kept, in bytes.
+     */
+    qulonglong cachedMemory() const;
+
+    /**
+     * Drops the decoded images kept, they are decoded again when needed.
+     * Doesn't wait for a decoding in progress: returns false if there is one,
+     * and then nothing is dropped.
+     */
+    bool tryReleaseCachedImages();
+
+    /**
+     * The error of the last decoding, or an empty string if there was none.
+     * The image of a damaged file may still decode in part.
+     */
+    QString errorString() const;
+
+private:
+    ImageDecoderPrivate *const d;
+};
+
+}
+
+#endif
@@ -413,17 +413,22 @@ void PagePrivate::rotateAt(Rotation orientation)
 
 void PagePrivate::changeSize(const PageSize &size)
 {
-    if (size.isNull() || (size.width() == m_width && size.height() == m_height))
+    if (size.isNull())
+        return;
+
+    // m_width and m_height are rotated, size is not
+    const bool swap = m_rotation % 2;
+    const double width = swap ? size.height() : size.width();
+    const double height = swap ? size.width() : size.height();
+    if (width == m_width && height == m_height)
         return;
 
     m_page->deletePixmaps();
     //    deleteHighlights();
     //    deleteTextSelections();
 
-    m_width = size.width();
-    m_height = size.height();
-    if (m_rotation % 2)
-        qSwap(m_width, m_height);
+    m_width = width;
+    m_height = height;
 }
 
 const ObjectRect *Page::objectRect(ObjectRect::ObjectType type, double x, double y, double xScale, double yScale) const
@@ -539,19 +544,34 @@ void PagePrivate::setPixmap(DocumentObserver *observer, QPixmap *pixmap, const N
         it.value().m_rotation = m_rotation;
         it.value().m_isPartialPixmap = isPartialPixmap;
     } else {
-        // it can happen that we get a setPixmap while closing and thus the page controller is gone
-        if (m_doc->m_pageController) {
-            RotationJob *job = new RotationJob(pixmap->toImage(), Rotation0, m_rotation, observer);
-            job->setPage(this);
-            job->setRect(TilesManager::toRotatedRect(rect, m_rotation));
-            job->setIsPartialUpdate(isPartialPixmap);
-            m_doc->m_pageController->addRotationJob(job);
-        }
-
+        addRotationJob(observer, pixmap->toImage(), rect, isPartialPixmap);
         delete pixmap;
     }
 }
 
+void PagePrivate::setImage(DocumentObserver *observer, QImage &&image, const NormalizedRect &rect, bool isPartialPixmap)
+{
+    if (m_rotation == Rotation0) {
+        // doesn't copy the image if it has the pixmap format already
+        setPixmap(observer, new QPixmap(QPixmap::fromImage(std::move(image))), rect, isPartialPixmap);
+    } else {
+        addRotationJob(observer, image, rect, isPartialPixmap);
+    }
+}
+
+void PagePrivate::addRotationJob(DocumentObserver *observer, const QImage &image, const NormalizedRect &rect, bool isPartialPixmap)
+{
+    // it can happen that we get a setPixmap while closing and thus the page controller is gone
+    if (!m_doc->m_pageController)
+        return;
+
+    RotationJob *job = new RotationJob(image, Rotation0, m_rotation, observer);
+    job->setPage(this);
+    job->setRect(TilesManager::toRotatedRect(rect, m_rotation));
+    job->setIsPartialUpdate(isPartialPixmap);
+    m_doc->m_pageController->addRotationJob(job);
+}
+
 void Page::setTextPage(TextPage *textPage)
 {
     delete d->m_text;
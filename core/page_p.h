@@ -23,6 +23,7 @@
 #include "global.h"
 
 class QColor;
+class QImage;
 
 namespace Okular
 {
@@ -137,6 +138,12 @@ public:
 
     void setPixmap(DocumentObserver *observer, QPixmap *pixmap, const NormalizedRect &rect, bool isPartialPixmap);
 
+    /*
+     * Like setPixmap(), but rotated pages get the generated @p image without a round trip through QPixmap
+     */
+    void setImage(DocumentObserver *observer, QImage &&image, const NormalizedRect &rect, bool isPartialPixmap);
+    void addRotationJob(DocumentObserver *observer, const QImage &image, const NormalizedRect &rect, bool isPartialPixmap);
+
     class PixmapObject
     {
     public:
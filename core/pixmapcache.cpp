@@ -0,0 +1,293 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "pixmapcache_p.h"
+
+#include "observer.h"
+
+#include <algorithm>
+
+using namespace Okular;
+
+PixmapCache::PixmapCache()
+    : m_clock(0)
+    , m_hits(0)
+    , m_misses(0)
+{
+}
+
+bool PixmapCache::isEmpty() const
+{
+    return m_recency.empty();
+}
+
+int PixmapCache::count() const
+{
+    return static_cast<int>(m_recency.size());
+}
+
+void PixmapCache::insert(AllocatedPixmap *pixmap)
+{
+    const bool inserted = m_pixmaps[pixmap->observer].emplace(pixmap->page, pixmap).second;
+    Q_ASSERT(inserted);
+    Q_UNUSED(inserted);
+    pixmap->lastUsed = ++m_clock;
+    m_recency.emplace(pixmap->lastUsed, pixmap);
+}
+
+void PixmapCache::remove(AllocatedPixmap *pixmap)
+{
+    const auto it = m_pixmaps.find(pixmap->observer);
+    if (it == m_pixmaps.end())
+        return;
+
+    const auto pageIt = it->find(pixmap->page);
+    if (pageIt == it->end() || pageIt->second != pixmap)
+        return;
+
+    it->erase(pageIt);
+    if (it->empty())
+        m_pixmaps.erase(it);
+    m_recency.erase(pixmap->lastUsed);
+}
+
+AllocatedPixmap *PixmapCache::find(DocumentObserver *observer, int page) const
+{
+    const auto it = m_pixmaps.constFind(observer);
+    if (it == m_pixmaps.constEnd())
+        return nullptr;
+
+    const auto pageIt = it->find(page);
+    return pageIt != it->end() ? pageIt->second : nullptr;
+}
+
+AllocatedPixmap *PixmapCache::farthest(int viewportPage, bool unloadableOnly, DocumentObserver *observer) const
+{
+    AllocatedPixmap *farthestPixmap = nullptr;
+    int maxDistance = -1;
+
+    auto isCandidate = [unloadableOnly](const std::pair<const int, AllocatedPixmap *> &entry) { return !unloadableOnly || entry.second->observer->canUnloadPixmap(entry.first); };
+    auto consider = [&farthestPixmap, &maxDistance, viewportPage](AllocatedPixmap *p) {
+        const int distance = qAbs(p->page - viewportPage);
+        if (distance > maxDistance || (distance == maxDistance && p->lastUsed < farthestPixmap->lastUsed)) {
+            maxDistance = distance;
+            farthestPixmap = p;
+        }
+    };
+
+    for (auto it = m_pixmaps.constBegin(), end = m_pixmaps.constEnd(); it != end; ++it) {
+        if (observer && it.key() != observer)
+            continue;
+
+        // the distance to the viewport only grows towards both ends,
+        // so the farthest candidate is the first one from either side
+        const std::map<int, AllocatedPixmap *> &pages = it.value();
+        const auto lowest = std::find_if(pages.cbegin(), pages.cend(), isCandidate);
+        if (lowest == pages.cend())
+            continue;
+        consider(lowest->second);
+
+        const auto highest = std::find_if(pages.crbegin(), pages.crend(), isCandidate);
+        consider(highest->second);
+    }
+
+    return farthestPixmap;
+}
+
+AllocatedPixmap *PixmapCache::leastValuable(int viewportPage) const
+{
+    AllocatedPixmap *selectedPixmap = nullptr;
+    qint64 maxScore = -1;
+
+    auto consider = [this, &selectedPixmap, &maxScore, viewportPage](AllocatedPixmap *p) {
+        const qint64 distance = qAbs(p->page - viewportPage);
+        const qint64 score = (distance + 1) * (m_clock - p->lastUsed + 1);
+        if (score > maxScore || (score == maxScore && p->lastUsed < selectedPixmap->lastUsed)) {
+            maxScore = score;
+            selectedPixmap = p;
+        }
+    };
+
+    for (auto it = m_pixmaps.constBegin(), end = m_pixmaps.constEnd(); it != end; ++it) {
+        AllocatedPixmap *p = farthest(viewportPage, true, it.key());
+        if (p)
+            consider(p);
+    }
+
+    const auto leastRecent = std::find_if(m_recency.cbegin(), m_recency.cend(), [](const std::pair<const qint64, AllocatedPixmap *> &entry) { return entry.second->observer->canUnloadPixmap(entry.second->page); });
+    if (leastRecent != m_recency.cend())
+        consider(leastRecent->second);
+
+    return selectedPixmap;
+}
+
+void PixmapCache::touch(AllocatedPixmap *pixmap)
+{
+    const auto it = m_recency.find(pixmap->lastUsed);
+    if (it == m_recency.end() || it->second != pixmap)
+        return;
+
+    m_recency.erase(it);
+    pixmap->lastUsed = ++m_clock;
+    m_recency.emplace(pixmap->lastUsed, pixmap);
+}
+
+void PixmapCache::recordLookup(bool hit)
+{
+    if (hit)
+        ++m_hits;
+    else
+        ++m_misses;
+}
+
+double PixmapCache::hitRate() const
+{
+    const qint64 lookups = m_hits + m_misses;
+    return lookups ? double(m_hits) / lookups : 0;
+}
+
+QVector<AllocatedPixmap *> PixmapCache::take(DocumentObserver *observer)
+{
+    QVector<AllocatedPixmap *> taken;
+    const std::map<int, AllocatedPixmap *> pages = m_pixmaps.take(observer);
+    taken.reserve(pages.size());
+    for (const auto &entry : pages) {
+        m_recency.erase(entry.second->lastUsed);
+        taken.append(entry.second);
+    }
+
+    return taken;
+}
+
+QVector<AllocatedPixmap *> PixmapCache::takeAll()
+{
+    QVector<AllocatedPixmap *> taken;
+    taken.reserve(count());
+    for (const std::map<int, AllocatedPixmap *> &pages : qAsConst(m_pixmaps)) {
+        for (const auto &entry : pages)
+            taken.append(entry.second);
+    }
+
+    m_pixmaps.clear();
+    m_recency.clear();
+    return taken;
+}
+
+DownscaledPixmapCache::DownscaledPixmapCache()
+    : m_budget(0)
+    , m_memoryUsage(0)
+    , m_clock(0)
+    , m_hits(0)
+    , m_misses(0)
+{
+}
+
+void DownscaledPixmapCache::setBudget(qulonglong budget)
+{
+    m_budget = budget;
+    shrinkTo(m_budget);
+}
+
+qulonglong DownscaledPixmapCache::budget() const
+{
+    return m_budget;
+}
+
+qulonglong DownscaledPixmapCache::memoryUsage() const
+{
+    return m_memoryUsage;
+}
+
+int DownscaledPixmapCache::count() const
+{
+    return m_entries.count();
+}
+
+void DownscaledPixmapCache::insert(DocumentObserver *observer, int page, const QPixmap &pixmap, Rotation rotation)
+{
+    remove(observer, page);
+
+    const qulonglong memory = qulonglong(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+    if (memory > m_budget)
+        return;
+
+    shrinkTo(m_budget - memory);
+
+    const Key key(observer, page);
+    m_entries.insert(key, Entry {pixmap, rotation, memory, ++m_clock});
+    m_age.emplace(m_clock, key);
+    m_memoryUsage += memory;
+}
+
+bool DownscaledPixmapCache::take(DocumentObserver *observer, int page, QPixmap *pixmap, Rotation *rotation)
+{
+    const auto it = m_entries.find(Key(observer, page));
+    if (it == m_entries.end()) {
+        ++m_misses;
+        return false;
+    }
+
+    ++m_hits;
+    *pixmap = it->pixmap;
+    *rotation = it->rotation;
+    removeEntry(it);
+    return true;
+}
+
+void DownscaledPixmapCache::remove(DocumentObserver *observer, int page)
+{
+    const auto it = m_entries.find(Key(observer, page));
+    if (it != m_entries.end())
+        removeEntry(it);
+}
+
+void DownscaledPixmapCache::remove(DocumentObserver *observer)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it.key().first == observer) {
+            m_age.erase(it->added);
+            m_memoryUsage -= it->memory;
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DownscaledPixmapCache::clear()
+{
+    m_entries.clear();
+    m_age.clear();
+    m_memoryUsage = 0;
+}
+
+qint64 DownscaledPixmapCache::hits() const
+{
+    return m_hits;
+}
+
+qint64 DownscaledPixmapCache::misses() const
+{
+    return m_misses;
+}
+
+double DownscaledPixmapCache::hitRate() const
+{
+    const qint64 lookups = m_hits + m_misses;
+    return lookups ? double(m_hits) / lookups : 0;
+}
+
+void DownscaledPixmapCache::removeEntry(QHash<Key, Entry>::iterator it)
+{
+    m_age.erase(it->added);
+    m_memoryUsage -= it->memory;
+    m_entries.erase(it);
+}
+
+void DownscaledPixmapCache::shrinkTo(qulonglong memory)
+{
+    while (m_memoryUsage > memory && !m_age.empty())
+        removeEntry(m_entries.find(m_age.begin()->second));
+}
@@ -0,0 +1,199 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef _OKULAR_PIXMAPCACHE_P_H_
+#define _OKULAR_PIXMAPCACHE_P_H_
+
+#include <QHash>
+#include <QPair>
+#include <QPixmap>
+#include <QVector>
+
+#include "global.h"
+
+#include <map>
+
+namespace Okular
+{
+class DocumentObserver;
+
+struct AllocatedPixmap {
+    // owner of the page
+    DocumentObserver *observer;
+    int page;
+    qulonglong memory;
+    // when it was last added or shown, older ones are evicted first
+    qint64 lastUsed;
+    // public constructor: initialize data
+    AllocatedPixmap(DocumentObserver *o, int p, qulonglong m)
+        : observer(o)
+        , page(p)
+        , memory(m)
+        , lastUsed(0)
+    {
+    }
+};
+
+/**
+ * The memory allocation descriptors of the pixmaps the observers hold,
+ * indexed by observer and page.
+ *
+ * The pixmaps of every observer are kept sorted by page number, so the ones
+ * farthest from the viewport are always at either end and nothing has to be
+ * reordered when the viewport moves. Finding one to evict costs O(1) for each
+ * observer (plus skipping the ones their observer can't unload), adding,
+ * finding and removing a given page costs O(log n).
+ *
+ * All of them are also kept sorted by when they were last used, which
+ * leastValuable() weighs against the distance to the viewport.
+ *
+ * The cache doesn't own the descriptors.
+ */
+class PixmapCache
+{
+public:
+    PixmapCache();
+
+    bool isEmpty() const;
+    int count() const;
+
+    /**
+     * Adds @p pixmap, there must be no other for the same observer and page.
+     */
+    void insert(AllocatedPixmap *pixmap);
+
+    /**
+     * Removes @p pixmap from the cache.
+     */
+    void remove(AllocatedPixmap *pixmap);
+
+    /**
+     * The descriptor for @p page of @p observer, or nullptr if there is none.
+     */
+    AllocatedPixmap *find(DocumentObserver *observer, int page) const;
+
+    /**
+     * The pixmap farthest from @p viewportPage, the oldest one if several are
+     * at the same distance. If @p unloadableOnly is set only pixmaps that
+     * their observer can unload are considered, if @p observer is not null only
+     * the pixmaps of that observer are.
+     */
+    AllocatedPixmap *farthest(int viewportPage, bool unloadableOnly, DocumentObserver *observer = nullptr) const;
+
+    /**
+     * The pixmap with the highest product of distance from @p viewportPage and
+     * time since it was last used, among the ones their observers can unload.
+     * Only the farthest pixmaps of every observer and the least recently used
+     * one are looked at.
+     */
+    AllocatedPixmap *leastValuable(int viewportPage) const;
+
+    /**
+     * Marks @p pixmap as just used.
+     */
+    void touch(AllocatedPixmap *pixmap);
+
+    /**
+     * Counts a page that was shown and already had (@p hit) or not a pixmap.
+     */
+    void recordLookup(bool hit);
+
+    /**
+     * The fraction of recorded lookups that were hits, 0 if there were none.
+     */
+    double hitRate() const;
+
+    /**
+     * Removes and returns all the descriptors of @p observer.
+     */
+    QVector<AllocatedPixmap *> take(DocumentObserver *observer);
+
+    /**
+     * Removes and returns all the descriptors.
+     */
+    QVector<AllocatedPixmap *> takeAll();
+
+private:
+    QHash<DocumentObserver *, std::map<int, AllocatedPixmap *>> m_pixmaps;
+    std::map<qint64, AllocatedPixmap *> m_recency;
+    qint64 m_clock;
+    qint64 m_hits;
+    qint64 m_misses;
+};
+
+/**
+ * Half resolution copies of the pixmaps evicted from the PixmapCache.
+ *
+ * When the page is needed again its copy is shown, scaled up, until the
+ * new pixmap is rendered. The copies have their own memory budget, the
+ * least recently added ones are dropped when it is exceeded.
+ */
+class DownscaledPixmapCache
+{
+public:
+    DownscaledPixmapCache();
+
+    /**
+     * Sets the memory budget in bytes, 0 disables the cache.
+     */
+    void setBudget(qulonglong budget);
+    qulonglong budget() const;
+
+    qulonglong memoryUsage() const;
+    int count() const;
+
+    /**
+     * Keeps @p pixmap, already downscaled and rotated by @p rotation, for
+     * @p page of @p observer, replacing any previous one.
+     */
+    void insert(DocumentObserver *observer, int page, const QPixmap &pixmap, Rotation rotation);
+
+    /**
+     * Removes the copy for @p page of @p observer and returns it in @p pixmap
+     * and @p rotation. Returns false, counting a miss, if there is none.
+     */
+    bool take(DocumentObserver *observer, int page, QPixmap *pixmap, Rotation *rotation);
+
+    /**
+     * Drops the copy for @p page of @p observer.
+     */
+    void remove(DocumentObserver *observer, int page);
+
+    /**
+     * Drops all the copies of @p observer.
+     */
+    void remove(DocumentObserver *observer);
+
+    void clear();
+
+    qint64 hits() const;
+    qint64 misses() const;
+    double hitRate() const;
+
+private:
+    typedef QPair<DocumentObserver *, int> Key;
+
+    struct Entry {
+        QPixmap pixmap;
+        Rotation rotation;
+        qulonglong memory;
+        qint64 added;
+    };
+
+    void removeEntry(QHash<Key, Entry>::iterator it);
+    void shrinkTo(qulonglong memory);
+
+    QHash<Key, Entry> m_entries;
+    std::map<qint64, Key> m_age;
+    qulonglong m_budget;
+    qulonglong m_memoryUsage;
+    qint64 m_clock;
+    qint64 m_hits;
+    qint64 m_misses;
+};
+
+}
+
+#endif
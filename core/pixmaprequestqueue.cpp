@@ -0,0 +1,129 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "pixmaprequestqueue_p.h"
+
+#include "generator.h"
+
+using namespace Okular;
+
+PixmapRequestQueue::PixmapRequestQueue()
+    : m_nextOrder(0)
+    , m_lastWaitTime(0)
+{
+    m_clock.start();
+}
+
+bool PixmapRequestQueue::isEmpty() const
+{
+    return m_requests.empty();
+}
+
+int PixmapRequestQueue::count() const
+{
+    return static_cast<int>(m_requests.size());
+}
+
+void PixmapRequestQueue::enqueue(PixmapRequest *request, int viewportPage)
+{
+    Key key;
+    key.priority = request->priority();
+    if (key.priority == 0) {
+        // priority zero requests go before everything else, the latest first
+        key.distance = 0;
+        key.order = -(++m_nextOrder);
+    } else {
+        key.distance = qAbs(request->pageNumber() - viewportPage);
+        key.order = ++m_nextOrder;
+    }
+
+    m_requests.emplace(key, Entry {request, m_clock.elapsed()});
+    m_keys.insert(request, key);
+    m_observerRequests[request->observer()].insert(request->pageNumber(), request);
+}
+
+PixmapRequest *PixmapRequestQueue::top() const
+{
+    return m_requests.empty() ? nullptr : m_requests.begin()->second.request;
+}
+
+void PixmapRequestQueue::remove(PixmapRequest *request)
+{
+    removeEntry(request, false);
+}
+
+void PixmapRequestQueue::removeDispatched(PixmapRequest *request)
+{
+    removeEntry(request, true);
+}
+
+QVector<PixmapRequest *> PixmapRequestQueue::takeRequests(DocumentObserver *observer)
+{
+    const QMultiHash<int, PixmapRequest *> observerRequests = m_observerRequests.value(observer);
+
+    QVector<PixmapRequest *> taken;
+    taken.reserve(observerRequests.size());
+    for (PixmapRequest *request : observerRequests) {
+        removeEntry(request, false);
+        taken.append(request);
+    }
+    return taken;
+}
+
+QVector<PixmapRequest *> PixmapRequestQueue::takeRequests(DocumentObserver *observer, const QSet<int> &pages)
+{
+    const auto it = m_observerRequests.constFind(observer);
+    if (it == m_observerRequests.constEnd())
+        return {};
+
+    QVector<PixmapRequest *> taken;
+    for (int page : pages) {
+        const QList<PixmapRequest *> pageRequests = it->values(page);
+        taken += pageRequests.toVector();
+    }
+    for (PixmapRequest *request : qAsConst(taken))
+        removeEntry(request, false);
+    return taken;
+}
+
+QVector<PixmapRequest *> PixmapRequestQueue::takeAll()
+{
+    QVector<PixmapRequest *> taken;
+    taken.reserve(count());
+    for (const auto &entry : m_requests)
+        taken.append(entry.second.request);
+
+    m_requests.clear();
+    m_keys.clear();
+    m_observerRequests.clear();
+    return taken;
+}
+
+qint64 PixmapRequestQueue::lastWaitTime() const
+{
+    return m_lastWaitTime;
+}
+
+void PixmapRequestQueue::removeEntry(PixmapRequest *request, bool dispatched)
+{
+    const auto keyIt = m_keys.find(request);
+    if (keyIt == m_keys.end())
+        return;
+
+    const auto it = m_requests.find(*keyIt);
+    Q_ASSERT(it != m_requests.end());
+    if (dispatched)
+        m_lastWaitTime = m_clock.elapsed() - it->second.queuedAt;
+    m_requests.erase(it);
+    m_keys.erase(keyIt);
+
+    // the observer and page of a request don't change while it is queued
+    const auto observerIt = m_observerRequests.find(request->observer());
+    if (observerIt != m_observerRequests.end()) {
+        observerIt->remove(request->pageNumber(), request);
+        if (observerIt->isEmpty())
+            m_observerRequests.erase(observerIt);
+    }
+}
@@ -0,0 +1,122 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef _OKULAR_PIXMAPREQUESTQUEUE_P_H_
+#define _OKULAR_PIXMAPREQUESTQUEUE_P_H_
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMultiHash>
+#include <QSet>
+#include <QVector>
+
+#include <map>
+
+namespace Okular
+{
+class DocumentObserver;
+class PixmapRequest;
+
+/**
+ * The pixmap requests waiting to be sent to the generator.
+ *
+ * Requests are ordered by priority (lower values first) and then by their
+ * distance from the viewport page at the time they were queued. Requests
+ * with the same priority and distance are sent in the order they came in,
+ * except for priority 0 ones, where the newest goes first.
+ *
+ * Adding and removing a request costs O(log n), looking at the next one O(1)
+ * and removing the requests of an observer is proportional to the number of
+ * requests that observer has queued.
+ *
+ * The queue doesn't own the requests and is not thread safe, the document
+ * protects it with m_pixmapRequestsMutex.
+ */
+class PixmapRequestQueue
+{
+public:
+    PixmapRequestQueue();
+
+    bool isEmpty() const;
+    int count() const;
+
+    /**
+     * Queues @p request, @p viewportPage is the page the viewport is currently on.
+     */
+    void enqueue(PixmapRequest *request, int viewportPage);
+
+    /**
+     * The request that should be sent to the generator next, or nullptr if empty.
+     */
+    PixmapRequest *top() const;
+
+    /**
+     * Removes @p request without sending it to the generator.
+     */
+    void remove(PixmapRequest *request);
+
+    /**
+     * Removes @p request because it was sent to the generator,
+     * accounting the time it spent waiting.
+     */
+    void removeDispatched(PixmapRequest *request);
+
+    /**
+     * Removes and returns all the requests of @p observer.
+     */
+    QVector<PixmapRequest *> takeRequests(DocumentObserver *observer);
+
+    /**
+     * Removes and returns the requests of @p observer for any of the @p pages.
+     */
+    QVector<PixmapRequest *> takeRequests(DocumentObserver *observer, const QSet<int> &pages);
+
+    /**
+     * Removes and returns all the requests.
+     */
+    QVector<PixmapRequest *> takeAll();
+
+    /**
+     * Time in milliseconds the last dispatched request spent waiting,
+     * for the debug output.
+     */
+    qint64 lastWaitTime() const;
+
+private:
+    struct Key {
+        int priority;
+        int distance;
+        qint64 order;
+
+        bool operator<(const Key &other) const
+        {
+            if (priority != other.priority)
+                return priority < other.priority;
+            if (distance != other.distance)
+                return distance < other.distance;
+            return order < other.order;
+        }
+    };
+
+    struct Entry {
+        PixmapRequest *request;
+        qint64 queuedAt;
+    };
+
+    void removeEntry(PixmapRequest *request, bool dispatched);
+
+    std::map<Key, Entry> m_requests;
+    QHash<PixmapRequest *, Key> m_keys;
+    QHash<DocumentObserver *, QMultiHash<int, PixmapRequest *>> m_observerRequests;
+
+    qint64 m_nextOrder;
+    QElapsedTimer m_clock;
+
+    qint64 m_lastWaitTime;
+};
+
+}
+
+#endif
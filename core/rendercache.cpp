@@ -0,0 +1,199 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "rendercache_p.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
+
+#include <algorithm>
+
+#include "debug_p.h"
+
+using namespace Okular;
+
+static const quint32 renderCacheMagic = 0x4f4b5243; // "OKRC"
+static const quint32 renderCacheVersion = 1;
+
+// how much of the start and of the end of the file goes into the document hash
+static const qint64 contentsSampleSize = 64 * 1024;
+
+RenderCache::RenderCache(const QString &filePath, const QByteArray &localContentsDigest, qulonglong maximumSize)
+    : m_maximumSize(maximumSize)
+    , m_bytesSincePrune(maximumSize) // check the size with the first image stored
+    , m_pruning(false)
+    , m_storing(true)
+{
+    const QFileInfo info(filePath);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(info.absoluteFilePath().toUtf8());
+    hash.addData(QByteArray::number(info.size()));
+    hash.addData(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+
+    QFile file(filePath);
+    if (file.open(QIODevice::ReadOnly)) {
+        hash.addData(file.read(contentsSampleSize));
+        if (file.size() > contentsSampleSize && file.seek(qMax(contentsSampleSize, file.size() - contentsSampleSize)))
+            hash.addData(file.read(contentsSampleSize));
+    }
+    hash.addData(localContentsDigest);
+
+    m_directory = cacheDirectory() + QLatin1Char('/') + QString::fromLatin1(hash.result().toHex());
+}
+
+void RenderCache::setRenderHints(const QString &renderHints)
+{
+    const QString hintsKey = QString::fromLatin1(QCryptographicHash::hash(renderHints.toUtf8(), QCryptographicHash::Md5).toHex().left(8));
+
+    QMutexLocker locker(&m_mutex);
+    m_renderHints = hintsKey;
+}
+
+QImage RenderCache::load(int page, int width, int height, Rotation rotation)
+{
+    QFile file(fileName(page, width, height, rotation));
+    if (!file.open(QIODevice::ReadOnly))
+        return QImage();
+
+    const qint64 size = file.size();
+    uchar *mapped = file.map(0, size);
+    if (!mapped)
+        return QImage();
+
+    QImage image;
+    {
+        const QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), size);
+        QDataStream stream(data);
+        quint32 magic, version;
+        qint32 imageWidth, imageHeight, format, bytesPerLine;
+        stream >> magic >> version >> imageWidth >> imageHeight >> format >> bytesPerLine;
+
+        if (stream.status() == QDataStream::Ok && magic == renderCacheMagic && version == renderCacheVersion && imageWidth == width && imageHeight == height && format > QImage::Format_Invalid && format < QImage::NImageFormats) {
+            const qint64 headerSize = stream.device()->pos();
+            const QByteArray bits = qUncompress(mapped + headerSize, static_cast<int>(size - headerSize));
+            image = QImage(width, height, static_cast<QImage::Format>(format));
+            if (!image.isNull() && image.bytesPerLine() == bytesPerLine && bits.size() == image.sizeInBytes())
+                memcpy(image.bits(), bits.constData(), bits.size());
+            else
+                image = QImage();
+        }
+    }
+    file.unmap(mapped);
+
+    if (image.isNull()) {
+        qCDebug(OkularCoreDebug) << "Removing invalid render cache file" << file.fileName();
+        file.remove();
+        return QImage();
+    }
+
+    // the modification time tells prune() when it was last used
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    return image;
+}
+
+void RenderCache::store(int page, Rotation rotation, const QImage &image)
+{
+    if (image.isNull() || !QDir().mkpath(m_directory))
+        return;
+
+    QByteArray data;
+    {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << renderCacheMagic << renderCacheVersion << qint32(image.width()) << qint32(image.height()) << qint32(image.format()) << qint32(image.bytesPerLine());
+    }
+    // fast compression, the images are mostly flat areas and this runs in the rendering thread
+    data += qCompress(image.constBits(), image.sizeInBytes(), 1);
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_storing)
+        return;
+    locker.unlock();
+
+    QSaveFile file(fileName(page, image.width(), image.height(), rotation));
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+        return;
+
+    locker.relock();
+    m_bytesSincePrune += data.size();
+    if (m_pruning || m_bytesSincePrune < m_maximumSize / 8)
+        return;
+
+    m_bytesSincePrune = 0;
+    m_pruning = true;
+    locker.unlock();
+    prune();
+    locker.relock();
+    m_pruning = false;
+}
+
+void RenderCache::removePage(int page)
+{
+    QDir dir(m_directory);
+    const QStringList files = dir.entryList({QStringLiteral("%1-*").arg(page)}, QDir::Files);
+    for (const QString &file : files)
+        dir.remove(file);
+}
+
+void RenderCache::stopStoring()
+{
+    QMutexLocker locker(&m_mutex);
+    m_storing = false;
+}
+
+QString RenderCache::cacheDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/okular/pages");
+}
+
+QString RenderCache::fileName(int page, int width, int height, Rotation rotation) const
+{
+    QMutexLocker locker(&m_mutex);
+    return QStringLiteral("%1/%2-%3x%4-%5-%6").arg(m_directory).arg(page).arg(width).arg(height).arg(static_cast<int>(rotation)).arg(m_renderHints);
+}
+
+void RenderCache::prune()
+{
+    struct CachedFile {
+        qint64 lastUsed;
+        qint64 size;
+        QString path;
+    };
+
+    // the limit is shared by all documents, so look at all of them
+    QVector<CachedFile> files;
+    qulonglong totalSize = 0;
+    QDirIterator it(cacheDirectory(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        files.append({info.lastModified().toMSecsSinceEpoch(), info.size(), info.filePath()});
+        totalSize += info.size();
+    }
+
+    if (totalSize <= m_maximumSize)
+        return;
+
+    std::sort(files.begin(), files.end(), [](const CachedFile &a, const CachedFile &b) { return a.lastUsed < b.lastUsed; });
+    for (const CachedFile &file : qAsConst(files)) {
+        if (totalSize <= m_maximumSize)
+            break;
+        if (QFile::remove(file.path))
+            totalSize -= file.size;
+    }
+
+    // rmdir only succeeds on the ones left empty
+    QDir cacheDir(cacheDirectory());
+    const QStringList documentDirs = cacheDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString &documentDir : documentDirs)
+        cacheDir.rmdir(documentDir);
+}
@@ -0,0 +1,90 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef _OKULAR_RENDERCACHE_P_H_
+#define _OKULAR_RENDERCACHE_P_H_
+
+#include <QByteArray>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+#include "global.h"
+
+namespace Okular
+{
+/**
+ * Rendered page images kept on disk, so that reopening a document shows
+ * its pages and thumbnails without rendering them again.
+ *
+ * Every document gets its own directory under the XDG cache directory,
+ * named after a hash of its path, size, modification time, the start and
+ * end of its contents and @p localContentsDigest (the annotations and forms
+ * stored in the docdata file, that generators may render). Changing the file
+ * in any way thus leaves the old images unused until they are pruned.
+ *
+ * An image is stored as a zlib compressed copy of its scanlines, keyed by
+ * page number, size, rotation and the render hints; reading it maps the file
+ * instead of reading it. The least recently used images of all documents are
+ * removed when the total size exceeds the limit.
+ *
+ * load() and store() are called from the rendering threads, the rest from
+ * the GUI thread.
+ */
+class RenderCache
+{
+public:
+    RenderCache(const QString &filePath, const QByteArray &localContentsDigest, qulonglong maximumSize);
+
+    /**
+     * Sets the render hints that are part of the key of new lookups, since
+     * images rendered with other hints must not be used.
+     */
+    void setRenderHints(const QString &renderHints);
+
+    /**
+     * The image stored for @p page, or a null image if there is none.
+     */
+    QImage load(int page, int width, int height, Rotation rotation);
+
+    /**
+     * Stores @p image for @p page, pruning the cache if needed.
+     */
+    void store(int page, Rotation rotation, const QImage &image);
+
+    /**
+     * Removes all the images of @p page, e.g. because its annotations changed.
+     */
+    void removePage(int page);
+
+    /**
+     * Stops storing new images, because the document doesn't show what is
+     * in the file and the docdata anymore: images rendered from now on would
+     * be found again after discarding the changes.
+     */
+    void stopStoring();
+
+    /**
+     * The directory all documents store their images in.
+     */
+    static QString cacheDirectory();
+
+private:
+    QString fileName(int page, int width, int height, Rotation rotation) const;
+    void prune();
+
+    QString m_directory;
+    qulonglong m_maximumSize;
+
+    mutable QMutex m_mutex;
+    QString m_renderHints;
+    qulonglong m_bytesSincePrune;
+    bool m_pruning;
+    bool m_storing;
+};
+
+}
+
+#endif
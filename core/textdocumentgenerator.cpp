@@ -79,17 +79,13 @@ TextDocumentGenerator *TextDocumentConverter::generator() const
  */
 Okular::TextPage *TextDocumentGeneratorPrivate::createTextPage(int pageNumber) const
 {
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
     Q_Q(const TextDocumentGenerator);
-#endif
 
     Okular::TextPage *textPage = new Okular::TextPage;
 
     int start, end;
 
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    q->userMutex()->lock();
-#endif
+    QMutexLocker locker(q->userMutex());
     TextDocumentUtils::calculatePositions(mDocument, pageNumber, start, end);
 
     {
@@ -109,13 +105,21 @@ Okular::TextPage *TextDocumentGeneratorPrivate::createTextPage(int pageNumber) c
             }
         }
     }
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    q->userMutex()->unlock();
-#endif
 
     return textPage;
 }
 
+void TextDocumentGeneratorPrivate::layoutDocument(QTextDocument *document) const
+{
+    // setting the font again would relayout the document all the same
+    if (document->defaultFont() != mFont)
+        document->setDefaultFont(mFont);
+
+    // pageCount() lays out the whole document, so that drawing it in the
+    // rendering thread doesn't change it nor start the timers of the layout
+    document->pageCount();
+}
+
 void TextDocumentGeneratorPrivate::addAction(Action *action, int cursorBegin, int cursorEnd)
 {
     if (!action)
@@ -251,9 +255,8 @@ void TextDocumentGeneratorPrivate::initializeGenerator()
     q->setFeature(Generator::TextExtraction);
     q->setFeature(Generator::PrintNative);
     q->setFeature(Generator::PrintToFile);
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    q->setFeature(Generator::Threaded);
-#endif
+    if (QFontDatabase::supportsThreadedFontRendering())
+        q->setFeature(Generator::Threaded);
 
     QObject::connect(mConverter, &TextDocumentConverter::addAction, q, [this](Action *a, int cb, int ce) { addAction(a, cb, ce); });
     QObject::connect(mConverter, &TextDocumentConverter::addAnnotation, q, [this](Annotation *a, int cb, int ce) { addAnnotation(a, cb, ce); });
@@ -300,6 +303,7 @@ Document::OpenResult TextDocumentGenerator::loadDocumentWithPassword(const QStri
         return openResult;
     }
     d->mDocument = d->mConverter->document();
+    d->layoutDocument(d->mDocument);
 
     d->generateTitleInfos();
     const QList<TextDocumentGeneratorPrivate::LinkInfo> linkInfos = d->generateLinkInfos();
@@ -347,8 +351,10 @@ Document::OpenResult TextDocumentGenerator::loadDocumentWithPassword(const QStri
 bool TextDocumentGenerator::doCloseDocument()
 {
     Q_D(TextDocumentGenerator);
+    userMutex()->lock();
     delete d->mDocument;
     d->mDocument = nullptr;
+    userMutex()->unlock();
 
     d->mTitlePositions.clear();
     d->mLinkPositions.clear();
@@ -372,13 +378,12 @@ void TextDocumentGenerator::generatePixmap(Okular::PixmapRequest *request)
 
 QImage TextDocumentGeneratorPrivate::image(PixmapRequest *request)
 {
+    Q_Q(TextDocumentGenerator);
+
+    QMutexLocker locker(q->userMutex());
     if (!mDocument)
         return QImage();
 
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    Q_Q(TextDocumentGenerator);
-#endif
-
     QImage image(request->width(), request->height(), QImage::Format_ARGB32);
     image.fill(Qt::white);
 
@@ -396,9 +401,6 @@ QImage TextDocumentGeneratorPrivate::image(PixmapRequest *request)
     rect = QRect(0, request->pageNumber() * size.height(), size.width(), size.height());
     p.translate(QPoint(0, request->pageNumber() * size.height() * -1));
     p.setClipRect(rect);
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    q->userMutex()->lock();
-#endif
     QAbstractTextDocumentLayout::PaintContext context;
     context.palette.setColor(QPalette::Text, Qt::black);
     //  FIXME Fix Qt, this doesn't work, we have horrible hacks
@@ -406,11 +408,7 @@ QImage TextDocumentGeneratorPrivate::image(PixmapRequest *request)
     //        if Qt ever gets fixed
     //     context.palette.setColor( QPalette::Link, Qt::blue );
     context.clip = rect;
-    mDocument->setDefaultFont(mFont);
     mDocument->documentLayout()->draw(&p, context);
-#ifdef OKULAR_TEXTDOCUMENT_THREADED_RENDERING
-    q->userMutex()->unlock();
-#endif
     p.end();
 
     return image;
@@ -425,6 +423,7 @@ Okular::TextPage *TextDocumentGenerator::textPage(Okular::TextRequest *request)
 Document::PrintError TextDocumentGenerator::print(QPrinter &printer)
 {
     Q_D(TextDocumentGenerator);
+    QMutexLocker locker(userMutex());
     if (!d->mDocument)
         return Document::UnknownPrintError;
 
@@ -477,6 +476,7 @@ Okular::ExportFormat::List TextDocumentGenerator::exportFormats() const
 bool TextDocumentGenerator::exportTo(const QString &fileName, const Okular::ExportFormat &format)
 {
     Q_D(TextDocumentGenerator);
+    QMutexLocker locker(userMutex());
     if (!d->mDocument)
         return false;
 
@@ -519,6 +519,10 @@ bool TextDocumentGenerator::reparseConfig()
 
     if (newFont != d->mFont) {
         d->mFont = newFont;
+        if (d->mDocument) {
+            QMutexLocker locker(userMutex());
+            d->layoutDocument(d->mDocument);
+        }
         return true;
     }
 
@@ -549,7 +553,13 @@ void TextDocumentGenerator::setTextDocument(QTextDocument *textDocument)
 {
     Q_D(TextDocumentGenerator);
 
+    // lay it out before the rendering threads can see it
+    if (textDocument)
+        d->layoutDocument(textDocument);
+
+    userMutex()->lock();
     d->mDocument = textDocument;
+    userMutex()->unlock();
 
     for (Page *p : qAsConst(d->m_document->m_pagesVector)) {
         p->setTextPage(nullptr);
@@ -183,7 +183,7 @@ public:
     bool exportTo(const QString &fileName, const Okular::ExportFormat &format) override;
 
     // [INHERITED] config interface
-    /// By default checks if the default font has changed or not
+    /// By default checks if the default font has changed or not, and lays out the document again with it
     bool reparseConfig() override;
     /// Does nothing by default. You need to reimplement it in your generator
     void addPages(KConfigDialog *dlg) override;
@@ -202,6 +202,7 @@ public:
     void calculateBoundingRect(int startPosition, int endPosition, QRectF &rect, int &page) const;
     void calculatePositions(int page, int &start, int &end) const;
     Okular::TextPage *createTextPage(int) const;
+    void layoutDocument(QTextDocument *document) const;
 
     void addAction(Action *action, int cursorBegin, int cursorEnd);
     void addAnnotation(Annotation *annotation, int cursorBegin, int cursorEnd);
@@ -215,6 +216,8 @@ public:
 
     TextDocumentConverter *mConverter;
 
+    // laid out as a whole in the GUI thread and only read by the rendering threads,
+    // all the accesses hold the userMutex() since QTextDocument isn't thread safe
     QTextDocument *mDocument;
     Okular::DocumentInfo mDocumentInfo;
     Okular::DocumentSynopsis mDocumentSynopsis;
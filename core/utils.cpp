@@ -19,6 +19,12 @@
 #include <QWidget>
 #include <QWindow>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 using namespace Okular;
 
 QRect Utils::rotateRect(const QRect source, int width, int height, int orientation)
@@ -66,14 +72,152 @@ inline static bool isPaperColor(QRgb argb, QRgb paperColor)
     return (argb & 0xFFFFFF) == (paperColor & 0xFFFFFF); // ignore alpha
 }
 
+namespace
+{
+/**
+ * Finds the pixels that are not paper colored in the scanlines of a 32 bit image.
+ *
+ * Runs of paper colored pixels are skipped comparing several at once, the
+ * pixels of a run that doesn't fully match are then checked one by one.
+ * QImage::pixel() unpremultiplies, so in premultiplied images only opaque
+ * pixels can be matched at once, the others go through qUnpremultiply().
+ */
+class PaperColorScanner
+{
+public:
+    PaperColorScanner(QImage::Format format, QRgb paperColor)
+        : m_paperColor(paperColor)
+        , m_premultiplied(format == QImage::Format_ARGB32_Premultiplied)
+        , m_mask(m_premultiplied ? 0xFFFFFFFF : 0x00FFFFFF)
+        , m_value(m_premultiplied ? (paperColor | 0xFF000000) : (paperColor & 0x00FFFFFF))
+    {
+    }
+
+    /**
+     * The first pixel of @p line in [@p begin, @p end) that is not paper colored, -1 if there is none.
+     */
+    int first(const QRgb *line, int begin, int end) const
+    {
+        int x = begin;
+        while (x < end) {
+            x = skipForward(line, x, end);
+            const int runEnd = qMin(x + runLength, end);
+            for (; x < runEnd; ++x) {
+                if (!isPaper(line[x]))
+                    return x;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * The last pixel of @p line in [@p begin, @p end) that is not paper colored, -1 if there is none.
+     */
+    int last(const QRgb *line, int begin, int end) const
+    {
+        int x = end;
+        while (x > begin) {
+            x = skipBackward(line, begin, x);
+            const int runBegin = qMax(x - runLength, begin);
+            for (--x; x >= runBegin; --x) {
+                if (!isPaper(line[x]))
+                    return x;
+            }
+            x = runBegin;
+        }
+        return -1;
+    }
+
+private:
+    static const int runLength = 4;
+
+    bool matches(QRgb pixel) const
+    {
+        return (pixel & m_mask) == m_value;
+    }
+
+    bool isPaper(QRgb pixel) const
+    {
+        return matches(pixel) || (m_premultiplied && isPaperColor(qUnpremultiply(pixel), m_paperColor));
+    }
+
+    // the start of the first run after x that doesn't fully match
+    int skipForward(const QRgb *line, int x, int end) const
+    {
+#if defined(__SSE2__) || defined(_M_X64)
+        const __m128i mask = _mm_set1_epi32(m_mask);
+        const __m128i value = _mm_set1_epi32(m_value);
+        for (; x + runLength <= end; x += runLength) {
+            const __m128i pixels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(line + x)), mask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(pixels, value)) != 0xFFFF)
+                break;
+        }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        const uint32x4_t mask = vdupq_n_u32(m_mask);
+        const uint32x4_t value = vdupq_n_u32(m_value);
+        for (; x + runLength <= end; x += runLength) {
+            const uint32x4_t equal = vceqq_u32(vandq_u32(vld1q_u32(line + x), mask), value);
+            const uint32x2_t allEqual = vand_u32(vget_low_u32(equal), vget_high_u32(equal));
+            if ((vget_lane_u32(allEqual, 0) & vget_lane_u32(allEqual, 1)) != 0xFFFFFFFF)
+                break;
+        }
+#else
+        for (; x < end && matches(line[x]); ++x)
+            ;
+#endif
+        return x;
+    }
+
+    // the end of the last run before x that doesn't fully match
+    int skipBackward(const QRgb *line, int begin, int x) const
+    {
+#if defined(__SSE2__) || defined(_M_X64)
+        const __m128i mask = _mm_set1_epi32(m_mask);
+        const __m128i value = _mm_set1_epi32(m_value);
+        for (; x - runLength >= begin; x -= runLength) {
+            const __m128i pixels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(line + x - runLength)), mask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(pixels, value)) != 0xFFFF)
+                break;
+        }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        const uint32x4_t mask = vdupq_n_u32(m_mask);
+        const uint32x4_t value = vdupq_n_u32(m_value);
+        for (; x - runLength >= begin; x -= runLength) {
+            const uint32x4_t equal = vceqq_u32(vandq_u32(vld1q_u32(line + x - runLength), mask), value);
+            const uint32x2_t allEqual = vand_u32(vget_low_u32(equal), vget_high_u32(equal));
+            if ((vget_lane_u32(allEqual, 0) & vget_lane_u32(allEqual, 1)) != 0xFFFFFFFF)
+                break;
+        }
+#else
+        for (; x > begin && matches(line[x - 1]); --x)
+            ;
+#endif
+        return x;
+    }
+
+    QRgb m_paperColor;
+    bool m_premultiplied;
+    quint32 m_mask;
+    quint32 m_value;
+};
+}
+
 NormalizedRect Utils::imageBoundingBox(const QImage *image)
 {
     if (!image)
         return NormalizedRect();
 
+    // the scanner reads 32 bit pixels straight from the scanlines
+    QImage convertedImage;
+    if (image->format() != QImage::Format_RGB32 && image->format() != QImage::Format_ARGB32 && image->format() != QImage::Format_ARGB32_Premultiplied) {
+        convertedImage = image->convertToFormat(image->hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+        image = &convertedImage;
+    }
+
     const int width = image->width();
     const int height = image->height();
-    const QRgb paperColor = SettingsCore::paperColor().rgb();
+    const PaperColorScanner scanner(image->format(), SettingsCore::paperColor().rgb());
+    auto line = [image](int y) { return reinterpret_cast<const QRgb *>(image->constScanLine(y)); };
     int left, top, bottom, right, x, y;
 
 #ifdef BBOX_DEBUG
@@ -81,38 +225,43 @@ NormalizedRect Utils::imageBoundingBox(const QImage *image)
     time.start();
 #endif
 
-    // Scan pixels for top non-white
-    for (top = 0; top < height; ++top)
-        for (x = 0; x < width; ++x)
-            if (!isPaperColor(image->pixel(x, top), paperColor))
-                goto got_top;
-    return NormalizedRect(0, 0, 0, 0); // the image is blank
-got_top:
-    left = right = x;
-
-    // Scan pixels for bottom non-white
-    for (bottom = height - 1; bottom >= top; --bottom)
-        for (x = width - 1; x >= 0; --x)
-            if (!isPaperColor(image->pixel(x, bottom), paperColor))
-                goto got_bottom;
-    Q_ASSERT(0); // image changed?!
-got_bottom:
-    if (x < left)
-        left = x;
-    if (x > right)
-        right = x;
-
-    // Scan for leftmost and rightmost (we already found some bounds on these):
-    for (y = top; y <= bottom && (left > 0 || right < width - 1); ++y) {
-        for (x = 0; x < left; ++x)
-            if (!isPaperColor(image->pixel(x, y), paperColor))
+    // Scan rows for top non-white
+    for (top = 0; top < height; ++top) {
+        left = scanner.first(line(top), 0, width);
+        if (left != -1)
+            break;
+    }
+    if (top == height)
+        return NormalizedRect(0, 0, 0, 0); // the image is blank
+    right = scanner.last(line(top), left, width);
+
+    // Scan rows for bottom non-white
+    for (bottom = height - 1; bottom > top; --bottom) {
+        x = scanner.last(line(bottom), 0, width);
+        if (x != -1) {
+            right = qMax(right, x);
+            left = qMin(left, scanner.first(line(bottom), 0, x + 1));
+            break;
+        }
+    }
+
+    // Scan for leftmost and rightmost (we already found some bounds on these),
+    // only the margins outside of them need to be looked at. A first pass on
+    // every few rows finds most of the content, so that the margins are already
+    // narrow when every row is looked at in the second pass.
+    for (int step : {8, 1}) {
+        for (y = top + 1; y < bottom && (left > 0 || right < width - 1); y += step) {
+            const QRgb *pixels = line(y);
+            x = scanner.first(pixels, 0, left);
+            if (x != -1)
                 left = x;
-        for (x = width - 1; x > right + 1; --x)
-            if (!isPaperColor(image->pixel(x, y), paperColor))
+            x = scanner.last(pixels, right + 1, width);
+            if (x != -1)
                 right = x;
+        }
     }
 
-    NormalizedRect bbox(QRect(left, top, (right - left + 1), (bottom - top + 1)), image->width(), image->height());
+    NormalizedRect bbox(QRect(left, top, (right - left + 1), (bottom - top + 1)), width, height);
 
 #ifdef BBOX_DEBUG
     qCDebug(OkularCoreDebug) << "Computed bounding box" << bbox << "in" << time.elapsed() << "ms";
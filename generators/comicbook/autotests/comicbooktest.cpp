@@ -4,8 +4,13 @@
     SPDX-License-Identifier: GPL-2.0-or-later
 */
 
+#include <QFile>
+#include <QImage>
+#include <QTemporaryDir>
 #include <QTest>
 
+#include <memory>
+
 #include "core/document.h"
 #include "core/generator.h"
 #include "core/observer.h"
@@ -22,6 +27,7 @@ class ComicBookGeneratorTest : public QObject
 private slots:
     void initTestCase();
     void testRotatedImage();
+    void testGuessedPageSizes();
     void cleanupTestCase();
 };
 
@@ -50,6 +56,47 @@ void ComicBookGeneratorTest::testRotatedImage()
     QVERIFY(image.height() > image.width());
 }
 
+void ComicBookGeneratorTest::testGuessedPageSizes()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QVector<QSize> sizes = {QSize(10, 20), QSize(30, 10), QSize(5, 5)};
+    for (int i = 0; i < sizes.count(); ++i) {
+        QImage image(sizes[i], QImage::Format_RGB32);
+        image.fill(Qt::white);
+        QVERIFY(image.save(dir.filePath(QStringLiteral("page%1.png").arg(i + 1))));
+    }
+    QFile info(dir.filePath(QStringLiteral("ComicInfo.xml")));
+    QVERIFY(info.open(QIODevice::WriteOnly));
+    info.write("<ComicInfo/>");
+    info.close();
+    // named like an image but it isn't one, it must not become a page
+    QFile broken(dir.filePath(QStringLiteral("page2b.png")));
+    QVERIFY(broken.open(QIODevice::WriteOnly));
+    broken.write("not an image");
+    broken.close();
+
+    ComicBook::Document document;
+    QVERIFY(document.open(dir.path()));
+
+    QVector<Okular::Page *> pagesVector;
+    document.pages(&pagesVector);
+
+    // only the first page is read, the others get its size until they are
+    QCOMPARE(pagesVector.count(), sizes.count());
+    for (const Okular::Page *p : qAsConst(pagesVector))
+        QCOMPARE(QSize(p->width(), p->height()), sizes[0]);
+    QCOMPARE(document.guessedPages(), QVector<int>({1, 2}));
+
+    std::unique_ptr<ComicBook::PageSizeReader> reader(document.createPageSizeReader());
+    QVERIFY(reader);
+    const QAtomicInt stopped;
+    for (int i = 0; i < sizes.count(); ++i)
+        QCOMPARE(reader->pageSize(i, stopped), sizes[i]);
+
+    qDeleteAll(pagesVector);
+}
+
 QTEST_MAIN(ComicBookGeneratorTest)
 #include "comicbooktest.moc"
 
@@ -7,9 +7,10 @@
 #include "document.h"
 
 #include <QBuffer>
+#include <QFile>
+#include <QFileInfo>
 #include <QImage>
 #include <QImageReader>
-#include <QScopedPointer>
 
 #include <KLocalizedString>
 #include <KTar>
@@ -44,6 +45,106 @@ static void imagesInArchive(const QString &prefix, const KArchiveDirectory *dir,
     }
 }
 
+/**
+ * A new archive for the file, if it is of one of the formats KArchive reads.
+ */
+static KArchive *createArchive(const QString &fileName, const QMimeType &mime)
+{
+    /**
+     * We have a zip archive
+     */
+    if (mime.inherits(QStringLiteral("application/x-cbz")) || mime.inherits(QStringLiteral("application/zip"))) {
+        return new KZip(fileName);
+        /**
+         * We have a TAR archive
+         */
+    } else if (mime.inherits(QStringLiteral("application/x-cbt")) || mime.inherits(QStringLiteral("application/x-gzip")) || mime.inherits(QStringLiteral("application/x-tar")) || mime.inherits(QStringLiteral("application/x-bzip"))) {
+        return new KTar(fileName);
+#ifdef WITH_K7ZIP
+        /**
+         * We have a 7z archive
+         */
+    } else if (mime.inherits(QStringLiteral("application/x-cb7")) || mime.inherits(QStringLiteral("application/x-7z-compressed"))) {
+        return new K7Zip(fileName);
+#endif
+    }
+
+    return nullptr;
+}
+
+static QIODevice *createDevice(const KArchiveDirectory *archiveDir, const Directory *directory, const Unrar *unrar, const QString &file)
+{
+    if (archiveDir) {
+        const KArchiveFile *entry = static_cast<const KArchiveFile *>(archiveDir->entry(file));
+        return entry ? entry->createDevice() : nullptr;
+    } else if (directory) {
+        return directory->createDevice(file);
+    } else {
+        return unrar->createDevice(file);
+    }
+}
+
+/**
+ * The size of the image in @p device, invalid if it isn't an image.
+ */
+static QSize imageSize(QIODevice *device)
+{
+    QImageReader reader(device);
+    reader.setAutoTransform(true);
+    if (!reader.canRead())
+        return QSize();
+
+    QSize size = reader.size();
+    if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+        size.transpose();
+    }
+    if (!size.isValid()) {
+        const QImage i = reader.read();
+        if (!i.isNull())
+            size = i.size();
+    }
+    return size;
+}
+
+/**
+ * Whether the header in @p device is the one of an image, without reading the rest of it.
+ */
+static bool canReadImage(QIODevice *device)
+{
+    QImageReader reader(device);
+    return reader.canRead();
+}
+
+PageSizeReader::PageSizeReader()
+    : mDirectory(nullptr)
+    , mUnrar(nullptr)
+    , mArchive(nullptr)
+    , mArchiveDir(nullptr)
+{
+}
+
+PageSizeReader::~PageSizeReader()
+{
+    delete mArchive;
+}
+
+QSize PageSizeReader::pageSize(int page, const QAtomicInt &stopped) const
+{
+    const QString file = mPageMap.value(page);
+    // rather than extracting the files one by one
+    if (mUnrar) {
+        mUnrar->waitForExtraction(file, &stopped);
+        if (stopped.loadAcquire())
+            return QSize();
+    }
+
+    std::unique_ptr<QIODevice> dev(createDevice(mArchiveDir, mDirectory, mUnrar, file));
+    if (!dev)
+        return QSize();
+
+    return imageSize(dev.get());
+}
+
 Document::Document()
     : mDirectory(nullptr)
     , mUnrar(nullptr)
@@ -62,35 +163,11 @@ bool Document::open(const QString &fileName)
     QMimeDatabase db;
     const QMimeType mime = db.mimeTypeForFile(fileName, QMimeDatabase::MatchContent);
 
-    /**
-     * We have a zip archive
-     */
-    if (mime.inherits(QStringLiteral("application/x-cbz")) || mime.inherits(QStringLiteral("application/zip"))) {
-        mArchive = new KZip(fileName);
-
-        if (!processArchive()) {
-            return false;
-        }
-        /**
-         * We have a TAR archive
-         */
-    } else if (mime.inherits(QStringLiteral("application/x-cbt")) || mime.inherits(QStringLiteral("application/x-gzip")) || mime.inherits(QStringLiteral("application/x-tar")) || mime.inherits(QStringLiteral("application/x-bzip"))) {
-        mArchive = new KTar(fileName);
-
-        if (!processArchive()) {
-            return false;
-        }
-#ifdef WITH_K7ZIP
-        /**
-         * We have a 7z archive
-         */
-    } else if (mime.inherits(QStringLiteral("application/x-cb7")) || mime.inherits(QStringLiteral("application/x-7z-compressed"))) {
-        mArchive = new K7Zip(fileName);
-
+    mArchive = createArchive(fileName, mime);
+    if (mArchive) {
         if (!processArchive()) {
             return false;
         }
-#endif
     } else if (mime.inherits(QStringLiteral("application/x-cbr")) || mime.inherits(QStringLiteral("application/x-rar")) || mime.inherits(QStringLiteral("application/vnd.rar"))) {
         if (!Unrar::isAvailable()) {
             mLastErrorString = i18n("Cannot open document, neither unrar nor unarchiver were found.");
@@ -131,9 +208,17 @@ bool Document::open(const QString &fileName)
         return false;
     }
 
+    mFileName = fileName;
+    mMimeType = mime;
     return true;
 }
 
+void Document::stopExtraction()
+{
+    if (mUnrar)
+        mUnrar->stopExtraction();
+}
+
 void Document::close()
 {
     mLastErrorString.clear();
@@ -148,6 +233,7 @@ void Document::close()
     delete mUnrar;
     mUnrar = nullptr;
     mPageMap.clear();
+    mGuessedPages.clear();
     mEntries.clear();
 }
 
@@ -178,48 +264,76 @@ bool Document::processArchive()
 void Document::pages(QVector<Okular::Page *> *pagesVector)
 {
     std::sort(mEntries.begin(), mEntries.end(), caseSensitiveNaturalOrderLessThen);
-    QScopedPointer<QIODevice> dev;
 
-    int count = 0;
+    // Reading the size of every entry makes opening big archives slow, so the
+    // ones named like images are taken for images of the size of the first
+    // one, until a PageSizeReader tells their real size. Their header is still
+    // checked, so that what isn't an image after all doesn't become a blank page;
+    // not for rar archives, whose entries are only there once the background
+    // extraction gets to them
+    const QList<QByteArray> imageFormats = QImageReader::supportedImageFormats();
+    QSize firstPageSize;
+
     pagesVector->clear();
-    pagesVector->resize(mEntries.size());
-    QImageReader reader;
-    reader.setAutoTransform(true);
+    mPageMap.clear();
+    mGuessedPages.clear();
     for (const QString &file : qAsConst(mEntries)) {
-        if (mArchive) {
-            const KArchiveFile *entry = static_cast<const KArchiveFile *>(mArchiveDir->entry(file));
-            if (entry) {
-                dev.reset(entry->createDevice());
+        QSize pageSize;
+        if (firstPageSize.isValid() && imageFormats.contains(QFileInfo(file).suffix().toLower().toLatin1())) {
+            if (!mUnrar) {
+                std::unique_ptr<QIODevice> dev(createDevice(mArchiveDir, mDirectory, mUnrar, file));
+                if (!dev || !canReadImage(dev.get())) {
+                    qCDebug(OkularComicbookDebug) << "Ignoring" << file << "doesn't seem to be an image";
+                    continue;
+                }
             }
-        } else if (mDirectory) {
-            dev.reset(mDirectory->createDevice(file));
+            pageSize = firstPageSize;
+            mGuessedPages.append(mPageMap.count());
         } else {
-            dev.reset(mUnrar->createDevice(file));
-        }
-
-        if (!dev.isNull()) {
-            reader.setDevice(dev.data());
-            if (reader.canRead()) {
-                QSize pageSize = reader.size();
-                if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
-                    pageSize.transpose();
-                }
-                if (!pageSize.isValid()) {
-                    const QImage i = reader.read();
-                    if (!i.isNull())
-                        pageSize = i.size();
-                }
-                if (pageSize.isValid()) {
-                    pagesVector->replace(count, new Okular::Page(count, pageSize.width(), pageSize.height(), Okular::Rotation0));
-                    mPageMap.append(file);
-                    count++;
-                } else {
-                    qCDebug(OkularComicbookDebug) << "Ignoring" << file << "doesn't seem to be an image even if QImageReader::canRead returned true";
-                }
+            std::unique_ptr<QIODevice> dev(createDevice(mArchiveDir, mDirectory, mUnrar, file));
+            if (dev) {
+                pageSize = imageSize(dev.get());
+            }
+            if (!pageSize.isValid()) {
+                qCDebug(OkularComicbookDebug) << "Ignoring" << file << "doesn't seem to be an image";
+                continue;
+            }
+            if (!firstPageSize.isValid()) {
+                firstPageSize = pageSize;
             }
         }
+
+        pagesVector->append(new Okular::Page(mPageMap.count(), pageSize.width(), pageSize.height(), Okular::Rotation0));
+        mPageMap.append(file);
+    }
+}
+
+QVector<int> Document::guessedPages() const
+{
+    return mGuessedPages;
+}
+
+PageSizeReader *Document::createPageSizeReader() const
+{
+    std::unique_ptr<PageSizeReader> reader(new PageSizeReader());
+    reader->mPageMap = mPageMap;
+    if (mArchive) {
+        // KArchive devices of the same archive can't be used from different threads
+        reader->mArchive = createArchive(mFileName, mMimeType);
+        if (!reader->mArchive || !reader->mArchive->open(QIODevice::ReadOnly))
+            return nullptr;
+        reader->mArchiveDir = reader->mArchive->directory();
+        if (!reader->mArchiveDir)
+            return nullptr;
+    } else if (mDirectory) {
+        reader->mDirectory = mDirectory;
+    } else if (mUnrar) {
+        reader->mUnrar = mUnrar;
+    } else {
+        return nullptr;
     }
-    pagesVector->resize(count);
+
+    return reader.release();
 }
 
 QStringList Document::pageTitles() const
@@ -227,30 +341,36 @@ QStringList Document::pageTitles() const
     return QStringList();
 }
 
-QImage Document::pageImage(int page) const
+QByteArray Document::pageData(int page) const
 {
     if (mArchive) {
         const KArchiveFile *entry = static_cast<const KArchiveFile *>(mArchiveDir->entry(mPageMap[page]));
         if (entry) {
             std::unique_ptr<QIODevice> dev(entry->createDevice());
-            // This could simply be
-            //     QImageReader reader(dev.get());
+            // The image could simply be read from dev with a QImageReader
             // but due to https://codereview.qt-project.org/c/qt/qtbase/+/349174 and https://invent.kde.org/frameworks/karchive/-/merge_requests/14
             // it can not, so it will have to be like this at least until Qt6
             // Test with https://bugs.kde.org/attachment.cgi?id=74039 (it's a cbz with a png inside)
-            QBuffer b;
-            b.setData(dev->readAll());
-            QImageReader reader(&b);
-            reader.setAutoTransform(true);
-            return reader.read();
+            return dev->readAll();
         }
     } else if (mDirectory) {
-        return QImage(mPageMap[page]);
+        QFile file(mPageMap[page]);
+        if (file.open(QIODevice::ReadOnly))
+            return file.readAll();
     } else {
-        return QImage::fromData(mUnrar->contentOf(mPageMap[page]));
+        return mUnrar->contentOf(mPageMap[page]);
     }
 
-    return QImage();
+    return QByteArray();
+}
+
+QImage Document::pageImage(int page) const
+{
+    QBuffer b;
+    b.setData(pageData(page));
+    QImageReader reader(&b);
+    reader.setAutoTransform(true);
+    return reader.read();
 }
 
 QString Document::lastErrorString() const
@@ -7,7 +7,11 @@
 #ifndef COMICBOOK_DOCUMENT_H
 #define COMICBOOK_DOCUMENT_H
 
+#include <QAtomicInt>
+#include <QMimeType>
+#include <QSize>
 #include <QStringList>
+#include <QVector>
 
 class KArchiveDirectory;
 class KArchive;
@@ -22,6 +26,35 @@ class Page;
 
 namespace ComicBook
 {
+/**
+ * Reads the real sizes of the pages that Document::pages() only guessed.
+ *
+ * It opens archives again for its own use, so that several readers can be
+ * used in other threads while the document is used; the document must not
+ * be closed while they are.
+ */
+class PageSizeReader
+{
+public:
+    ~PageSizeReader();
+
+    /**
+     * The size of @p page, invalid if its image can't be read
+     * or @p stopped got set while waiting for it.
+     */
+    QSize pageSize(int page, const QAtomicInt &stopped) const;
+
+private:
+    friend class Document;
+    PageSizeReader();
+
+    QStringList mPageMap;
+    const Directory *mDirectory;
+    const Unrar *mUnrar;
+    KArchive *mArchive;
+    const KArchiveDirectory *mArchiveDir;
+};
+
 class Document
 {
 public:
@@ -31,9 +64,40 @@ public:
     bool open(const QString &fileName);
     void close();
 
+    /**
+     * Stops the background extraction of a rar archive, so that nobody
+     * waits for it anymore.
+     */
+    void stopExtraction();
+
+    /**
+     * Fills @p pagesVector with a page for every image of the document.
+     *
+     * Only the size of the entries that aren't named like images and of the
+     * first image is read, the other pages get the size of the first one as a
+     * guess once their header tells they are images, see guessedPages() and
+     * createPageSizeReader().
+     */
     void pages(QVector<Okular::Page *> *pagesVector);
+
+    /**
+     * The pages whose size pages() guessed.
+     */
+    QVector<int> guessedPages() const;
+
+    /**
+     * Returns a new reader for the real sizes of the pages, or nullptr if
+     * the document can't be opened again.
+     */
+    PageSizeReader *createPageSizeReader() const;
+
     QStringList pageTitles() const;
 
+    /**
+     * The encoded image of @p page, as stored.
+     */
+    QByteArray pageData(int page) const;
+
     QImage pageImage(int page) const;
 
     QString lastErrorString() const;
@@ -42,6 +106,9 @@ private:
     bool processArchive();
 
     QStringList mPageMap;
+    QVector<int> mGuessedPages;
+    QString mFileName;
+    QMimeType mMimeType;
     Directory *mDirectory;
     Unrar *mUnrar;
     KArchive *mArchive;
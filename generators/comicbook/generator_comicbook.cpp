@@ -6,8 +6,11 @@
 
 #include "generator_comicbook.h"
 
+#include <QAtomicInt>
 #include <QPainter>
 #include <QPrinter>
+#include <QRunnable>
+#include <QThread>
 
 #include <KAboutData>
 #include <KLocalizedString>
@@ -20,16 +23,77 @@
 
 OKULAR_EXPORT_PLUGIN(ComicBookGenerator, "libokularGenerator_comicbook.json")
 
+// how many page sizes a thread reads before handing them over
+static const int pageSizeChunk = 16;
+
+struct PageSizeReading {
+    QVector<int> pages;
+    QAtomicInt nextChunk;
+    QAtomicInt stopped;
+};
+
+/**
+ * Reads the sizes of chunks of PageSizeReading::pages until there are no more,
+ * so the threads reading them go through the document in page order.
+ */
+class PageSizeJob : public QRunnable
+{
+public:
+    PageSizeJob(ComicBookGenerator *generator, ComicBook::PageSizeReader *reader, const std::shared_ptr<PageSizeReading> &reading)
+        : mGenerator(generator)
+        , mReader(reader)
+        , mReading(reading)
+    {
+    }
+
+    void run() override
+    {
+        const int chunks = (mReading->pages.count() + pageSizeChunk - 1) / pageSizeChunk;
+        int chunk;
+        while (!mReading->stopped.loadAcquire() && (chunk = mReading->nextChunk.fetchAndAddRelaxed(1)) < chunks) {
+            QHash<int, QSizeF> sizes;
+            const int end = qMin((chunk + 1) * pageSizeChunk, mReading->pages.count());
+            for (int i = chunk * pageSizeChunk; i < end && !mReading->stopped.loadAcquire(); ++i) {
+                const int page = mReading->pages[i];
+                const QSize size = mReader->pageSize(page, mReading->stopped);
+                if (size.isValid())
+                    sizes.insert(page, size);
+            }
+
+            ComicBookGenerator *generator = mGenerator;
+            const std::shared_ptr<PageSizeReading> reading = mReading;
+            QMetaObject::invokeMethod(
+                generator, [generator, reading, sizes] { generator->pageSizesRead(reading.get(), sizes); }, Qt::QueuedConnection);
+        }
+    }
+
+private:
+    ComicBookGenerator *mGenerator;
+    std::unique_ptr<ComicBook::PageSizeReader> mReader;
+    std::shared_ptr<PageSizeReading> mReading;
+};
+
 ComicBookGenerator::ComicBookGenerator(QObject *parent, const QVariantList &args)
     : Generator(parent, args)
 {
     setFeature(Threaded);
     setFeature(PrintNative);
     setFeature(PrintToFile);
+
+    mDecoders.setMaxCost(4);
+
+    // each size change relayouts the document, so apply them in batches
+    mPageSizeUpdateTimer.setSingleShot(true);
+    mPageSizeUpdateTimer.setInterval(200);
+    connect(&mPageSizeUpdateTimer, &QTimer::timeout, this, [this] {
+        updatePageSizes(mReadPageSizes);
+        mReadPageSizes.clear();
+    });
 }
 
 ComicBookGenerator::~ComicBookGenerator()
 {
+    stopReadingPageSizes();
 }
 
 bool ComicBookGenerator::loadDocument(const QString &fileName, QVector<Okular::Page *> &pagesVector)
@@ -42,11 +106,17 @@ bool ComicBookGenerator::loadDocument(const QString &fileName, QVector<Okular::P
     }
 
     mDocument.pages(&pagesVector);
+    startReadingPageSizes();
     return true;
 }
 
 bool ComicBookGenerator::doCloseDocument()
 {
+    stopReadingPageSizes();
+    {
+        QMutexLocker locker(&mDecodersMutex);
+        mDecoders.clear();
+    }
     mDocument.close();
 
     return true;
@@ -56,10 +126,61 @@ QImage ComicBookGenerator::image(Okular::PixmapRequest *request)
 {
     int width = request->width();
     int height = request->height();
+    if (request->page()->rotation() % 2 == 1)
+        qSwap(width, height);
+
+    QMutexLocker locker(&mDecodersMutex);
+    Okular::ImageDecoder *decoder = mDecoders.object(request->pageNumber());
+    if (!decoder) {
+        decoder = new Okular::ImageDecoder(mDocument.pageData(request->pageNumber()));
+        mDecoders.insert(request->pageNumber(), decoder);
+    }
+
+    return decoder->image(QSize(width, height));
+}
 
-    QImage image = mDocument.pageImage(request->pageNumber());
+void ComicBookGenerator::startReadingPageSizes()
+{
+    const QVector<int> pages = mDocument.guessedPages();
+    if (pages.isEmpty())
+        return;
+
+    mPageSizeReading = std::make_shared<PageSizeReading>();
+    mPageSizeReading->pages = pages;
+
+    const int threads = qBound(1, (pages.count() + pageSizeChunk - 1) / pageSizeChunk, QThread::idealThreadCount());
+    mPageSizeThreads.setMaxThreadCount(threads);
+    for (int i = 0; i < threads; ++i) {
+        ComicBook::PageSizeReader *reader = mDocument.createPageSizeReader();
+        if (!reader)
+            break;
+        mPageSizeThreads.start(new PageSizeJob(this, reader, mPageSizeReading));
+    }
+}
 
-    return image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+void ComicBookGenerator::stopReadingPageSizes()
+{
+    if (mPageSizeReading) {
+        mPageSizeReading->stopped.storeRelease(1);
+        // the readers may be waiting for the extraction of a rar archive
+        mDocument.stopExtraction();
+    }
+    mPageSizeThreads.waitForDone();
+    mPageSizeReading.reset();
+    mPageSizeUpdateTimer.stop();
+    mReadPageSizes.clear();
+}
+
+void ComicBookGenerator::pageSizesRead(const PageSizeReading *reading, const QHash<int, QSizeF> &sizes)
+{
+    // sizes read for a document that was closed in the meantime
+    if (reading != mPageSizeReading.get())
+        return;
+
+    for (auto it = sizes.constBegin(); it != sizes.constEnd(); ++it)
+        mReadPageSizes.insert(it.key(), it.value());
+    if (!mPageSizeUpdateTimer.isActive())
+        mPageSizeUpdateTimer.start();
 }
 
 Okular::Document::PrintError ComicBookGenerator::print(QPrinter &printer)
@@ -8,9 +8,20 @@
 #define GENERATOR_COMICBOOK_H
 
 #include <core/generator.h>
+#include <core/imagedecoder.h>
+
+#include <QCache>
+#include <QMutex>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <memory>
 
 #include "document.h"
 
+class PageSizeJob;
+struct PageSizeReading;
+
 class ComicBookGenerator : public Okular::Generator
 {
     Q_OBJECT
@@ -31,7 +42,23 @@ protected:
     QImage image(Okular::PixmapRequest *request) override;
 
 private:
+    friend class PageSizeJob;
+
+    void startReadingPageSizes();
+    void stopReadingPageSizes();
+    void pageSizesRead(const PageSizeReading *reading, const QHash<int, QSizeF> &sizes);
+
     ComicBook::Document mDocument;
+
+    // the last pages shown, with their reduced copies
+    QCache<int, Okular::ImageDecoder> mDecoders;
+    QMutex mDecodersMutex;
+
+    // the real sizes of the pages whose size was guessed, read in the background
+    QThreadPool mPageSizeThreads;
+    std::shared_ptr<PageSizeReading> mPageSizeReading;
+    QHash<int, QSizeF> mReadPageSizes;
+    QTimer mPageSizeUpdateTimer;
 };
 
 #endif
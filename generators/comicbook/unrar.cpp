@@ -10,7 +10,9 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QGlobalStatic>
+#include <QSet>
 #include <QTemporaryDir>
+#include <QThread>
 
 #include <QLoggingCategory>
 #if defined(WITH_KPTY)
@@ -98,16 +100,47 @@ UnrarHelper::~UnrarHelper()
     delete kind;
 }
 
+/**
+ * Runs the extraction with @p args to the end, unless @p stop gets set.
+ *
+ * Like startSyncProcess() it takes anything written to stderr for an error,
+ * asking for a password included, and kills the process then, since nobody
+ * is there to type it.
+ */
+static bool runExtraction(const QStringList &args, const QAtomicInt *stop)
+{
+    QProcess process;
+    process.setStandardOutputFile(QProcess::nullDevice());
+    process.start(helper->unrarPath, args);
+    process.closeWriteChannel();
+    if (!process.waitForStarted(-1))
+        return false;
+
+    while (!process.waitForFinished(100) && process.state() != QProcess::NotRunning) {
+        if ((stop && stop->loadAcquire()) || !process.readAllStandardError().isEmpty()) {
+            process.kill();
+            process.waitForFinished(-1);
+            return false;
+        }
+    }
+
+    return process.exitStatus() == QProcess::NormalExit && process.exitCode() == 0 && process.readAllStandardError().isEmpty();
+}
+
 Unrar::Unrar()
     : QObject(nullptr)
     , mLoop(nullptr)
     , mTempDir(nullptr)
+    , mExtractionThread(nullptr)
+    , mSingleFilesDir(nullptr)
 {
 }
 
 Unrar::~Unrar()
 {
+    stopExtraction();
     delete mTempDir;
+    delete mSingleFilesDir;
 }
 
 bool Unrar::open(const QString &fileName)
@@ -115,35 +148,27 @@ bool Unrar::open(const QString &fileName)
     if (!isSuitableVersionAvailable())
         return false;
 
+    stopExtraction();
     delete mTempDir;
     mTempDir = new QTemporaryDir();
+    delete mSingleFilesDir;
+    mSingleFilesDir = new QTemporaryDir();
 
     mFileName = fileName;
+    mFiles.clear();
+    mArchiveEntries.clear();
+    mFileIndexes.clear();
 
-    /**
-     * Extract the archive to a temporary directory
-     */
     mStdOutData.clear();
     mStdErrData.clear();
 
-    const int ret = startSyncProcess(helper->kind->processOpenArchiveArgs(mFileName, mTempDir->path()));
-    bool ok = ret == 0;
-
-    return ok;
-}
-
-QStringList Unrar::list()
-{
-    mStdOutData.clear();
-    mStdErrData.clear();
-
-    if (!isSuitableVersionAvailable())
-        return QStringList();
-
-    startSyncProcess(helper->kind->processListArgs(mFileName));
+    if (startSyncProcess(helper->kind->processListArgs(mFileName)) != 0)
+        return false;
 
     const QRegularExpression regex(QStringLiteral("[\r\n]"));
     QStringList listFiles = helper->kind->processListing(QString::fromLocal8Bit(mStdOutData).split(regex, QString::SkipEmptyParts));
+    if (listFiles.isEmpty())
+        return false;
 
     QString subDir;
 
@@ -153,16 +178,39 @@ QStringList Unrar::list()
         listFiles.removeLast();
     }
 
-    QStringList newList;
+    // The listings have the directories too, but nothing is extracted for them
+    QSet<QString> directories;
+    for (const QString &f : qAsConst(listFiles)) {
+        for (int slash = f.indexOf(QLatin1Char('/')); slash > 0; slash = f.indexOf(QLatin1Char('/'), slash + 1))
+            directories.insert(f.left(slash));
+    }
+
     for (const QString &f : qAsConst(listFiles)) {
+        if (f.endsWith(QLatin1Char('/')) || directories.contains(f))
+            continue;
+
         // Extract all the files to mTempDir regardless of their path inside the archive
         // This will break if ever an arvhice with two files with the same name in different subfolders
-        QFileInfo fi(f);
-        if (QFile::exists(mTempDir->path() + QLatin1Char('/') + subDir + fi.fileName())) {
-            newList.append(subDir + fi.fileName());
-        }
+        const QString file = subDir + QFileInfo(f).fileName();
+        if (mFileIndexes.contains(file))
+            continue;
+
+        mFileIndexes.insert(file, mFiles.count());
+        mFiles.append(file);
+        mArchiveEntries.append(f);
     }
-    return newList;
+
+    mExtractionState.storeRelease(ExtractionRunning);
+    mStopExtraction.storeRelease(0);
+    mExtractionThread = QThread::create([this] { extractAll(); });
+    mExtractionThread->start();
+
+    return true;
+}
+
+QStringList Unrar::list()
+{
+    return mFiles;
 }
 
 QByteArray Unrar::contentOf(const QString &fileName) const
@@ -170,7 +218,7 @@ QByteArray Unrar::contentOf(const QString &fileName) const
     if (!isSuitableVersionAvailable())
         return QByteArray();
 
-    QFile file(mTempDir->path() + QLatin1Char('/') + fileName);
+    QFile file(extractedFile(fileName));
     if (!file.open(QIODevice::ReadOnly))
         return QByteArray();
 
@@ -182,13 +230,85 @@ QIODevice *Unrar::createDevice(const QString &fileName) const
     if (!isSuitableVersionAvailable())
         return nullptr;
 
-    std::unique_ptr<QFile> file(new QFile(mTempDir->path() + QLatin1Char('/') + fileName));
+    std::unique_ptr<QFile> file(new QFile(extractedFile(fileName)));
     if (!file->open(QIODevice::ReadOnly))
         return nullptr;
 
     return file.release();
 }
 
+void Unrar::waitForExtraction(const QString &fileName, const QAtomicInt *stopped) const
+{
+    const int index = mFileIndexes.value(fileName, -1);
+    if (index == -1)
+        return;
+
+    while (!isExtracted(index) && mExtractionState.loadAcquire() == ExtractionRunning && !mStopExtraction.loadAcquire() && !(stopped && stopped->loadAcquire()))
+        QThread::msleep(20);
+}
+
+void Unrar::extractAll()
+{
+    const ProcessArgs args = helper->kind->processOpenArchiveArgs(mFileName, mTempDir->path());
+    const bool extracted = runExtraction(args.appArgs, &mStopExtraction);
+    if (!extracted && !mStopExtraction.loadAcquire())
+        qCDebug(OkularComicbookDebug) << "Extracting" << mFileName << "failed, the pages not extracted yet are extracted one by one";
+
+    mExtractionState.storeRelease(extracted ? ExtractionFinished : ExtractionFailed);
+}
+
+bool Unrar::isExtracted(int index) const
+{
+    if (mExtractionState.loadAcquire() == ExtractionFinished)
+        return true;
+
+    // The files are extracted one after the other in archive order,
+    // so when the next one appeared this one is complete
+    return index + 1 < mFiles.count() && QFile::exists(mTempDir->path() + QLatin1Char('/') + mFiles[index + 1]);
+}
+
+QString Unrar::extractedFile(const QString &fileName) const
+{
+    const int index = mFileIndexes.value(fileName, -1);
+    if (index == -1)
+        return QString();
+
+    const QString path = mTempDir->path() + QLatin1Char('/') + fileName;
+    if (isExtracted(index))
+        return path;
+
+    // Don't make the page wait for all the ones before it
+    {
+        QMutexLocker locker(&mSingleFilesMutex);
+        const QString singlePath = mSingleFilesDir->path() + QLatin1Char('/') + fileName;
+        if (QFile::exists(singlePath))
+            return singlePath;
+
+        const ProcessArgs args = helper->kind->processExtractEntryArgs(mFileName, mArchiveEntries[index], mSingleFilesDir->path());
+        if (!args.appArgs.isEmpty()) {
+            if (runExtraction(args.appArgs, nullptr) && QFile::exists(singlePath))
+                return singlePath;
+            // don't take a partially extracted file for a complete one later
+            QFile::remove(singlePath);
+        }
+    }
+
+    // the background extraction may still get to it, unless it failed or was stopped
+    waitForExtraction(fileName);
+    return isExtracted(index) ? path : QString();
+}
+
+void Unrar::stopExtraction()
+{
+    if (!mExtractionThread)
+        return;
+
+    mStopExtraction.storeRelease(1);
+    mExtractionThread->wait();
+    delete mExtractionThread;
+    mExtractionThread = nullptr;
+}
+
 bool Unrar::isAvailable()
 {
     return helper->kind;
@@ -7,6 +7,9 @@
 #ifndef UNRAR_H
 #define UNRAR_H
 
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
 #include <QObject>
 #include <QProcess>
 #include <QStringList>
@@ -15,6 +18,7 @@
 
 class QEventLoop;
 class QTemporaryDir;
+class QThread;
 
 #if defined(WITH_KPTY)
 class KPtyProcess;
@@ -36,25 +40,48 @@ public:
     ~Unrar() override;
 
     /**
-     * Opens given rar archive.
+     * Opens given rar archive and starts extracting it to a temporary
+     * directory in the background.
      */
     bool open(const QString &fileName);
 
     /**
-     * Returns the list of files from the archive.
+     * Returns the list of files from the archive, in archive order.
      */
     QStringList list();
 
     /**
      * Returns the content of the file with the given name.
+     *
+     * If the background extraction didn't get to the file yet, it is
+     * extracted on its own.
      */
     QByteArray contentOf(const QString &fileName) const;
 
     /**
      * Returns a new device for reading the file with the given name.
+     *
+     * If the background extraction didn't get to the file yet, it is
+     * extracted on its own.
      */
     QIODevice *createDevice(const QString &fileName) const;
 
+    /**
+     * Waits for the background extraction to get past the file with the
+     * given name, for who wants all the files and would rather not have
+     * them extracted one by one.
+     *
+     * It returns early when the extraction fails or is stopped, or when
+     * @p stopped is set.
+     */
+    void waitForExtraction(const QString &fileName, const QAtomicInt *stopped = nullptr) const;
+
+    /**
+     * Stops the background extraction, the files it didn't get to are
+     * then extracted one by one.
+     */
+    void stopExtraction();
+
     static bool isAvailable();
     static bool isSuitableVersionAvailable();
 
@@ -66,6 +93,9 @@ private Q_SLOTS:
 private:
     int startSyncProcess(const ProcessArgs &args);
     void writeToProcess(const QByteArray &data);
+    void extractAll();
+    bool isExtracted(int index) const;
+    QString extractedFile(const QString &fileName) const;
 
 #if defined(WITH_KPTY)
     KPtyProcess *mProcess;
@@ -77,6 +107,21 @@ private:
     QByteArray mStdOutData;
     QByteArray mStdErrData;
     QTemporaryDir *mTempDir;
+
+    // the files, named as in mTempDir, and their names in the archive
+    QStringList mFiles;
+    QStringList mArchiveEntries;
+    QHash<QString, int> mFileIndexes;
+
+    enum ExtractionState { ExtractionRunning, ExtractionFinished, ExtractionFailed };
+
+    QThread *mExtractionThread;
+    QAtomicInt mExtractionState;
+    QAtomicInt mStopExtraction;
+
+    // the files extracted on their own, before the background extraction got to them
+    QTemporaryDir *mSingleFilesDir;
+    mutable QMutex mSingleFilesMutex;
 };
 
 #endif
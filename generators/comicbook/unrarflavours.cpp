@@ -36,6 +36,11 @@ QString UnrarFlavour::fileName() const
     return mFileName;
 }
 
+ProcessArgs UnrarFlavour::processExtractEntryArgs(const QString &, const QString &, const QString &) const
+{
+    return ProcessArgs();
+}
+
 NonFreeUnrarFlavour::NonFreeUnrarFlavour()
     : UnrarFlavour()
 {
@@ -62,6 +67,12 @@ ProcessArgs NonFreeUnrarFlavour::processOpenArchiveArgs(const QString &fileName,
     return ProcessArgs(QStringList() << QStringLiteral("e") << fileName << path + QLatin1Char('/'), false);
 }
 
+ProcessArgs NonFreeUnrarFlavour::processExtractEntryArgs(const QString &fileName, const QString &entry, const QString &path) const
+{
+    // -- keeps an entry starting with - from being taken for a switch
+    return ProcessArgs(QStringList() << QStringLiteral("e") << QStringLiteral("-y") << QStringLiteral("--") << fileName << entry << path + QLatin1Char('/'), false);
+}
+
 FreeUnrarFlavour::FreeUnrarFlavour()
     : UnrarFlavour()
 {
@@ -34,6 +34,12 @@ public:
     virtual ProcessArgs processListArgs(const QString &fileName) const = 0;
     virtual ProcessArgs processOpenArchiveArgs(const QString &fileName, const QString &path) const = 0;
 
+    /**
+     * The arguments for extracting only @p entry to @p path, with no
+     * directories, or no arguments if that can't be done.
+     */
+    virtual ProcessArgs processExtractEntryArgs(const QString &fileName, const QString &entry, const QString &path) const;
+
     void setFileName(const QString &fileName);
 
 protected:
@@ -55,6 +61,7 @@ public:
 
     ProcessArgs processListArgs(const QString &fileName) const override;
     ProcessArgs processOpenArchiveArgs(const QString &fileName, const QString &path) const override;
+    ProcessArgs processExtractEntryArgs(const QString &fileName, const QString &entry, const QString &path) const override;
 };
 
 class FreeUnrarFlavour : public UnrarFlavour
@@ -65,6 +65,7 @@ DjVuGenerator::DjVuGenerator(QObject *parent, const QVariantList &args)
 {
     setFeature(TextExtraction);
     setFeature(Threaded);
+    setFeature(TiledRendering);
     setFeature(PrintPostscript);
     if (Okular::FilePrinter::ps2pdfAvailable())
         setFeature(PrintToFile);
@@ -95,6 +96,7 @@ bool DjVuGenerator::doCloseDocument()
 {
     userMutex()->lock();
     m_djvu->closeFile();
+    m_decodedPagesMemory.storeRelease(0);
     userMutex()->unlock();
 
     delete m_docSyn;
@@ -106,11 +108,31 @@ bool DjVuGenerator::doCloseDocument()
 QImage DjVuGenerator::image(Okular::PixmapRequest *request)
 {
     userMutex()->lock();
-    QImage img = m_djvu->image(request->pageNumber(), request->width(), request->height(), request->page()->rotation());
+    const QRect rect = request->isTile() ? request->normalizedRect().geometry(request->width(), request->height()) : QRect();
+    QImage img = m_djvu->image(request->pageNumber(), request->width(), request->height(), request->page()->rotation(), rect);
+    // have the pages around decoded while the image is shown, preloads
+    // go ahead of the reading already
+    if (!request->preload()) {
+        m_djvu->prefetchPage(request->pageNumber() + 1);
+        m_djvu->prefetchPage(request->pageNumber() - 1);
+    }
+    m_decodedPagesMemory.storeRelease(int(m_djvu->decodedPagesMemory() / 1024));
     userMutex()->unlock();
     return img;
 }
 
+void DjVuGenerator::freeCachedMemory(qulonglong memory)
+{
+    // don't block the main thread while a page is rendered, the next
+    // memory check will try again
+    if (!userMutex()->tryLock())
+        return;
+
+    m_djvu->releaseDecodedPages(memory);
+    m_decodedPagesMemory.storeRelease(int(m_djvu->decodedPagesMemory() / 1024));
+    userMutex()->unlock();
+}
+
 Okular::DocumentInfo DjVuGenerator::generateDocumentInfo(const QSet<Okular::DocumentInfo::Key> &keys) const
 {
     Okular::DocumentInfo docInfo;
@@ -177,9 +199,12 @@ Okular::Document::PrintError DjVuGenerator::print(QPrinter &printer)
 
 QVariant DjVuGenerator::metaData(const QString &key, const QVariant &option) const
 {
-    Q_UNUSED(option)
     if (key == QLatin1String("DocumentTitle")) {
         return m_djvu->metaData(QStringLiteral("title"));
+    } else if (key == QLatin1String("CachedMemory")) {
+        return qulonglong(m_decodedPagesMemory.loadAcquire()) * 1024;
+    } else if (key == QLatin1String("FreeCachedMemory")) {
+        const_cast<DjVuGenerator *>(this)->freeCachedMemory(option.toULongLong());
     }
     return QVariant();
 }
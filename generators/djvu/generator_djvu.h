@@ -9,6 +9,7 @@
 
 #include <core/generator.h>
 
+#include <QAtomicInt>
 #include <QVector>
 
 #include "kdjvu.h"
@@ -47,8 +48,12 @@ private:
     void loadPages(QVector<Okular::Page *> &pagesVector, int rotation);
     Okular::ObjectRect *convertKDjVuLink(int page, KDjVu::Link *link) const;
     Okular::Annotation *convertKDjVuAnnotation(int w, int h, KDjVu::Annotation *ann) const;
+    // frees about memory bytes of the decoded pages, for the FreeCachedMemory meta data
+    void freeCachedMemory(qulonglong memory);
 
     KDjVu *m_djvu;
+    // in KiB, to be read without waiting for the rendering thread
+    QAtomicInt m_decodedPagesMemory;
 
     Okular::DocumentSynopsis *m_docSyn;
 };
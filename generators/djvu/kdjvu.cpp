@@ -425,11 +425,12 @@ public:
         , m_djvu_document(nullptr)
         , m_format(nullptr)
         , m_docBookmarks(nullptr)
+        , m_decodedPagesMemory(0)
         , m_cacheEnabled(true)
     {
     }
 
-    QImage generateImageTile(ddjvu_page_t *djvupage, int &res, int width, int row, int xdelta, int height, int col, int ydelta);
+    QImage generateImageTile(ddjvu_page_t *djvupage, int &res, int width, int height, const QRect &rect);
 
     void readBookmarks();
     void fillBookmarksRecurse(QDomDocument &maindoc, QDomNode &curnode, miniexp_t exp, int offset = -1);
@@ -438,12 +439,20 @@ public:
 
     int pageWithName(const QString &name);
 
+    ddjvu_page_t *decodedPage(int page);
+    qulonglong decodedPageMemory(int page) const;
+    void releaseDecodedPage(int page);
+    void releaseDecodedPages(int maxPages, qulonglong maxMemory);
+
     ddjvu_context_t *m_djvu_cxt;
     ddjvu_document_t *m_djvu_document;
     ddjvu_format_t *m_format;
 
     QVector<KDjVu::Page *> m_pages;
-    QVector<ddjvu_page_t *> m_pages_cache;
+    // the decoded pages, the numbers of the most recently used first
+    QHash<int, ddjvu_page_t *> m_pages_cache;
+    QList<int> m_pages_cache_order;
+    qulonglong m_decodedPagesMemory;
 
     QList<ImageCacheItem *> mImgCache;
 
@@ -459,15 +468,59 @@ public:
 
 unsigned int KDjVu::Private::s_formatmask[4] = {0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000};
 
-QImage KDjVu::Private::generateImageTile(ddjvu_page_t *djvupage, int &res, int width, int row, int xdelta, int height, int col, int ydelta)
+// how many decoded pages are kept at most, and how much memory they can take
+static const int s_maxDecodedPages = 8;
+static const qulonglong s_maxDecodedPagesMemory = 256 * 1024 * 1024;
+
+ddjvu_page_t *KDjVu::Private::decodedPage(int page)
+{
+    ddjvu_page_t *djvupage = m_pages_cache.value(page);
+    if (djvupage) {
+        m_pages_cache_order.removeOne(page);
+        m_pages_cache_order.prepend(page);
+        return djvupage;
+    }
+
+    // DjVuLibre decodes the page in a thread of its own
+    djvupage = ddjvu_page_create_by_pageno(m_djvu_document, page);
+    if (!djvupage)
+        return nullptr;
+
+    m_pages_cache.insert(page, djvupage);
+    m_pages_cache_order.prepend(page);
+    m_decodedPagesMemory += decodedPageMemory(page);
+    releaseDecodedPages(s_maxDecodedPages, s_maxDecodedPagesMemory);
+    return djvupage;
+}
+
+qulonglong KDjVu::Private::decodedPageMemory(int page) const
+{
+    // DjVuLibre doesn't tell, the masks and the layers of a decoded page take
+    // about a byte per pixel at its full resolution
+    const KDjVu::Page *p = m_pages.at(page);
+    return qulonglong(p->width()) * p->height();
+}
+
+void KDjVu::Private::releaseDecodedPage(int page)
+{
+    ddjvu_page_release(m_pages_cache.take(page));
+    m_pages_cache_order.removeOne(page);
+    m_decodedPagesMemory -= decodedPageMemory(page);
+}
+
+void KDjVu::Private::releaseDecodedPages(int maxPages, qulonglong maxMemory)
+{
+    while (m_pages_cache_order.count() > 1 && (m_pages_cache_order.count() > maxPages || m_decodedPagesMemory > maxMemory))
+        releaseDecodedPage(m_pages_cache_order.last());
+}
+
+QImage KDjVu::Private::generateImageTile(ddjvu_page_t *djvupage, int &res, int width, int height, const QRect &rect)
 {
     ddjvu_rect_t renderrect;
-    renderrect.x = row * xdelta;
-    renderrect.y = col * ydelta;
-    int realwidth = qMin(width - renderrect.x, xdelta);
-    int realheight = qMin(height - renderrect.y, ydelta);
-    renderrect.w = realwidth;
-    renderrect.h = realheight;
+    renderrect.x = rect.x();
+    renderrect.y = rect.y();
+    renderrect.w = rect.width();
+    renderrect.h = rect.height();
 #ifdef KDJVU_DEBUG
     qDebug() << "renderrect:" << renderrect;
 #endif
@@ -480,7 +533,7 @@ QImage KDjVu::Private::generateImageTile(ddjvu_page_t *djvupage, int &res, int w
     qDebug() << "pagerect:" << pagerect;
 #endif
     handle_ddjvu_messages(m_djvu_cxt, false);
-    QImage res_img(realwidth, realheight, QImage::Format_RGB32);
+    QImage res_img(rect.width(), rect.height(), QImage::Format_RGB32);
     // the following line workarounds a rare crash in djvulibre;
     // it should be fixed with >= 3.5.21
     ddjvu_page_get_width(djvupage);
@@ -652,8 +705,6 @@ bool KDjVu::openFile(const QString &fileName)
     int numofpages = ddjvu_document_get_pagenum(d->m_djvu_document);
     d->m_pages.clear();
     d->m_pages.resize(numofpages);
-    d->m_pages_cache.clear();
-    d->m_pages_cache.resize(numofpages);
 
     // get the document type
     QString doctype;
@@ -721,10 +772,11 @@ void KDjVu::closeFile()
     qDeleteAll(d->m_pages);
     d->m_pages.clear();
     // releasing the djvu pages
-    QVector<ddjvu_page_t *>::Iterator it = d->m_pages_cache.begin(), itEnd = d->m_pages_cache.end();
-    for (; it != itEnd; ++it)
-        ddjvu_page_release(*it);
+    for (ddjvu_page_t *djvupage : qAsConst(d->m_pages_cache))
+        ddjvu_page_release(djvupage);
     d->m_pages_cache.clear();
+    d->m_pages_cache_order.clear();
+    d->m_decodedPagesMemory = 0;
     // clearing the image cache
     qDeleteAll(d->mImgCache);
     d->mImgCache.clear();
@@ -840,9 +892,15 @@ const QVector<KDjVu::Page *> &KDjVu::pages() const
     return d->m_pages;
 }
 
-QImage KDjVu::image(int page, int width, int height, int rotation)
+QImage KDjVu::image(int page, int width, int height, int rotation, const QRect &rect)
 {
-    if (d->m_cacheEnabled) {
+    const QRect pageRect(0, 0, width, height);
+    const QRect renderRect = rect.isValid() ? rect & pageRect : pageRect;
+    if (renderRect.isEmpty())
+        return QImage();
+    const bool wholePage = renderRect == pageRect;
+
+    if (d->m_cacheEnabled && wholePage) {
         bool found = false;
         QList<ImageCacheItem *>::Iterator it = d->mImgCache.begin(), itEnd = d->mImgCache.end();
         for (; (it != itEnd) && !found; ++it) {
@@ -861,15 +919,12 @@ QImage KDjVu::image(int page, int width, int height, int rotation)
         }
     }
 
-    if (!d->m_pages_cache.at(page)) {
-        ddjvu_page_t *newpage = ddjvu_page_create_by_pageno(d->m_djvu_document, page);
-        // wait for the new page to be loaded
-        ddjvu_status_t sts;
-        while ((sts = ddjvu_page_decoding_status(newpage)) < DDJVU_JOB_OK)
-            handle_ddjvu_messages(d->m_djvu_cxt, true);
-        d->m_pages_cache[page] = newpage;
-    }
-    ddjvu_page_t *djvupage = d->m_pages_cache[page];
+    ddjvu_page_t *djvupage = d->decodedPage(page);
+    if (!djvupage)
+        return QImage();
+    // wait for the page to be decoded, if it is not yet
+    while (ddjvu_page_decoding_status(djvupage) < DDJVU_JOB_OK)
+        handle_ddjvu_messages(d->m_djvu_cxt, true);
 
     /*
         if ( ddjvu_page_get_rotation( djvupage ) != flipRotation( rotation ) )
@@ -883,34 +938,35 @@ QImage KDjVu::image(int page, int width, int height, int rotation)
     static const int xdelta = 1500;
     static const int ydelta = 1500;
 
-    int xparts = width / xdelta + 1;
-    int yparts = height / ydelta + 1;
+    const int xparts = (renderRect.width() + xdelta - 1) / xdelta;
+    const int yparts = (renderRect.height() + ydelta - 1) / ydelta;
 
     QImage newimg;
 
     int res = 10000;
     if ((xparts == 1) && (yparts == 1)) {
         // only one part -- render at once with no need to auxiliary image
-        newimg = d->generateImageTile(djvupage, res, width, 0, xdelta, height, 0, ydelta);
+        newimg = d->generateImageTile(djvupage, res, width, height, renderRect);
     } else {
         // more than one part -- need to render piece-by-piece and to compose
         // the results
-        newimg = QImage(width, height, QImage::Format_RGB32);
+        newimg = QImage(renderRect.size(), QImage::Format_RGB32);
         QPainter p;
         p.begin(&newimg);
         int parts = xparts * yparts;
         for (int i = 0; i < parts; ++i) {
             const int row = i % xparts;
             const int col = i / xparts;
+            const QRect partRect = QRect(renderRect.x() + row * xdelta, renderRect.y() + col * ydelta, xdelta, ydelta) & renderRect;
             int tmpres = 0;
-            const QImage tempp = d->generateImageTile(djvupage, tmpres, width, row, xdelta, height, col, ydelta);
-            p.drawImage(row * xdelta, col * ydelta, tempp);
+            const QImage tempp = d->generateImageTile(djvupage, tmpres, width, height, partRect);
+            p.drawImage(partRect.topLeft() - renderRect.topLeft(), tempp);
             res = qMin(tmpres, res);
         }
         p.end();
     }
 
-    if (res && d->m_cacheEnabled) {
+    if (res && d->m_cacheEnabled && wholePage) {
         // delete all the cached pixmaps for the current page with a size that
         // differs no more than 35% of the new pixmap size
         int imgsize = newimg.width() * newimg.height();
@@ -937,6 +993,26 @@ QImage KDjVu::image(int page, int width, int height, int rotation)
     return newimg;
 }
 
+void KDjVu::prefetchPage(int page)
+{
+    if (!d->m_djvu_document || page < 0 || page >= d->m_pages.count() || d->m_pages_cache.contains(page))
+        return;
+
+    d->decodedPage(page);
+    handle_ddjvu_messages(d->m_djvu_cxt, false);
+}
+
+qulonglong KDjVu::decodedPagesMemory() const
+{
+    return d->m_decodedPagesMemory;
+}
+
+void KDjVu::releaseDecodedPages(qulonglong memory)
+{
+    const qulonglong maxMemory = memory < d->m_decodedPagesMemory ? d->m_decodedPagesMemory - memory : 0;
+    d->releaseDecodedPages(s_maxDecodedPages, maxMemory);
+}
+
 bool KDjVu::exportAsPostScript(const QString &fileName, const QList<int> &pageList) const
 {
     if (!d->m_djvu_document || fileName.trimmed().isEmpty() || pageList.isEmpty())
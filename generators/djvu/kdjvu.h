@@ -258,8 +258,29 @@ public:
      * Check if the image for the specified \p page with the specified
      * \p width, \p height and \p rotation is already in cache, and returns
      * it. If not, a null image is returned.
+     *
+     * If \p rect is valid, only that part of the page scaled to \p width
+     * and \p height is rendered, and it is never cached.
+     */
+    QImage image(int page, int width, int height, int rotation, const QRect &rect = QRect());
+
+    /**
+     * Start decoding the specified \p page in the background, if it is not
+     * decoded already, so that a later image() of it has less to wait.
+     */
+    void prefetchPage(int page);
+
+    /**
+     * A rough estimate, in bytes, of the memory used by the decoded pages
+     * that are kept for the next image() calls.
+     */
+    qulonglong decodedPagesMemory() const;
+
+    /**
+     * Release the least recently used decoded pages, up to about \p memory
+     * bytes of them. The most recently used page is always kept.
      */
-    QImage image(int page, int width, int height, int rotation);
+    void releaseDecodedPages(qulonglong memory);
 
     /**
      * Export the currently open document as PostScript file \p fileName.
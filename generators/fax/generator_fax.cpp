@@ -42,11 +42,12 @@ bool FaxGenerator::loadDocument(const QString &fileName, QVector<Okular::Page *>
         return false;
     }
 
-    m_img = faxDocument.image();
+    m_decoder.reset(new Okular::ImageDecoder(faxDocument.image()));
 
     pagesVector.resize(1);
 
-    Okular::Page *page = new Okular::Page(0, m_img.width(), m_img.height(), Okular::Rotation0);
+    const QSize size = m_decoder->size();
+    Okular::Page *page = new Okular::Page(0, size.width(), size.height(), Okular::Rotation0);
     pagesVector[0] = page;
 
     return true;
@@ -54,20 +55,20 @@ bool FaxGenerator::loadDocument(const QString &fileName, QVector<Okular::Page *>
 
 bool FaxGenerator::doCloseDocument()
 {
-    m_img = QImage();
+    m_decoder.reset();
 
     return true;
 }
 
 QImage FaxGenerator::image(Okular::PixmapRequest *request)
 {
-    // perform a smooth scaled generation
+    // perform a smooth scaled generation, from the smallest reduced copy that is large enough
     int width = request->width();
     int height = request->height();
     if (request->page()->rotation() % 2 == 1)
         qSwap(width, height);
 
-    return m_img.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    return m_decoder->image(QSize(width, height));
 }
 
 Okular::DocumentInfo FaxGenerator::generateDocumentInfo(const QSet<Okular::DocumentInfo::Key> &keys) const
@@ -86,7 +87,7 @@ Okular::Document::PrintError FaxGenerator::print(QPrinter &printer)
 {
     QPainter p(&printer);
 
-    QImage image(m_img);
+    QImage image = m_decoder->image();
 
     if ((image.width() > printer.width()) || (image.height() > printer.height()))
 
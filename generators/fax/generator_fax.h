@@ -7,8 +7,9 @@
 #define OKULAR_GENERATOR_FAX_H
 
 #include <core/generator.h>
+#include <core/imagedecoder.h>
 
-#include <QImage>
+#include <memory>
 
 #include "faxdocument.h"
 
@@ -32,7 +33,7 @@ protected:
     QImage image(Okular::PixmapRequest *request) override;
 
 private:
-    QImage m_img;
+    std::unique_ptr<Okular::ImageDecoder> m_decoder;
     FaxDocument::DocumentType m_type;
 };
 
@@ -11,9 +11,7 @@
 
 #include "generator_kimgio.h"
 
-#include <QBuffer>
 #include <QFile>
-#include <QImageReader>
 #include <QMimeDatabase>
 #include <QMimeType>
 #include <QPainter>
@@ -33,6 +31,30 @@
 
 OKULAR_EXPORT_PLUGIN(KIMGIOGenerator, "libokularGenerator_kimgio.json")
 
+#ifdef WITH_KEXIV
+static QImageIOHandler::Transformations exifTransformation(KExiv2Iface::KExiv2::ImageOrientation orientation)
+{
+    switch (orientation) {
+    case KExiv2Iface::KExiv2::ORIENTATION_HFLIP:
+        return QImageIOHandler::TransformationMirror;
+    case KExiv2Iface::KExiv2::ORIENTATION_ROT_180:
+        return QImageIOHandler::TransformationRotate180;
+    case KExiv2Iface::KExiv2::ORIENTATION_VFLIP:
+        return QImageIOHandler::TransformationFlip;
+    case KExiv2Iface::KExiv2::ORIENTATION_ROT_90_HFLIP:
+        return QImageIOHandler::TransformationFlipAndRotate90;
+    case KExiv2Iface::KExiv2::ORIENTATION_ROT_90:
+        return QImageIOHandler::TransformationRotate90;
+    case KExiv2Iface::KExiv2::ORIENTATION_ROT_90_VFLIP:
+        return QImageIOHandler::TransformationMirrorAndRotate90;
+    case KExiv2Iface::KExiv2::ORIENTATION_ROT_270:
+        return QImageIOHandler::TransformationRotate270;
+    default:
+        return QImageIOHandler::TransformationNone;
+    }
+}
+#endif
+
 KIMGIOGenerator::KIMGIOGenerator(QObject *parent, const QVariantList &args)
     : Generator(parent, args)
 {
@@ -65,20 +87,18 @@ bool KIMGIOGenerator::loadDocumentFromData(const QByteArray &fileData, QVector<O
 
 bool KIMGIOGenerator::loadDocumentInternal(const QByteArray &fileData, const QString &fileName, QVector<Okular::Page *> &pagesVector)
 {
-    QBuffer buffer;
-    buffer.setData(fileData);
-    buffer.open(QIODevice::ReadOnly);
-
-    QImageReader reader(&buffer, QImageReader::imageFormat(&buffer));
-    reader.setAutoDetectImageFormat(true);
-    if (!reader.read(&m_img)) {
-        if (!m_img.isNull()) {
-            emit warning(i18n("This document appears malformed. Here is a best approximation of the document's intended appearance."), -1);
-        } else {
-            emit error(i18n("Unable to load document: %1", reader.errorString()), -1);
-            return false;
-        }
+    // the image is decoded at the size it is shown, here only the header and a
+    // small level of it, which also makes sure that there is an image after the header
+    m_decoder.reset(new Okular::ImageDecoder(fileData, false));
+    if (!m_decoder->isValid() || m_decoder->image(m_decoder->size().scaled(64, 64, Qt::KeepAspectRatio).expandedTo(QSize(1, 1))).isNull()) {
+        emit error(i18n("Unable to load document: %1", m_decoder->errorString()), -1);
+        m_decoder.reset();
+        m_cachedMemory.storeRelease(0);
+        return false;
     }
+    m_malformedWarningShown.storeRelease(0);
+    m_cachedMemory.storeRelease(int(m_decoder->cachedMemory() / 1024));
+
     QMimeDatabase db;
     auto mime = db.mimeTypeForFileNameAndData(fileName, fileData);
     docInfo.set(Okular::DocumentInfo::MimeType, mime.name());
@@ -87,13 +107,14 @@ bool KIMGIOGenerator::loadDocumentInternal(const QByteArray &fileData, const QSt
     // Apply transformations dictated by Exif metadata
     KExiv2Iface::KExiv2 exifMetadata;
     if (exifMetadata.loadFromData(fileData)) {
-        exifMetadata.rotateExifQImage(m_img, exifMetadata.getImageOrientation());
+        m_decoder->setTransformation(exifTransformation(exifMetadata.getImageOrientation()));
     }
 #endif
 
     pagesVector.resize(1);
 
-    Okular::Page *page = new Okular::Page(0, m_img.width(), m_img.height(), Okular::Rotation0);
+    const QSize size = m_decoder->size();
+    Okular::Page *page = new Okular::Page(0, size.width(), size.height(), Okular::Rotation0);
     pagesVector[0] = page;
 
     return true;
@@ -108,41 +129,39 @@ KIMGIOGenerator::SwapBackingFileResult KIMGIOGenerator::swapBackingFile(QString
 
 bool KIMGIOGenerator::doCloseDocument()
 {
-    m_img = QImage();
+    m_decoder.reset();
+    m_cachedMemory.storeRelease(0);
 
     return true;
 }
 
 QImage KIMGIOGenerator::image(Okular::PixmapRequest *request)
 {
-    // perform a smooth scaled generation
+    QImage image;
     if (request->isTile()) {
-        const QRect srcRect = request->normalizedRect().geometry(m_img.width(), m_img.height());
         const QRect destRect = request->normalizedRect().geometry(request->width(), request->height());
-
-        QImage destImg(destRect.size(), QImage::Format_RGB32);
-        destImg.fill(Qt::white);
-
-        QPainter p(&destImg);
-        p.setRenderHint(QPainter::SmoothPixmapTransform);
-        p.drawImage(destImg.rect(), m_img, srcRect);
-
-        return destImg;
+        image = m_decoder->image(QSize(request->width(), request->height()), destRect);
     } else {
         int width = request->width();
         int height = request->height();
         if (request->page()->rotation() % 2 == 1)
             qSwap(width, height);
 
-        return m_img.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        image = m_decoder->image(QSize(width, height));
     }
+    m_cachedMemory.storeRelease(int(m_decoder->cachedMemory() / 1024));
+
+    if (!image.isNull() && !m_decoder->errorString().isEmpty() && m_malformedWarningShown.testAndSetRelaxed(0, 1))
+        emit warning(i18n("This document appears malformed. Here is a best approximation of the document's intended appearance."), -1);
+
+    return image;
 }
 
 Okular::Document::PrintError KIMGIOGenerator::print(QPrinter &printer)
 {
     QPainter p(&printer);
 
-    QImage image(m_img);
+    QImage image = m_decoder->image();
 
     if ((image.width() > printer.width()) || (image.height() > printer.height()))
 
@@ -153,6 +172,25 @@ Okular::Document::PrintError KIMGIOGenerator::print(QPrinter &printer)
     return Okular::Document::NoPrintError;
 }
 
+QVariant KIMGIOGenerator::metaData(const QString &key, const QVariant &option) const
+{
+    Q_UNUSED(option)
+    if (key == QLatin1String("CachedMemory")) {
+        return qulonglong(m_cachedMemory.loadAcquire()) * 1024;
+    } else if (key == QLatin1String("FreeCachedMemory")) {
+        const_cast<KIMGIOGenerator *>(this)->freeCachedMemory();
+    }
+    return QVariant();
+}
+
+void KIMGIOGenerator::freeCachedMemory()
+{
+    // all or nothing, the levels are decoded again from the smallest one needed;
+    // if one is being decoded the next memory check will try again
+    if (m_decoder && m_decoder->tryReleaseCachedImages())
+        m_cachedMemory.storeRelease(0);
+}
+
 Okular::DocumentInfo KIMGIOGenerator::generateDocumentInfo(const QSet<Okular::DocumentInfo::Key> &keys) const
 {
     Q_UNUSED(keys);
@@ -12,8 +12,11 @@
 
 #include <core/document.h>
 #include <core/generator.h>
+#include <core/imagedecoder.h>
 
-#include <QImage>
+#include <QAtomicInt>
+
+#include <memory>
 
 class KIMGIOGenerator : public Okular::Generator
 {
@@ -35,15 +38,23 @@ public:
     // [INHERITED] document information
     Okular::DocumentInfo generateDocumentInfo(const QSet<Okular::DocumentInfo::Key> &keys) const override;
 
+    // [INHERITED] the memory of the decoded levels of the image
+    QVariant metaData(const QString &key, const QVariant &option) const override;
+
 protected:
     bool doCloseDocument() override;
     QImage image(Okular::PixmapRequest *request) override;
 
 private:
     bool loadDocumentInternal(const QByteArray &fileData, const QString &fileName, QVector<Okular::Page *> &pagesVector);
+    // frees the decoded levels of the image, for the FreeCachedMemory meta data
+    void freeCachedMemory();
 
 private:
-    QImage m_img;
+    std::unique_ptr<Okular::ImageDecoder> m_decoder;
+    QAtomicInt m_malformedWarningShown;
+    // in KiB, so that the main thread can read it while a level is decoded
+    QAtomicInt m_cachedMemory;
     Okular::DocumentInfo docInfo;
 };
 
@@ -54,10 +54,12 @@ static int maskExportedFlags(int flags)
 }
 
 // BEGIN PopplerAnnotationProxy implementation
-PopplerAnnotationProxy::PopplerAnnotationProxy(Poppler::Document *doc, QMutex *userMutex, QHash<Okular::Annotation *, Poppler::Annotation *> *annotsOnOpenHash)
+PopplerAnnotationProxy::PopplerAnnotationProxy(Poppler::Document *doc, QMutex *userMutex, QHash<Okular::Annotation *, Poppler::Annotation *> *annotsOnOpenHash, const std::function<void(int)> &pageModifiedCallback, const std::function<void(int)> &pageAnnotationsNeededCallback)
     : ppl_doc(doc)
     , mutex(userMutex)
     , annotationsOnOpenHash(annotsOnOpenHash)
+    , pageModified(pageModifiedCallback)
+    , pageAnnotationsNeeded(pageAnnotationsNeededCallback)
 {
 }
 
@@ -462,6 +464,8 @@ static Poppler::Annotation *createPopplerAnnotationFromOkularAnnotation(const Ok
 }
 void PopplerAnnotationProxy::notifyAddition(Okular::Annotation *okl_ann, int page)
 {
+    pageAnnotationsNeeded(page);
+
     QMutexLocker ml(mutex);
 
     Poppler::Page *ppl_page = ppl_doc->page(page);
@@ -529,12 +533,13 @@ void PopplerAnnotationProxy::notifyAddition(Okular::Annotation *okl_ann, int pag
     okl_ann->setNativeId(QVariant::fromValue(ppl_ann));
     okl_ann->setDisposeDataFunction(disposeAnnotation);
 
+    pageModified(page);
+
     qCDebug(OkularPdfDebug) << okl_ann->uniqueName();
 }
 
 void PopplerAnnotationProxy::notifyModification(const Okular::Annotation *okl_ann, int page, bool appearanceChanged)
 {
-    Q_UNUSED(page);
     Q_UNUSED(appearanceChanged);
 
     Poppler::Annotation *ppl_ann = qvariant_cast<Poppler::Annotation *>(okl_ann->nativeId());
@@ -544,6 +549,8 @@ void PopplerAnnotationProxy::notifyModification(const Okular::Annotation *okl_an
 
     QMutexLocker ml(mutex);
 
+    pageModified(page);
+
     if (okl_ann->flags() & (Okular::Annotation::BeingMoved | Okular::Annotation::BeingResized)) {
         // Okular ui already renders the annotation on its own
         ppl_ann->setFlags(Poppler::Annotation::Hidden);
@@ -631,6 +638,8 @@ void PopplerAnnotationProxy::notifyRemoval(Okular::Annotation *okl_ann, int page
     ppl_page->removeAnnotation(ppl_ann); // Also destroys ppl_ann
     delete ppl_page;
 
+    pageModified(page);
+
     okl_ann->setNativeId(QVariant::fromValue(0)); // So that we don't double-free in disposeAnnotation
 
     qCDebug(OkularPdfDebug) << okl_ann->uniqueName();
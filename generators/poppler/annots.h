@@ -15,6 +15,7 @@
 
 #include <QMutex>
 
+#include <functional>
 #include <unordered_map>
 
 #include "config-okular-poppler.h"
@@ -25,7 +26,7 @@ extern Okular::Annotation *createAnnotationFromPopplerAnnotation(Poppler::Annota
 class PopplerAnnotationProxy : public Okular::AnnotationProxy
 {
 public:
-    PopplerAnnotationProxy(Poppler::Document *doc, QMutex *userMutex, QHash<Okular::Annotation *, Poppler::Annotation *> *annotsOnOpenHash);
+    PopplerAnnotationProxy(Poppler::Document *doc, QMutex *userMutex, QHash<Okular::Annotation *, Poppler::Annotation *> *annotsOnOpenHash, const std::function<void(int)> &pageModifiedCallback, const std::function<void(int)> &pageAnnotationsNeededCallback);
     ~PopplerAnnotationProxy() override;
 
     bool supports(Capability capability) const override;
@@ -37,6 +38,11 @@ private:
     Poppler::Document *ppl_doc;
     QMutex *mutex;
     QHash<Okular::Annotation *, Poppler::Annotation *> *annotationsOnOpenHash;
+    // called with the page number every time the annotations of a page are changed in ppl_doc
+    std::function<void(int)> pageModified;
+    // called with the page number before adding an annotation to a page, so that
+    // the annotations already in ppl_doc are loaded before the new one shows up there
+    std::function<void(int)> pageAnnotationsNeeded;
 #ifdef HAVE_POPPLER_21_10
     std::unordered_map<Okular::StampAnnotation *, std::unique_ptr<Poppler::AnnotationAppearance>> deletedStampsAnnotationAppearance;
 #endif
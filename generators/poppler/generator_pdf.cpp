@@ -20,7 +20,9 @@
 #include <QComboBox>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFileInfo>
 #include <QImage>
 #include <QLayout>
 #include <QMutex>
@@ -75,6 +77,11 @@ Q_DECLARE_METATYPE(const Poppler::LinkOCGState *)
 
 static const int defaultPageWidth = 595;
 static const int defaultPageHeight = 842;
+// annotations of the pages after these ones are loaded lazily
+static const int eagerAnnotationPages = 16;
+// each copy of the document costs as much memory as pdfdoc, the renderings
+// beyond these take turns on pdfdoc
+static const int maxRenderDocuments = 3;
 
 class PDFOptionsPage : public Okular::PrintOptionsWidget
 {
@@ -574,6 +581,10 @@ static QLinkedList<Okular::ObjectRect *> generateLinks(const QList<Poppler::Link
  * So, as example, printing while generating a pixmap asynchronously is safe,
  * it might only block the gui thread by 1) waiting for the mutex to unlock
  * in async thread and 2) doing the 'heavy' print operation.
+ * concurrency: image() and textPage() work on private copies of the document
+ *           (see takeRenderDocument) whenever the page only has contents that
+ *           are also in the file, so they don't need the mutex and several of
+ *           them can run at the same time.
  */
 
 OKULAR_EXPORT_PLUGIN(PDFGenerator, "libokularGenerator_poppler.json")
@@ -587,12 +598,15 @@ static void PDFGeneratorPopplerDebugFunction(const QString &message, const QVari
 PDFGenerator::PDFGenerator(QObject *parent, const QVariantList &args)
     : Generator(parent, args)
     , pdfdoc(nullptr)
+    , renderDocumentsUsable(false)
     , docSynopsisDirty(true)
     , xrefReconstructed(false)
     , docEmbeddedFilesDirty(true)
     , nextFontPage(0)
     , annotProxy(nullptr)
     , certStore(nullptr)
+    , nextAnnotationsPage(0)
+    , annotationsLoadTimer(new QTimer(this))
 {
     setFeature(Threaded);
     setFeature(TextExtraction);
@@ -608,6 +622,10 @@ PDFGenerator::PDFGenerator(QObject *parent, const QVariantList &args)
     setFeature(TiledRendering);
     setFeature(SwapBackingFile);
     setFeature(SupportsCancelling);
+    setFeature(ConcurrentRendering);
+
+    annotationsLoadTimer->setInterval(20);
+    connect(annotationsLoadTimer, &QTimer::timeout, this, &PDFGenerator::loadMoreAnnotations);
 
     // You only need to do it once not for each of the documents but it is cheap enough
     // so doing it all the time won't hurt either
@@ -636,6 +654,9 @@ Okular::Document::OpenResult PDFGenerator::loadDocumentWithPassword(const QStrin
 #endif
     // create PDFDoc for the given file
     pdfdoc = Poppler::Document::load(filePath, nullptr, nullptr);
+    documentFilePath = filePath;
+    documentFileModified = QFileInfo(filePath).lastModified();
+    documentData.clear();
     return init(pagesVector, password);
 }
 
@@ -649,27 +670,34 @@ Okular::Document::OpenResult PDFGenerator::loadDocumentFromDataWithPassword(cons
 #endif
     // create PDFDoc for the given file
     pdfdoc = Poppler::Document::loadFromData(fileData, nullptr, nullptr);
+    documentFilePath.clear();
+    documentData = fileData;
     return init(pagesVector, password);
 }
 
+static bool unlockDocument(Poppler::Document *doc, const QString &password)
+{
+    if (doc->isLocked()) {
+        doc->unlock(password.toLatin1(), password.toLatin1());
+
+        if (doc->isLocked())
+            doc->unlock(password.toUtf8(), password.toUtf8());
+    }
+
+    return !doc->isLocked();
+}
+
 Okular::Document::OpenResult PDFGenerator::init(QVector<Okular::Page *> &pagesVector, const QString &password)
 {
     if (!pdfdoc)
         return Okular::Document::OpenError;
 
-    if (pdfdoc->isLocked()) {
-        pdfdoc->unlock(password.toLatin1(), password.toLatin1());
-
-        if (pdfdoc->isLocked()) {
-            pdfdoc->unlock(password.toUtf8(), password.toUtf8());
-
-            if (pdfdoc->isLocked()) {
-                delete pdfdoc;
-                pdfdoc = nullptr;
-                return Okular::Document::OpenNeedsPassword;
-            }
-        }
+    if (!unlockDocument(pdfdoc, password)) {
+        delete pdfdoc;
+        pdfdoc = nullptr;
+        return Okular::Document::OpenNeedsPassword;
     }
+    documentPassword = password;
 
     xrefReconstructed = false;
 #ifdef HAVE_POPPLER_RECONSTRUCTION_CALLBACK
@@ -690,16 +718,34 @@ Okular::Document::OpenResult PDFGenerator::init(QVector<Okular::Page *> &pagesVe
     }
     pagesVector.resize(pageCount);
     rectsGenerated.fill(false, pageCount);
+    pagesNeedingMainDocument.fill(false, pageCount);
+    renderDocumentsUsable = true;
+    annotationsLoaded.fill(false, pageCount);
 
     annotationsOnOpenHash.clear();
 
     loadPages(pagesVector, 0, false);
 
+    // layers are only toggled in pdfdoc, so once the user changes them we can't render from the copies anymore
+    if (pdfdoc->hasOptionalContent()) {
+        connect(pdfdoc->optionalContentModel(), &QAbstractItemModel::dataChanged, this, [this] {
+            QMutexLocker locker(&renderDocumentsMutex);
+            renderDocumentsUsable = false;
+        });
+    }
+
     // update the configuration
     reparseConfig();
 
     // create annotation proxy
-    annotProxy = new PopplerAnnotationProxy(pdfdoc, userMutex(), &annotationsOnOpenHash);
+    annotProxy = new PopplerAnnotationProxy(
+        pdfdoc, userMutex(), &annotationsOnOpenHash, [this](int page) { setPageNeedsMainDocument(page); }, [this](int page) { loadPageAnnotations(page, true); });
+
+    // fetch the annotations of the remaining pages in the background
+    nextAnnotationsPage = 0;
+    wantedAnnotationsPages.clear();
+    if (annotationsLoaded.count(true) < pageCount)
+        annotationsLoadTimer->start();
 
     // the file has been loaded correctly
     return Okular::Document::OpenSuccess;
@@ -714,6 +760,17 @@ PDFGenerator::SwapBackingFileResult PDFGenerator::swapBackingFile(QString const
     if (openResult != Okular::Document::OpenSuccess)
         return SwapBackingFileError;
 
+    // The document replaces the annotations of the current pages with the ones
+    // of the new pages, so all of them need to be there already
+    userMutex()->lock();
+    for (int i = 0; i < newPagesVector.count(); ++i) {
+        const QList<Okular::Annotation *> annotations = loadPageAnnotationsLocked(i);
+        for (Okular::Annotation *annotation : annotations)
+            newPagesVector[i]->addAnnotation(annotation);
+    }
+    userMutex()->unlock();
+    annotationsLoadTimer->stop();
+
     // Recreate links if needed since they are done on image() and image() is not called when swapping the file
     // since the page is already rendered
     if (oldRectsGenerated.count() == rectsGenerated.count()) {
@@ -736,6 +793,8 @@ PDFGenerator::SwapBackingFileResult PDFGenerator::swapBackingFile(QString const
 
 bool PDFGenerator::doCloseDocument()
 {
+    annotationsLoadTimer->stop();
+
     // remove internal objects
     userMutex()->lock();
     delete annotProxy;
@@ -743,6 +802,7 @@ bool PDFGenerator::doCloseDocument()
     delete pdfdoc;
     pdfdoc = nullptr;
     userMutex()->unlock();
+    deleteRenderDocuments();
     docSynopsisDirty = true;
     docSyn.clear();
     docEmbeddedFilesDirty = true;
@@ -750,6 +810,8 @@ bool PDFGenerator::doCloseDocument()
     docEmbeddedFiles.clear();
     nextFontPage = 0;
     rectsGenerated.clear();
+    annotationsLoaded.clear();
+    wantedAnnotationsPages.clear();
 
     return true;
 }
@@ -758,6 +820,8 @@ void PDFGenerator::loadPages(QVector<Okular::Page *> &pagesVector, int rotation,
 {
     // TODO XPDF 3.01 check
     const int count = pagesVector.count();
+    // without an AcroForm there are no form fields to look for, which saves parsing the annotations of every page
+    const bool hasForms = pdfdoc->formType() != Poppler::Document::NoForm;
     double w = 0, h = 0;
     for (int i = 0; i < count; i++) {
         // get xpdf page
@@ -787,8 +851,14 @@ void PDFGenerator::loadPages(QVector<Okular::Page *> &pagesVector, int rotation,
             // init a Okular::page, add transition and annotation information
             page = new Okular::Page(i, w, h, orientation);
             addTransition(p, page);
-            if (true) // TODO real check
-                addAnnotations(p, page);
+            // parsing the annotations of all the pages takes long for big documents,
+            // only the first ones are loaded here and the rest when they are needed
+            if (i < eagerAnnotationPages) {
+                const QList<Okular::Annotation *> annotations = getAnnotations(p);
+                for (Okular::Annotation *annotation : annotations)
+                    page->addAnnotation(annotation);
+                annotationsLoaded.setBit(i);
+            }
             Poppler::Link *tmplink = p->action(Poppler::Page::Opening);
             if (tmplink) {
                 page->setPageAction(Okular::Page::Opening, createLinkFromPopplerLink(tmplink));
@@ -802,14 +872,18 @@ void PDFGenerator::loadPages(QVector<Okular::Page *> &pagesVector, int rotation,
 
             QLinkedList<Okular::FormField *> okularFormFields;
 #if POPPLER_VERSION_MACRO >= QT_VERSION_CHECK(0, 89, 0)
-            if (i > 0) // for page 0 we handle the form fields at the end
+            if (hasForms && i > 0) // for page 0 we handle the form fields at the end
                 okularFormFields = getFormFields(p);
 #else
-            okularFormFields = getFormFields(p);
+            if (hasForms)
+                okularFormFields = getFormFields(p);
 #endif
-            if (!okularFormFields.isEmpty())
+            if (!okularFormFields.isEmpty()) {
                 page->setFormFields(okularFormFields);
-                //        qWarning(PDFDebug).nospace() << page->width() << "x" << page->height();
+                // form values are edited in pdfdoc
+                setPageNeedsMainDocument(i);
+            }
+            //        qWarning(PDFDebug).nospace() << page->width() << "x" << page->height();
 
 #ifdef PDFGENERATOR_DEBUG
             qCDebug(OkularPdfDebug) << "load page" << i << "with rotation" << rotation << "and orientation" << orientation;
@@ -827,7 +901,7 @@ void PDFGenerator::loadPages(QVector<Okular::Page *> &pagesVector, int rotation,
 
     // Once we've added the signatures to all pages except page 0, we add all the missing signatures there
     // we do that because there's signatures that don't belong to any page, but okular needs a page<->signature mapping
-    if (count > 0) {
+    if (hasForms && count > 0) {
 #if POPPLER_VERSION_MACRO >= QT_VERSION_CHECK(0, 89, 0)
         const QVector<Poppler::FormFieldSignature *> allSignatures = pdfdoc->signatures();
         std::unique_ptr<Poppler::Page> page0(pdfdoc->page(0));
@@ -859,8 +933,10 @@ void PDFGenerator::loadPages(QVector<Okular::Page *> &pagesVector, int rotation,
             }
         }
 
-        if (!page0FormFields.isEmpty())
+        if (!page0FormFields.isEmpty()) {
             pagesVector[0]->setFormFields(page0FormFields);
+            setPageNeedsMainDocument(0);
+        }
 #endif
     }
 }
@@ -1120,6 +1196,27 @@ static bool shouldAbortRenderCallback(const QVariant &vPayload)
     return payload->request->shouldAbortRender();
 }
 
+void PDFGenerator::generatePixmap(Okular::PixmapRequest *request)
+{
+    // the page is about to be shown, so its annotations are needed now, but if
+    // pdfdoc is busy rendering don't block the ui for them, annotationsLoadTimer
+    // fetches them first thing on its next timeout
+    if (!loadPageAnnotations(request->pageNumber(), false)) {
+        wantedAnnotationsPages.append(request->pageNumber());
+        annotationsLoadTimer->start();
+    }
+
+    // and so are its links, image() might not be called if the document
+    // has the page in its render cache, otherwise image() loads them
+    // rectsGenerated is written by the rendering threads, so only read it locked
+    if (!request->isTile() && documentMetaData(RenderCacheMetaData).toBool()) {
+        QMutexLocker ml(userMutex());
+        loadPageLinksLocked(request->page());
+    }
+
+    Generator::generatePixmap(request);
+}
+
 QImage PDFGenerator::image(Okular::PixmapRequest *request)
 {
     // debug requests to this (xpdf) generator
@@ -1136,20 +1233,23 @@ QImage PDFGenerator::image(Okular::PixmapRequest *request)
     qreal fakeDpiX = request->width() / pageWidth * dpi().width();
     qreal fakeDpiY = request->height() / pageHeight * dpi().height();
 
-    // generate links rects only the first time
-    bool genObjectRects = !rectsGenerated.at(page->number());
-
-    // 0. LOCK [waits for the thread end]
-    userMutex()->lock();
+    // 0. LOCK [waits for the thread end], unless the page can be rendered
+    // from a private copy of the document
+    Poppler::Document *renderDoc = takeRenderDocument(page->number());
+    if (!renderDoc)
+        userMutex()->lock();
 
     if (request->shouldAbortRender()) {
-        userMutex()->unlock();
+        if (renderDoc)
+            giveBackRenderDocument(renderDoc);
+        else
+            userMutex()->unlock();
         return QImage();
     }
 
     // 1. Set OutputDev parameters and Generate contents
     // note: thread safety is set on 'false' for the GUI (this) thread
-    Poppler::Page *p = pdfdoc->page(page->number());
+    Poppler::Page *p = (renderDoc ? renderDoc : pdfdoc)->page(page->number());
 
     // 2. Take data from outputdev and attach it to the Page
     QImage img;
@@ -1178,24 +1278,41 @@ QImage PDFGenerator::image(Okular::PixmapRequest *request)
         img.fill(Qt::white);
     }
 
-    if (p && genObjectRects) {
-        // TODO previously we extracted Image type rects too, but that needed porting to poppler
-        // and as we are not doing anything with Image type rects i did not port it, have a look at
-        // dead gp_outputdev.cpp on image extraction
-        page->setObjectRects(generateLinks(p->links()));
-        rectsGenerated[request->page()->number()] = true;
+    delete p;
 
-        resolveMediaLinkReferences(page);
+    // the links are always taken from pdfdoc, so it needs to be locked from here on
+    if (renderDoc) {
+        giveBackRenderDocument(renderDoc);
+        userMutex()->lock();
     }
 
+    // generate links rects only the first time
+    loadPageLinksLocked(page);
+
     // 3. UNLOCK [re-enables shared access]
     userMutex()->unlock();
 
-    delete p;
-
     return img;
 }
 
+void PDFGenerator::loadPageLinksLocked(Okular::Page *page)
+{
+    if (rectsGenerated.at(page->number()))
+        return;
+
+    // TODO previously we extracted Image type rects too, but that needed porting to poppler
+    // and as we are not doing anything with Image type rects i did not port it, have a look at
+    // dead gp_outputdev.cpp on image extraction
+    Poppler::Page *linksPage = pdfdoc->page(page->number());
+    if (linksPage) {
+        page->setObjectRects(generateLinks(linksPage->links()));
+        rectsGenerated[page->number()] = true;
+
+        resolveMediaLinkReferences(page);
+        delete linksPage;
+    }
+}
+
 template<typename PopplerLinkType, typename OkularLinkType, typename PopplerAnnotationType, typename OkularAnnotationType>
 void resolveMediaLinks(Okular::Action *action, enum Okular::Annotation::SubType subType, QHash<Okular::Annotation *, Poppler::Annotation *> &annotationsHash)
 {
@@ -1283,8 +1400,10 @@ Okular::TextPage *PDFGenerator::textPage(Okular::TextRequest *request)
     // build a TextList...
     QList<Poppler::TextBox *> textList;
     double pageWidth, pageHeight;
-    userMutex()->lock();
-    Poppler::Page *pp = pdfdoc->page(page->number());
+    Poppler::Document *textDoc = takeRenderDocument(page->number());
+    if (!textDoc)
+        userMutex()->lock();
+    Poppler::Page *pp = (textDoc ? textDoc : pdfdoc)->page(page->number());
     if (pp) {
         TextExtractionPayload payload(request);
         textList = pp->textList(Poppler::Page::Rotate0, shouldAbortTextExtractionCallback, QVariant::fromValue(&payload));
@@ -1296,7 +1415,10 @@ Okular::TextPage *PDFGenerator::textPage(Okular::TextRequest *request)
         pageHeight = defaultPageHeight;
     }
     delete pp;
-    userMutex()->unlock();
+    if (textDoc)
+        giveBackRenderDocument(textDoc);
+    else
+        userMutex()->unlock();
 
     if (textList.isEmpty() && request->shouldAbortExtraction())
         return nullptr;
@@ -1530,6 +1652,11 @@ QVariant PDFGenerator::metaData(const QString &key, const QVariant &option) cons
 #else
         return QStringLiteral("yes");
 #endif
+    } else if (key == QLatin1String("RenderHints")) {
+        // everything besides the core settings that changes how the pages look,
+        // answering it also lets the document keep the rendered pages on disk
+        QMutexLocker ml(userMutex());
+        return QString::number(int(pdfdoc->renderHints()));
     } else if (key == QLatin1String("DocumentHasPassword")) {
         return pdfdoc->isEncrypted() ? QStringLiteral("yes") : QStringLiteral("no");
     } else if (key == QLatin1String("CanSignDocumentWithPassword")) {
@@ -1561,6 +1688,13 @@ bool PDFGenerator::reparseConfig()
     }
     bool aaChanged = setDocumentRenderHints();
     somethingchanged = somethingchanged || aaChanged;
+
+    // the render documents pick these up next time they are used
+    renderDocumentsMutex.lock();
+    renderPaperColor = pdfdoc->paperColor();
+    renderHints = pdfdoc->renderHints();
+    renderDocumentsMutex.unlock();
+
     return somethingchanged;
 }
 
@@ -1604,6 +1738,93 @@ bool PDFGenerator::setDocumentRenderHints()
     return changed;
 }
 
+Poppler::Document *PDFGenerator::takeRenderDocument(int page)
+{
+    QMutexLocker locker(&renderDocumentsMutex);
+    if (!renderDocumentsUsable || pagesNeedingMainDocument.testBit(page))
+        return nullptr;
+
+    Poppler::Document *doc = nullptr;
+    if (!idleRenderDocuments.isEmpty()) {
+        doc = idleRenderDocuments.takeLast();
+    } else if (renderDocuments.count() >= maxRenderDocuments) {
+        // all the copies are busy, render from pdfdoc
+        return nullptr;
+    } else {
+        // load a new copy without blocking the other threads
+        locker.unlock();
+        if (!documentData.isEmpty()) {
+            doc = Poppler::Document::loadFromData(documentData, nullptr, nullptr);
+        } else if (QFileInfo(documentFilePath).lastModified() == documentFileModified) {
+            doc = Poppler::Document::load(documentFilePath, nullptr, nullptr);
+        }
+        if (doc && !unlockDocument(doc, documentPassword)) {
+            delete doc;
+            doc = nullptr;
+        }
+        locker.relock();
+
+        if (!doc) {
+            // the file changed or went away, stick to pdfdoc from now on
+            qCDebug(OkularPdfDebug) << "Could not load a render document, rendering from the main one";
+            renderDocumentsUsable = false;
+            return nullptr;
+        }
+        if (renderDocuments.count() >= maxRenderDocuments) {
+            // other threads loaded the last copies meanwhile
+            delete doc;
+            return nullptr;
+        }
+        renderDocuments.append(doc);
+    }
+
+    if (doc->paperColor() != renderPaperColor)
+        doc->setPaperColor(renderPaperColor);
+
+    if (doc->renderHints() != renderHints) {
+        static const Poppler::Document::RenderHint allHints[] = {Poppler::Document::Antialiasing,
+                                                                 Poppler::Document::TextAntialiasing,
+                                                                 Poppler::Document::TextHinting,
+                                                                 Poppler::Document::TextSlightHinting,
+                                                                 Poppler::Document::OverprintPreview,
+                                                                 Poppler::Document::ThinLineSolid,
+                                                                 Poppler::Document::ThinLineShape,
+                                                                 Poppler::Document::IgnorePaperColor,
+                                                                 Poppler::Document::HideAnnotations};
+        for (Poppler::Document::RenderHint hint : allHints)
+            doc->setRenderHint(hint, renderHints.testFlag(hint));
+    }
+
+    return doc;
+}
+
+void PDFGenerator::giveBackRenderDocument(Poppler::Document *doc)
+{
+    QMutexLocker locker(&renderDocumentsMutex);
+    if (renderDocuments.contains(doc))
+        idleRenderDocuments.append(doc);
+    else
+        delete doc; // deleteRenderDocuments() was called while it was in use
+}
+
+void PDFGenerator::setPageNeedsMainDocument(int page)
+{
+    QMutexLocker locker(&renderDocumentsMutex);
+    if (page >= 0 && page < pagesNeedingMainDocument.size())
+        pagesNeedingMainDocument.setBit(page);
+}
+
+void PDFGenerator::deleteRenderDocuments()
+{
+    // the documents still in use by a text extraction are deleted when given back
+    QMutexLocker locker(&renderDocumentsMutex);
+    qDeleteAll(idleRenderDocuments);
+    renderDocuments.clear();
+    idleRenderDocuments.clear();
+    pagesNeedingMainDocument.clear();
+    renderDocumentsUsable = false;
+}
+
 Okular::ExportFormat::List PDFGenerator::exportFormats() const
 {
     static Okular::ExportFormat::List formats;
@@ -1723,8 +1944,10 @@ void PDFGenerator::addSynopsisChildren(const QVector<Poppler::OutlineItem> &outl
     }
 }
 
-void PDFGenerator::addAnnotations(Poppler::Page *popplerPage, Okular::Page *page)
+QList<Okular::Annotation *> PDFGenerator::getAnnotations(Poppler::Page *popplerPage)
 {
+    QList<Okular::Annotation *> annotations;
+
     QSet<Poppler::Annotation::SubType> subtypes;
     subtypes << Poppler::Annotation::AFileAttachment << Poppler::Annotation::ASound << Poppler::Annotation::AMovie << Poppler::Annotation::AWidget << Poppler::Annotation::AScreen << Poppler::Annotation::AText << Poppler::Annotation::ALine
              << Poppler::Annotation::AGeom << Poppler::Annotation::AHighlight << Poppler::Annotation::AInk << Poppler::Annotation::AStamp << Poppler::Annotation::ACaret;
@@ -1735,7 +1958,7 @@ void PDFGenerator::addAnnotations(Poppler::Page *popplerPage, Okular::Page *page
         bool doDelete = true;
         Okular::Annotation *newann = createAnnotationFromPopplerAnnotation(a, *popplerPage, &doDelete);
         if (newann) {
-            page->addAnnotation(newann);
+            annotations.append(newann);
 
             if (a->subType() == Poppler::Annotation::AScreen) {
                 Poppler::ScreenAnnotation *annotScreen = static_cast<Poppler::ScreenAnnotation *>(a);
@@ -1776,6 +1999,72 @@ void PDFGenerator::addAnnotations(Poppler::Page *popplerPage, Okular::Page *page
         if (doDelete)
             delete a;
     }
+
+    return annotations;
+}
+
+QList<Okular::Annotation *> PDFGenerator::loadPageAnnotationsLocked(int page)
+{
+    if (annotationsLoaded.testBit(page))
+        return {};
+    annotationsLoaded.setBit(page);
+
+    std::unique_ptr<Poppler::Page> popplerPage(pdfdoc->page(page));
+    if (!popplerPage)
+        return {};
+
+    return getAnnotations(popplerPage.get());
+}
+
+bool PDFGenerator::loadPageAnnotations(int page, bool wait)
+{
+    if (page < 0 || page >= annotationsLoaded.count() || annotationsLoaded.testBit(page))
+        return true;
+
+    if (wait)
+        userMutex()->lock();
+    else if (!userMutex()->tryLock())
+        return false;
+    const QList<Okular::Annotation *> annotations = loadPageAnnotationsLocked(page);
+    userMutex()->unlock();
+
+    if (!annotations.isEmpty())
+        addPageAnnotations(page, annotations);
+    return true;
+}
+
+void PDFGenerator::loadMoreAnnotations()
+{
+    // pdfdoc is busy rendering, try again on the next timeout instead of blocking the ui
+    if (!userMutex()->tryLock())
+        return;
+
+    QVector<QPair<int, QList<Okular::Annotation *>>> loadedAnnotations;
+    QElapsedTimer elapsed;
+    elapsed.start();
+    const int count = annotationsLoaded.count();
+    // the pages that are being shown go first
+    for (const int page : qAsConst(wantedAnnotationsPages)) {
+        if (page >= count)
+            continue;
+        const QList<Okular::Annotation *> annotations = loadPageAnnotationsLocked(page);
+        if (!annotations.isEmpty())
+            loadedAnnotations.append(qMakePair(page, annotations));
+    }
+    wantedAnnotationsPages.clear();
+    while (nextAnnotationsPage < count && !elapsed.hasExpired(10)) {
+        const QList<Okular::Annotation *> annotations = loadPageAnnotationsLocked(nextAnnotationsPage);
+        if (!annotations.isEmpty())
+            loadedAnnotations.append(qMakePair(nextAnnotationsPage, annotations));
+        ++nextAnnotationsPage;
+    }
+    userMutex()->unlock();
+
+    for (const auto &pageAnnotations : qAsConst(loadedAnnotations))
+        addPageAnnotations(pageAnnotations.first, pageAnnotations.second);
+
+    if (nextAnnotationsPage >= count)
+        annotationsLoadTimer->stop();
 }
 
 void PDFGenerator::addTransition(Poppler::Page *pdfPage, Okular::Page *page)
@@ -17,7 +17,10 @@
 #include <poppler-qt5.h>
 
 #include <QBitArray>
+#include <QDateTime>
+#include <QMutex>
 #include <QPointer>
+#include <QVector>
 
 #include <core/annotations.h>
 #include <core/document.h>
@@ -31,6 +34,7 @@
 
 class PDFOptionsPage;
 class PopplerAnnotationProxy;
+class QTimer;
 
 /**
  * @short A generator that builds contents from a PDF document.
@@ -77,6 +81,7 @@ public:
     bool isAllowed(Okular::Permission permission) const override;
 
     // [INHERITED] perform actions on document / pages
+    void generatePixmap(Okular::PixmapRequest *request) override;
     QImage image(Okular::PixmapRequest *request) override;
 
     // [INHERITED] print page using an already configured kprinter
@@ -122,8 +127,17 @@ private:
 
     // create the document synopsis hierarchy
     void addSynopsisChildren(const QVector<Poppler::OutlineItem> &outlineItems, QDomNode *parentDestination);
-    // fetch annotations from the pdf file and add they to the page
-    void addAnnotations(Poppler::Page *popplerPage, Okular::Page *page);
+    // fetch annotations from the pdf file
+    QList<Okular::Annotation *> getAnnotations(Poppler::Page *popplerPage);
+    // fetch the annotations of the given page if that wasn't done yet, userMutex() must be locked
+    QList<Okular::Annotation *> loadPageAnnotationsLocked(int page);
+    // fetch the annotations of the given page if that wasn't done yet and add them to the document,
+    // without wait returns false instead if userMutex() is locked by a rendering
+    bool loadPageAnnotations(int page, bool wait);
+    // fetch the annotations of some of the pages that weren't shown yet, called from annotationsLoadTimer
+    void loadMoreAnnotations();
+    // fetch the links of the given page if that wasn't done yet, userMutex() must be locked
+    void loadPageLinksLocked(Okular::Page *page);
     // fetch the transition information and add it to the page
     void addTransition(Poppler::Page *pdfPage, Okular::Page *page);
     // fetch the poppler page form fields
@@ -136,9 +150,33 @@ private:
 
     bool setDocumentRenderHints();
 
+    // get a private copy of the document to render or extract text from the
+    // given page without locking userMutex(), or nullptr if pdfdoc must be used
+    Poppler::Document *takeRenderDocument(int page);
+    void giveBackRenderDocument(Poppler::Document *doc);
+    void setPageNeedsMainDocument(int page);
+    void deleteRenderDocuments();
+
     // poppler dependent stuff
     Poppler::Document *pdfdoc;
 
+    // where pdfdoc was loaded from, used to load the render documents
+    QString documentFilePath;
+    QDateTime documentFileModified;
+    QByteArray documentData;
+    QString documentPassword;
+
+    // a few independently loaded copies of pdfdoc so that several pages can be
+    // rendered at the same time, all of them protected by renderDocumentsMutex
+    QMutex renderDocumentsMutex;
+    QVector<Poppler::Document *> renderDocuments;
+    QVector<Poppler::Document *> idleRenderDocuments;
+    QColor renderPaperColor;
+    Poppler::Document::RenderHints renderHints;
+    bool renderDocumentsUsable;
+    // pages whose annotations or forms live only in pdfdoc
+    QBitArray pagesNeedingMainDocument;
+
     void xrefReconstructionHandler();
 
     // misc variables for document info and synopsis caching
@@ -156,6 +194,14 @@ private:
 
     QBitArray rectsGenerated;
 
+    // annotations are only fetched from pdfdoc the first time a page is shown
+    // or while the application is idle, these are the pages already done
+    QBitArray annotationsLoaded;
+    int nextAnnotationsPage;
+    // pages being shown whose annotations couldn't be fetched right away
+    QVector<int> wantedAnnotationsPages;
+    QTimer *annotationsLoadTimer;
+
     QPointer<PDFOptionsPage> pdfOptionsPage;
 };
 
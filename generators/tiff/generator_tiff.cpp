@@ -27,6 +27,14 @@
 #include <tiff.h>
 #include <tiffio.h>
 
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #define TiffDebug 4714
 
 tsize_t okular_tiffReadProc(thandle_t handle, tdata_t buf, tsize_t size)
@@ -89,9 +97,24 @@ public:
     {
     }
 
+    // a reduced resolution version of a page, in the main directory
+    // chain (subIfdOffset is 0) or in a SubIFD of the page
+    struct ReducedImage {
+        uint32_t width;
+        uint32_t height;
+        tdir_t directory;
+        toff_t subIfdOffset;
+    };
+
+    bool setDirectory(const ReducedImage &reducedImage)
+    {
+        return reducedImage.subIfdOffset ? TIFFSetSubDirectory(tiff, reducedImage.subIfdOffset) : TIFFSetDirectory(tiff, reducedImage.directory);
+    }
+
     TIFF *tiff;
     QByteArray data;
     QIODevice *dev;
+    QHash<int, QVector<ReducedImage>> reducedImages;
 };
 
 static QDateTime convertTIFFDateTime(const char *tiffdate)
@@ -152,6 +175,236 @@ static Okular::Rotation readTiffRotation(TIFF *tiff)
     return ret;
 }
 
+// an image read by ReadRGBAImage is ABGR, we need ARGB, so swap red and blue
+static void convertABGRToARGB(const uint32_t *src, uint32_t *dest, size_t size)
+{
+    size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i alphaGreen = _mm_set1_epi32(0xFF00FF00);
+    const __m128i redBlue = _mm_set1_epi32(0x00FF00FF);
+    for (; i + 4 <= size; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i rb = _mm_and_si128(pixels, redBlue);
+        const __m128i br = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + i), _mm_or_si128(_mm_and_si128(pixels, alphaGreen), br));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint32x4_t alphaGreen = vdupq_n_u32(0xFF00FF00);
+    const uint32x4_t redBlue = vdupq_n_u32(0x00FF00FF);
+    for (; i + 4 <= size; i += 4) {
+        const uint32x4_t pixels = vld1q_u32(src + i);
+        const uint32x4_t br = vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(vandq_u32(pixels, redBlue))));
+        vst1q_u32(dest + i, vorrq_u32(vandq_u32(pixels, alphaGreen), br));
+    }
+#endif
+    for (; i < size; ++i) {
+        uint32_t red = (src[i] & 0x00FF0000) >> 16;
+        uint32_t blue = (src[i] & 0x000000FF) << 16;
+        dest[i] = (src[i] & 0xFF00FF00) + red + blue;
+    }
+}
+
+static QImage readImage(TIFF *tiff, uint32_t width, uint32_t height, uint32_t orientation)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+    uint32_t *data = reinterpret_cast<uint32_t *>(image.bits());
+
+    if (image.isNull() || TIFFReadRGBAImageOriented(tiff, width, height, data, orientation) == 0)
+        return QImage();
+
+    convertABGRToARGB(data, data, size_t(width) * height);
+    return image;
+}
+
+/**
+ * Builds an image of the target size from the rows of a decoded region,
+ * given top to bottom as read by the TIFFReadRGBA functions.
+ *
+ * When scaling down, every row is averaged into its target row as soon as it
+ * is added (a box filter), so only the target image and one row of sums are
+ * kept instead of the whole region. Otherwise the region is kept and scaled
+ * at the end.
+ */
+class RegionScaler
+{
+public:
+    RegionScaler(const QSize &regionSize, const QSize &targetSize)
+        : m_regionSize(regionSize)
+        , m_targetSize(targetSize)
+        , m_downscale(targetSize != regionSize && targetSize.width() <= regionSize.width() && targetSize.height() <= regionSize.height())
+        , m_image(m_downscale ? targetSize : regionSize, QImage::Format_RGB32)
+        , m_row(0)
+        , m_targetRow(0)
+        , m_rowsInTargetRow(0)
+    {
+        if (m_downscale && !m_image.isNull()) {
+            m_columns.resize(regionSize.width());
+            m_columnWidths.fill(0, targetSize.width());
+            for (int x = 0; x < regionSize.width(); ++x) {
+                m_columns[x] = qint64(x) * targetSize.width() / regionSize.width();
+                ++m_columnWidths[m_columns[x]];
+            }
+            m_sums.fill(0, targetSize.width() * 3);
+        }
+    }
+
+    bool isNull() const
+    {
+        return m_image.isNull();
+    }
+
+    void addRow(const uint32_t *abgr)
+    {
+        Q_ASSERT(m_row < m_regionSize.height());
+        if (!m_downscale) {
+            convertABGRToARGB(abgr, reinterpret_cast<uint32_t *>(m_image.scanLine(m_row++)), m_regionSize.width());
+            return;
+        }
+
+        const int targetRow = qint64(m_row++) * m_targetSize.height() / m_regionSize.height();
+        if (targetRow != m_targetRow) {
+            flushRow();
+            m_targetRow = targetRow;
+        }
+
+        // no need to swap the channels, they are summed separately anyway
+        for (int x = 0; x < m_regionSize.width(); ++x) {
+            quint64 *sum = m_sums.data() + 3 * m_columns[x];
+            sum[0] += TIFFGetR(abgr[x]);
+            sum[1] += TIFFGetG(abgr[x]);
+            sum[2] += TIFFGetB(abgr[x]);
+        }
+        ++m_rowsInTargetRow;
+    }
+
+    QImage result()
+    {
+        if (m_downscale) {
+            flushRow();
+            return m_image;
+        }
+
+        return m_image.size() == m_targetSize ? m_image : m_image.scaled(m_targetSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+private:
+    void flushRow()
+    {
+        if (m_rowsInTargetRow == 0)
+            return;
+
+        QRgb *dest = reinterpret_cast<QRgb *>(m_image.scanLine(m_targetRow));
+        for (int x = 0; x < m_targetSize.width(); ++x) {
+            quint64 *sum = m_sums.data() + 3 * x;
+            const quint64 count = quint64(m_columnWidths[x]) * m_rowsInTargetRow;
+            dest[x] = qRgb((sum[0] + count / 2) / count, (sum[1] + count / 2) / count, (sum[2] + count / 2) / count);
+            sum[0] = sum[1] = sum[2] = 0;
+        }
+        m_rowsInTargetRow = 0;
+    }
+
+    const QSize m_regionSize;
+    const QSize m_targetSize;
+    const bool m_downscale;
+    QImage m_image;
+    int m_row;
+    int m_targetRow;
+    int m_rowsInTargetRow;
+    // the target column of every column of the region, and how many go in each
+    QVector<int> m_columns;
+    QVector<int> m_columnWidths;
+    // the red, green and blue sums of the current target row
+    QVector<quint64> m_sums;
+};
+
+// Only decodes the tiles intersecting rect, one row of tiles at a time. The rows of the tiles are stored bottom up.
+static QImage readTiles(TIFF *tiff, const QRect &rect, const QSize &targetSize)
+{
+    uint32_t tileWidth = 0;
+    uint32_t tileHeight = 0;
+    if (!TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tileWidth) || !TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tileHeight) || tileWidth == 0 || tileHeight == 0)
+        return QImage();
+    if (quint64(tileWidth) * tileHeight > quint64(std::numeric_limits<int>::max()) || quint64(rect.width()) * tileHeight > quint64(std::numeric_limits<int>::max()))
+        return QImage();
+
+    RegionScaler scaler(rect.size(), targetSize);
+    if (scaler.isNull())
+        return QImage();
+
+    QVector<uint32_t> raster(tileWidth * tileHeight);
+    QVector<uint32_t> tileRow(rect.width() * tileHeight);
+    for (uint32_t tileY = rect.top() / tileHeight * tileHeight; tileY <= uint32_t(rect.bottom()); tileY += tileHeight) {
+        const int firstRow = qMax<int>(tileY, rect.top());
+        const int lastRow = qMin<int>(tileY + tileHeight - 1, rect.bottom());
+
+        for (uint32_t tileX = rect.left() / tileWidth * tileWidth; tileX <= uint32_t(rect.right()); tileX += tileWidth) {
+            if (TIFFReadRGBATile(tiff, tileX, tileY, raster.data()) == 0)
+                return QImage();
+
+            const QRect tileRect = QRect(tileX, tileY, tileWidth, tileHeight) & rect;
+            for (int y = tileRect.top(); y <= tileRect.bottom(); ++y) {
+                const uint32_t *src = raster.constData() + (tileHeight - 1 - (y - tileY)) * tileWidth + (tileRect.left() - tileX);
+                uint32_t *dest = tileRow.data() + (y - firstRow) * rect.width() + (tileRect.left() - rect.left());
+                memcpy(dest, src, tileRect.width() * sizeof(uint32_t));
+            }
+        }
+
+        for (int y = firstRow; y <= lastRow; ++y)
+            scaler.addRow(tileRow.constData() + (y - firstRow) * rect.width());
+    }
+
+    return scaler.result();
+}
+
+// Only decodes the strips intersecting rect, one at a time. The rows of the strips are stored bottom up.
+static QImage readStrips(TIFF *tiff, uint32_t width, uint32_t height, const QRect &rect, const QSize &targetSize)
+{
+    uint32_t rowsPerStrip = 0;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+    rowsPerStrip = qBound<uint32_t>(1, rowsPerStrip, height);
+    if (quint64(width) * rowsPerStrip > quint64(std::numeric_limits<int>::max()))
+        return QImage();
+
+    RegionScaler scaler(rect.size(), targetSize);
+    if (scaler.isNull())
+        return QImage();
+
+    QVector<uint32_t> raster(width * rowsPerStrip);
+    for (uint32_t stripY = rect.top() / rowsPerStrip * rowsPerStrip; stripY <= uint32_t(rect.bottom()); stripY += rowsPerStrip) {
+        if (TIFFReadRGBAStrip(tiff, stripY, raster.data()) == 0)
+            return QImage();
+
+        const uint32_t stripRows = qMin(rowsPerStrip, height - stripY);
+        const int firstRow = qMax<int>(stripY, rect.top());
+        const int lastRow = qMin<int>(stripY + stripRows - 1, rect.bottom());
+        for (int y = firstRow; y <= lastRow; ++y)
+            scaler.addRow(raster.constData() + (stripRows - 1 - (y - stripY)) * width + rect.left());
+    }
+
+    return scaler.result();
+}
+
+/**
+ * Reads the @p rect part of the current directory of @p tiff, scaled to
+ * @p targetSize. Only the strips or tiles it intersects are decoded, and
+ * they are scaled down as they are decoded, so the whole region is never in
+ * memory at once. That's unless the directory is not stored top to bottom:
+ * the strip and tile functions of libtiff flip the rows of those and don't
+ * report how, so they are decoded whole.
+ */
+static QImage readScaledRegion(TIFF *tiff, uint32_t width, uint32_t height, uint32_t orientation, const QRect &rect, const QSize &targetSize)
+{
+    if (orientation == ORIENTATION_TOPLEFT)
+        return TIFFIsTiled(tiff) ? readTiles(tiff, rect, targetSize) : readStrips(tiff, width, height, rect, targetSize);
+
+    QImage image = readImage(tiff, width, height, orientation);
+    if (image.isNull())
+        return image;
+    if (rect != image.rect())
+        image = image.copy(rect);
+    return image.size() == targetSize ? image : image.scaled(targetSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
 OKULAR_EXPORT_PLUGIN(TIFFGenerator, "libokularGenerator_tiff.json")
 
 TIFFGenerator::TIFFGenerator(QObject *parent, const QVariantList &args)
@@ -159,6 +412,7 @@ TIFFGenerator::TIFFGenerator(QObject *parent, const QVariantList &args)
     , d(new Private)
 {
     setFeature(Threaded);
+    setFeature(TiledRendering);
     setFeature(PrintNative);
     setFeature(PrintToFile);
     setFeature(ReadRawData);
@@ -216,6 +470,7 @@ bool TIFFGenerator::doCloseDocument()
         delete d->dev;
         d->dev = nullptr;
         d->data.clear();
+        d->reducedImages.clear();
         m_pageMapping.clear();
     }
 
@@ -224,45 +479,57 @@ bool TIFFGenerator::doCloseDocument()
 
 QImage TIFFGenerator::image(Okular::PixmapRequest *request)
 {
-    bool generated = false;
     QImage img;
 
-    if (TIFFSetDirectory(d->tiff, mapPage(request->page()->number()))) {
-        int rotation = request->page()->rotation();
+    QSize targetSize;
+    if (request->isTile()) {
+        targetSize = request->normalizedRect().geometry(request->width(), request->height()).size();
+    } else {
+        targetSize = QSize(request->width(), request->height());
+        if (request->page()->rotation() % 2 == 1)
+            targetSize.transpose();
+    }
+
+    const int pageNumber = request->page()->number();
+    if (TIFFSetDirectory(d->tiff, mapPage(pageNumber))) {
         uint32_t width = 1;
         uint32_t height = 1;
         uint32_t orientation = 0;
         TIFFGetField(d->tiff, TIFFTAG_IMAGEWIDTH, &width);
         TIFFGetField(d->tiff, TIFFTAG_IMAGELENGTH, &height);
 
-        if (!TIFFGetField(d->tiff, TIFFTAG_ORIENTATION, &orientation))
-            orientation = ORIENTATION_TOPLEFT;
+        QRect rect(0, 0, width, height);
+        if (request->isTile())
+            rect &= request->normalizedRect().geometry(width, height);
 
-        QImage image(width, height, QImage::Format_RGB32);
-        uint32_t *data = reinterpret_cast<uint32_t *>(image.bits());
-
-        // read data
-        if (TIFFReadRGBAImageOriented(d->tiff, width, height, data, orientation) != 0) {
-            // an image read by ReadRGBAImage is ABGR, we need ARGB, so swap red and blue
-            uint32_t size = width * height;
-            for (uint32_t i = 0; i < size; ++i) {
-                uint32_t red = (data[i] & 0x00FF0000) >> 16;
-                uint32_t blue = (data[i] & 0x000000FF) << 16;
-                data[i] = (data[i] & 0xFF00FF00) + red + blue;
+        // read the smallest reduced resolution image that still has enough pixels, if any
+        const QVector<Private::ReducedImage> reducedImages = d->reducedImages.value(pageNumber);
+        const Private::ReducedImage *reducedImage = nullptr;
+        for (const Private::ReducedImage &candidate : reducedImages) {
+            if (quint64(candidate.width) * rect.width() >= quint64(targetSize.width()) * width && quint64(candidate.height) * rect.height() >= quint64(targetSize.height()) * height && (!reducedImage || candidate.width < reducedImage->width))
+                reducedImage = &candidate;
+        }
+        if (reducedImage) {
+            if (d->setDirectory(*reducedImage)) {
+                const double xScale = double(reducedImage->width) / width;
+                const double yScale = double(reducedImage->height) / height;
+                width = reducedImage->width;
+                height = reducedImage->height;
+                rect = QRectF(rect.x() * xScale, rect.y() * yScale, rect.width() * xScale, rect.height() * yScale).toAlignedRect() & QRect(0, 0, width, height);
+            } else {
+                TIFFSetDirectory(d->tiff, mapPage(pageNumber));
             }
+        }
 
-            int reqwidth = request->width();
-            int reqheight = request->height();
-            if (rotation % 2 == 1)
-                qSwap(reqwidth, reqheight);
-            img = image.scaled(reqwidth, reqheight, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        if (!TIFFGetField(d->tiff, TIFFTAG_ORIENTATION, &orientation))
+            orientation = ORIENTATION_TOPLEFT;
 
-            generated = true;
-        }
+        if (!rect.isEmpty())
+            img = readScaledRegion(d->tiff, width, height, orientation, rect, targetSize);
     }
 
-    if (!generated) {
-        img = QImage(request->width(), request->height(), QImage::Format_RGB32);
+    if (img.isNull()) {
+        img = QImage(targetSize, QImage::Format_RGB32);
         img.fill(qRgb(255, 255, 255));
     }
 
@@ -331,6 +598,23 @@ void TIFFGenerator::loadPages(QVector<Okular::Page *> &pagesVector)
         if (TIFFGetField(d->tiff, TIFFTAG_IMAGEWIDTH, &width) != 1 || TIFFGetField(d->tiff, TIFFTAG_IMAGELENGTH, &height) != 1)
             continue;
 
+        // reduced resolution versions of the previous page are not pages themselves
+        uint32_t subfileType = 0;
+        TIFFGetFieldDefaulted(d->tiff, TIFFTAG_SUBFILETYPE, &subfileType);
+        if ((subfileType & FILETYPE_REDUCEDIMAGE) && realdirs > 0) {
+            d->reducedImages[realdirs - 1].append({width, height, i, 0});
+            continue;
+        }
+
+        // and so are the ones in its SubIFDs
+        uint16_t subIfdCount = 0;
+        toff_t *subIfdOffsets = nullptr;
+        QVector<toff_t> subIfds;
+        if (TIFFGetField(d->tiff, TIFFTAG_SUBIFD, &subIfdCount, &subIfdOffsets) && subIfdOffsets) {
+            for (uint16_t j = 0; j < subIfdCount; ++j)
+                subIfds.append(subIfdOffsets[j]);
+        }
+
         adaptSizeToResolution(d->tiff, TIFFTAG_XRESOLUTION, dpi.width(), &width);
         adaptSizeToResolution(d->tiff, TIFFTAG_YRESOLUTION, dpi.height(), &height);
 
@@ -339,6 +623,15 @@ void TIFFGenerator::loadPages(QVector<Okular::Page *> &pagesVector)
 
         m_pageMapping[realdirs] = i;
 
+        for (toff_t subIfd : qAsConst(subIfds)) {
+            uint32_t subIfdWidth = 0;
+            uint32_t subIfdHeight = 0;
+            uint32_t subIfdType = 0;
+            if (TIFFSetSubDirectory(d->tiff, subIfd) && TIFFGetField(d->tiff, TIFFTAG_IMAGEWIDTH, &subIfdWidth) == 1 && TIFFGetField(d->tiff, TIFFTAG_IMAGELENGTH, &subIfdHeight) == 1 &&
+                TIFFGetFieldDefaulted(d->tiff, TIFFTAG_SUBFILETYPE, &subIfdType) && (subIfdType & FILETYPE_REDUCEDIMAGE))
+                d->reducedImages[realdirs].append({subIfdWidth, subIfdHeight, i, subIfd});
+        }
+
         ++realdirs;
     }
 
@@ -361,19 +654,7 @@ Okular::Document::PrintError TIFFGenerator::print(QPrinter &printer)
         if (TIFFGetField(d->tiff, TIFFTAG_IMAGEWIDTH, &width) != 1 || TIFFGetField(d->tiff, TIFFTAG_IMAGELENGTH, &height) != 1)
             continue;
 
-        QImage image(width, height, QImage::Format_RGB32);
-        uint32_t *data = reinterpret_cast<uint32_t *>(image.bits());
-
-        // read data
-        if (TIFFReadRGBAImageOriented(d->tiff, width, height, data, ORIENTATION_TOPLEFT) != 0) {
-            // an image read by ReadRGBAImage is ABGR, we need ARGB, so swap red and blue
-            uint32_t size = width * height;
-            for (uint32_t j = 0; j < size; ++j) {
-                uint32_t red = (data[j] & 0x00FF0000) >> 16;
-                uint32_t blue = (data[j] & 0x000000FF) << 16;
-                data[j] = (data[j] & 0xFF00FF00) + red + blue;
-            }
-        }
+        const QImage image = readImage(d->tiff, width, height, ORIENTATION_TOPLEFT);
 
         if (i != 0)
             printer.newPage();
@@ -675,7 +675,6 @@ static QString unicodeString(const QString &raw)
 XpsHandler::XpsHandler(XpsPage *page)
     : m_page(page)
 {
-    m_painter = nullptr;
 }
 
 XpsHandler::~XpsHandler()
@@ -689,6 +688,7 @@ bool XpsHandler::startDocument()
     XpsRenderNode node;
     node.name = QStringLiteral("document");
     m_nodes.push(node);
+    m_states.push(XpsRenderState());
 
     return true;
 }
@@ -728,61 +728,57 @@ void XpsHandler::processGlyph(XpsRenderNode &node)
     // TODO Currently ignored attributes: CaretStops, DeviceFontName, IsSideways, OpacityMask, Name, FixedPage.NavigateURI, xml:lang, x:key
     // TODO Indices is only partially implemented
     // TODO Currently ignored child elements: Clip, OpacityMask
-    // Handled separately: RenderTransform
 
     QString att;
 
-    m_painter->save();
+    // the glyphs are recorded even if they are not drawn, for their text
+    XpsDisplayItem item(XpsDisplayItem::Glyphs);
+    item.transform = m_states.top().transform;
+    item.opacity = m_states.top().opacity;
 
     // Get font (doesn't work well because qt doesn't allow to load font from file)
     // This works despite the fact that font size isn't specified in points as required by qt. It's because I set point size to be equal to drawing unit.
-    float fontSize = node.attributes.value(QStringLiteral("FontRenderingEmSize")).toFloat();
+    item.fontSize = node.attributes.value(QStringLiteral("FontRenderingEmSize")).toFloat();
     // qCWarning(OkularXpsDebug) << "Font Rendering EmSize:" << fontSize;
     // a value of 0.0 means the text is not visible (see XPS specs, chapter 12, "Glyphs")
-    if (fontSize < 0.1) {
-        m_painter->restore();
-        return;
+    if (item.fontSize < 0.1) {
+        item.visible = false;
     }
-    const QString absoluteFileName = absolutePath(entryPath(m_page->fileName()), node.attributes.value(QStringLiteral("FontUri")));
-    QFont font = m_page->m_file->getFontByName(absoluteFileName, fontSize);
+    item.fontFileName = absolutePath(entryPath(m_page->fileName()), node.attributes.value(QStringLiteral("FontUri")));
+    item.font = m_page->m_file->getFontByName(item.fontFileName, item.fontSize);
     att = node.attributes.value(QStringLiteral("StyleSimulations"));
     if (!att.isEmpty()) {
         if (att == QLatin1String("ItalicSimulation")) {
-            font.setItalic(true);
+            item.font.setItalic(true);
         } else if (att == QLatin1String("BoldSimulation")) {
-            font.setBold(true);
+            item.font.setBold(true);
         } else if (att == QLatin1String("BoldItalicSimulation")) {
-            font.setItalic(true);
-            font.setBold(true);
+            item.font.setItalic(true);
+            item.font.setBold(true);
         }
     }
-    m_painter->setFont(font);
 
     // Origin
-    QPointF origin(node.attributes.value(QStringLiteral("OriginX")).toDouble(), node.attributes.value(QStringLiteral("OriginY")).toDouble());
+    item.origin = QPointF(node.attributes.value(QStringLiteral("OriginX")).toDouble(), node.attributes.value(QStringLiteral("OriginY")).toDouble());
 
     // Fill
-    QBrush brush;
     att = node.attributes.value(QStringLiteral("Fill"));
     if (att.isEmpty()) {
         QVariant data = node.getChildData(QStringLiteral("Glyphs.Fill"));
         if (data.canConvert<QBrush>()) {
-            brush = data.value<QBrush>();
+            item.brush = data.value<QBrush>();
         } else {
             // no "Fill" attribute and no "Glyphs.Fill" child, so show nothing
             // (see XPS specs, 5.10)
-            m_painter->restore();
-            return;
+            item.visible = false;
         }
     } else {
-        brush = parseRscRefColorForBrush(att);
-        if (brush.style() > Qt::NoBrush && brush.style() < Qt::LinearGradientPattern && brush.color().alpha() == 0) {
-            m_painter->restore();
-            return;
+        item.brush = parseRscRefColorForBrush(att);
+        if (item.brush.style() > Qt::NoBrush && item.brush.style() < Qt::LinearGradientPattern && item.brush.color().alpha() == 0) {
+            item.visible = false;
         }
     }
-    m_painter->setBrush(brush);
-    m_painter->setPen(QPen(brush, 0));
+    item.pen = QPen(item.brush, 0);
 
     // Opacity
     att = node.attributes.value(QStringLiteral("Opacity"));
@@ -790,41 +786,39 @@ void XpsHandler::processGlyph(XpsRenderNode &node)
         bool ok = true;
         double value = att.toDouble(&ok);
         if (ok && value >= 0.1) {
-            m_painter->setOpacity(value);
+            item.opacity = value;
         } else {
-            m_painter->restore();
-            return;
+            item.visible = false;
         }
     }
 
     // RenderTransform
+    QVariant data = node.getChildData(QStringLiteral("Glyphs.RenderTransform"));
+    if (data.canConvert<QTransform>()) {
+        item.transform = data.value<QTransform>() * item.transform;
+    }
     att = node.attributes.value(QStringLiteral("RenderTransform"));
     if (!att.isEmpty()) {
-        m_painter->setWorldTransform(parseRscRefMatrix(att), true);
+        item.transform = parseRscRefMatrix(att) * item.transform;
     }
 
     // Clip
     att = node.attributes.value(QStringLiteral("Clip"));
     if (!att.isEmpty()) {
-        QPainterPath clipPath = parseRscRefPath(att);
-        if (!clipPath.isEmpty()) {
-            m_painter->setClipPath(clipPath);
-        }
+        item.clipPath = parseRscRefPath(att);
     }
 
     // BiDiLevel - default Left-to-Right
-    m_painter->setLayoutDirection(Qt::LeftToRight);
     att = node.attributes.value(QStringLiteral("BiDiLevel"));
     if (!att.isEmpty()) {
         if ((att.toInt() % 2) == 1) {
             // odd BiDiLevel, so Right-to-Left
-            m_painter->setLayoutDirection(Qt::RightToLeft);
+            item.layoutDirection = Qt::RightToLeft;
         }
     }
 
     // Indices - partial handling only
     att = node.attributes.value(QStringLiteral("Indices"));
-    QList<qreal> advanceWidths;
     if (!att.isEmpty()) {
         QStringList indicesElements = att.split(QLatin1Char(';'));
         for (int i = 0; i < indicesElements.size(); ++i) {
@@ -832,43 +826,60 @@ void XpsHandler::processGlyph(XpsRenderNode &node)
                 QStringList parts = indicesElements.at(i).split(QLatin1Char(','));
                 if (parts.size() == 2) {
                     // regular advance case, no offsets
-                    advanceWidths.append(parts.at(1).toDouble() * fontSize / 100.0);
+                    item.advanceWidths.append(parts.at(1).toDouble() * item.fontSize / 100.0);
                 } else if (parts.size() == 3) {
                     // regular advance case, with uOffset
-                    qreal AdvanceWidth = parts.at(1).toDouble() * fontSize / 100.0;
+                    qreal AdvanceWidth = parts.at(1).toDouble() * item.fontSize / 100.0;
                     qreal uOffset = parts.at(2).toDouble() / 100.0;
-                    advanceWidths.append(AdvanceWidth + uOffset);
+                    item.advanceWidths.append(AdvanceWidth + uOffset);
                 } else {
                     // has vertical offset, but don't know how to handle that yet
                     qCWarning(OkularXpsDebug) << "Unhandled Indices element: " << indicesElements.at(i);
-                    advanceWidths.append(-1.0);
+                    item.advanceWidths.append(-1.0);
                 }
             } else {
                 // no special advance case
-                advanceWidths.append(-1.0);
+                item.advanceWidths.append(-1.0);
             }
         }
     }
 
     // UnicodeString
-    QString stringToDraw(unicodeString(node.attributes.value(QStringLiteral("UnicodeString"))));
-    QPointF originAdvance(0, 0);
-    QFontMetrics metrics = m_painter->fontMetrics();
-    for (int i = 0; i < stringToDraw.size(); ++i) {
-        QChar thisChar = stringToDraw.at(i);
-        m_painter->drawText(origin + originAdvance, QString(thisChar));
-        const qreal advanceWidth = advanceWidths.value(i, qreal(-1.0));
-        if (advanceWidth > 0.0) {
-            originAdvance.rx() += advanceWidth;
-        } else {
-            originAdvance.rx() += metrics.horizontalAdvance(thisChar);
-        }
-    }
+    item.text = unicodeString(node.attributes.value(QStringLiteral("UnicodeString")));
     // qCWarning(OkularXpsDebug) << "Glyphs: " << atts.value("Fill") << ", " << atts.value("FontUri");
     // qCWarning(OkularXpsDebug) << "    Origin: " << atts.value("OriginX") << "," << atts.value("OriginY");
     // qCWarning(OkularXpsDebug) << "    Unicode: " << atts.value("UnicodeString");
 
-    m_painter->restore();
+    appendItem(item);
+}
+
+/**
+    Takes out the image of an image \p brush, keeping its ImageSource in
+    \p imageSource instead, if it is one.
+*/
+static void takeImage(QBrush *brush, QString *imageSource, const QHash<qint64, QString> &imageSources)
+{
+    if (brush->style() != Qt::TexturePattern) {
+        return;
+    }
+
+    *imageSource = imageSources.value(brush->textureImage().cacheKey());
+    if (!imageSource->isEmpty()) {
+        const QTransform transform = brush->transform();
+        *brush = QBrush();
+        brush->setTransform(transform);
+    }
+}
+
+void XpsHandler::appendItem(XpsDisplayItem &item)
+{
+    // the images are in the cache of the file already, don't keep them twice
+    takeImage(&item.brush, &item.brushImage, m_imageSources);
+    QBrush penBrush = item.pen.brush();
+    takeImage(&penBrush, &item.penImage, m_imageSources);
+    item.pen.setBrush(penBrush);
+
+    m_items.append(item);
 }
 
 void XpsHandler::processFill(XpsRenderNode &node)
@@ -903,7 +914,9 @@ void XpsHandler::processImageBrush(XpsRenderNode &node)
 
     QRectF viewport = stringToRectF(node.attributes.value(QStringLiteral("Viewport")));
     QRectF viewbox = stringToRectF(node.attributes.value(QStringLiteral("Viewbox")));
-    QImage image = m_page->loadImageFromFile(node.attributes.value(QStringLiteral("ImageSource")));
+    const QString imageSource = node.attributes.value(QStringLiteral("ImageSource"));
+    QImage image = m_page->loadImageFromFile(imageSource);
+    m_imageSources.insert(image.cacheKey(), imageSource);
 
     // Matrix which can transform [0, 0, 1, 1] rectangle to given viewbox
     QTransform viewboxMatrix = QTransform(viewbox.width() * image.physicalDpiX() / 96, 0, 0, viewbox.height() * image.physicalDpiY() / 96, viewbox.x(), viewbox.y());
@@ -933,9 +946,7 @@ void XpsHandler::processImageBrush(XpsRenderNode &node)
 void XpsHandler::processPath(XpsRenderNode &node)
 {
     // TODO Ignored attributes: Clip, OpacityMask, StrokeEndLineCap, StorkeStartLineCap, Name, FixedPage.NavigateURI, xml:lang, x:key, AutomationProperties.Name, AutomationProperties.HelpText, SnapsToDevicePixels
-    // TODO Ignored child elements: RenderTransform, Clip, OpacityMask
-    // Handled separately: RenderTransform
-    m_painter->save();
+    // TODO Ignored child elements: Clip, OpacityMask
 
     QString att;
     QVariant data;
@@ -951,10 +962,13 @@ void XpsHandler::processPath(XpsRenderNode &node)
     }
     if (!pathdata) {
         // nothing to draw
-        m_painter->restore();
         return;
     }
 
+    XpsDisplayItem item(XpsDisplayItem::Path);
+    item.transform = m_states.top().transform;
+    item.opacity = m_states.top().opacity;
+
     // Set Fill
     att = node.attributes.value(QStringLiteral("Fill"));
     QBrush brush;
@@ -966,7 +980,6 @@ void XpsHandler::processPath(XpsRenderNode &node)
             brush = data.value<QBrush>();
         }
     }
-    m_painter->setBrush(brush);
 
     // Stroke (pen)
     att = node.attributes.value(QStringLiteral("Stroke"));
@@ -1045,31 +1058,35 @@ void XpsHandler::processPath(XpsRenderNode &node)
             pen.setMiterLimit(limit / 2);
         }
     }
-    m_painter->setPen(pen);
+    item.brush = brush;
+    item.pen = pen;
 
     // Opacity
     att = node.attributes.value(QStringLiteral("Opacity"));
     if (!att.isEmpty()) {
-        m_painter->setOpacity(att.toDouble());
+        item.opacity = att.toDouble();
     }
 
     // RenderTransform
+    data = node.getChildData(QStringLiteral("Path.RenderTransform"));
+    if (data.canConvert<QTransform>()) {
+        item.transform = data.value<QTransform>() * item.transform;
+    }
     att = node.attributes.value(QStringLiteral("RenderTransform"));
     if (!att.isEmpty()) {
-        m_painter->setWorldTransform(parseRscRefMatrix(att), true);
+        item.transform = parseRscRefMatrix(att) * item.transform;
     }
     if (!pathdata->transform.isIdentity()) {
-        m_painter->setWorldTransform(pathdata->transform, true);
+        item.transform = pathdata->transform * item.transform;
     }
 
     for (const XpsPathFigure *figure : qAsConst(pathdata->paths)) {
-        m_painter->setBrush(figure->isFilled ? brush : QBrush());
-        m_painter->drawPath(figure->path);
+        item.figures.append(*figure);
     }
 
     delete pathdata;
 
-    m_painter->restore();
+    appendItem(item);
 }
 
 void XpsHandler::processPathData(XpsRenderNode &node)
@@ -1210,22 +1227,23 @@ void XpsHandler::processPathFigure(XpsRenderNode &node)
 void XpsHandler::processStartElement(XpsRenderNode &node)
 {
     if (node.name == QLatin1String("Canvas")) {
-        m_painter->save();
+        XpsRenderState state = m_states.top();
         QString att = node.attributes.value(QStringLiteral("RenderTransform"));
         if (!att.isEmpty()) {
-            m_painter->setWorldTransform(parseRscRefMatrix(att), true);
+            state.transform = parseRscRefMatrix(att) * state.transform;
         }
         att = node.attributes.value(QStringLiteral("Opacity"));
         if (!att.isEmpty()) {
             double value = att.toDouble();
             if (value > 0.0 && value <= 1.0) {
-                m_painter->setOpacity(m_painter->opacity() * value);
+                state.opacity *= value;
             } else {
                 // setting manually to 0 is necessary to "disable"
                 // all the stuff inside
-                m_painter->setOpacity(0.0);
+                state.opacity = 0.0;
             }
         }
+        m_states.push(state);
     }
 }
 
@@ -1238,13 +1256,16 @@ void XpsHandler::processEndElement(XpsRenderNode &node)
     } else if (node.name == QLatin1String("MatrixTransform")) {
         // TODO Ignoring x:key
         node.data = QVariant::fromValue(QTransform(attsToMatrix(node.attributes.value(QStringLiteral("Matrix")))));
-    } else if ((node.name == QLatin1String("Canvas.RenderTransform")) || (node.name == QLatin1String("Glyphs.RenderTransform")) || (node.name == QLatin1String("Path.RenderTransform"))) {
+    } else if (node.name == QLatin1String("Canvas.RenderTransform")) {
         QVariant data = node.getRequiredChildData(QStringLiteral("MatrixTransform"));
         if (data.canConvert<QTransform>()) {
-            m_painter->setWorldTransform(data.value<QTransform>(), true);
+            m_states.top().transform = data.value<QTransform>() * m_states.top().transform;
         }
+    } else if ((node.name == QLatin1String("Glyphs.RenderTransform")) || (node.name == QLatin1String("Path.RenderTransform"))) {
+        // applied when processing the element
+        node.data = node.getRequiredChildData(QStringLiteral("MatrixTransform"));
     } else if (node.name == QLatin1String("Canvas")) {
-        m_painter->restore();
+        m_states.pop();
     } else if ((node.name == QLatin1String("Path.Fill")) || (node.name == QLatin1String("Glyphs.Fill"))) {
         processFill(node);
     } else if (node.name == QLatin1String("Path.Stroke")) {
@@ -1324,10 +1345,8 @@ void XpsHandler::processEndElement(XpsRenderNode &node)
 XpsPage::XpsPage(XpsFile *file, const QString &fileName)
     : m_file(file)
     , m_fileName(fileName)
-    , m_pageIsRendered(false)
+    , m_displayListIsLoaded(false)
 {
-    m_pageImage = nullptr;
-
     // qCWarning(OkularXpsDebug) << "page file name: " << fileName;
 
     const KZipFileEntry *pageFile = static_cast<const KZipFileEntry *>(m_file->xpsArchive()->directory()->entry(fileName));
@@ -1350,37 +1369,110 @@ XpsPage::XpsPage(XpsFile *file, const QString &fileName)
 
 XpsPage::~XpsPage()
 {
-    delete m_pageImage;
 }
 
-bool XpsPage::renderToImage(QImage *p)
+bool XpsPage::renderToImage(QImage *p, const QSize &pageSize, const QPoint &offset)
 {
-    if ((m_pageImage == nullptr) || (m_pageImage->size() != p->size())) {
-        delete m_pageImage;
-        m_pageImage = new QImage(p->size(), QImage::Format_ARGB32);
-        // Set one point = one drawing unit. Useful for fonts, because xps specifies font size using drawing units, not points as usual
-        m_pageImage->setDotsPerMeterX(2835);
-        m_pageImage->setDotsPerMeterY(2835);
+    // Set one point = one drawing unit. Useful for fonts, because xps specifies font size using drawing units, not points as usual
+    p->setDotsPerMeterX(2835);
+    p->setDotsPerMeterY(2835);
+    p->fill(qRgba(255, 255, 255, 255));
 
-        m_pageIsRendered = false;
-    }
-    if (!m_pageIsRendered) {
-        m_pageImage->fill(qRgba(255, 255, 255, 255));
-        QPainter painter(m_pageImage);
-        renderToPainter(&painter);
-        m_pageIsRendered = true;
-    }
+    QPainter painter(p);
+    painter.translate(-offset);
+    return renderToPainter(&painter, pageSize);
+}
+
+bool XpsPage::renderToPainter(QPainter *painter)
+{
+    return renderToPainter(painter, QSizeF(painter->device()->width(), painter->device()->height()));
+}
+
+bool XpsPage::renderToPainter(QPainter *painter, const QSizeF &pageSize)
+{
+    const QTransform pageTransform = QTransform().scale(pageSize.width() / size().width(), pageSize.height() / size().height()) * painter->worldTransform();
+    const QRectF deviceRect(0, 0, painter->device()->width(), painter->device()->height());
+
+    for (const XpsDisplayItem &item : displayList()) {
+        if (!item.visible) {
+            continue;
+        }
+
+        // skip the paths that are outside of the device, e.g. of a tile
+        if (item.type == XpsDisplayItem::Path) {
+            QRectF bounds;
+            for (const XpsPathFigure &figure : item.figures) {
+                bounds |= figure.path.boundingRect();
+            }
+            const qreal penMargin = item.pen.style() == Qt::NoPen ? 0 : item.pen.widthF() * qMax<qreal>(item.pen.miterLimit(), 1);
+            bounds = (item.transform * pageTransform).mapRect(bounds.adjusted(-penMargin, -penMargin, penMargin, penMargin)).adjusted(-1, -1, 1, 1);
+            if (!bounds.intersects(deviceRect)) {
+                continue;
+            }
+        }
+
+        painter->save();
+        painter->setWorldTransform(item.transform * pageTransform);
+        painter->setOpacity(item.opacity);
+        if (!item.clipPath.isEmpty()) {
+            painter->setClipPath(item.clipPath, Qt::IntersectClip);
+        }
+        const QBrush brush = withImage(item.brush, item.brushImage);
+        QPen pen = item.pen;
+        if (!item.penImage.isEmpty()) {
+            pen.setBrush(withImage(pen.brush(), item.penImage));
+        }
+        painter->setPen(pen);
+
+        if (item.type == XpsDisplayItem::Path) {
+            for (const XpsPathFigure &figure : item.figures) {
+                painter->setBrush(figure.isFilled ? brush : QBrush());
+                painter->drawPath(figure.path);
+            }
+        } else {
+            painter->setFont(item.font);
+            painter->setBrush(brush);
+            painter->setLayoutDirection(item.layoutDirection);
+
+            QPointF originAdvance(0, 0);
+            QFontMetrics metrics = painter->fontMetrics();
+            for (int i = 0; i < item.text.size(); ++i) {
+                QChar thisChar = item.text.at(i);
+                painter->drawText(item.origin + originAdvance, QString(thisChar));
+                const qreal advanceWidth = item.advanceWidths.value(i, qreal(-1.0));
+                if (advanceWidth > 0.0) {
+                    originAdvance.rx() += advanceWidth;
+                } else {
+                    originAdvance.rx() += metrics.horizontalAdvance(thisChar);
+                }
+            }
+        }
 
-    *p = *m_pageImage;
+        painter->restore();
+    }
 
     return true;
 }
 
-bool XpsPage::renderToPainter(QPainter *painter)
+QBrush XpsPage::withImage(const QBrush &brush, const QString &imageSource)
+{
+    if (imageSource.isEmpty()) {
+        return brush;
+    }
+
+    QBrush imageBrush(loadImageFromFile(imageSource));
+    imageBrush.setTransform(brush.transform());
+    return imageBrush;
+}
+
+const QVector<XpsDisplayItem> &XpsPage::displayList()
 {
+    if (m_displayListIsLoaded) {
+        m_file->useDisplayList(this);
+        return m_displayList;
+    }
+
     XpsHandler handler(this);
-    handler.m_painter = painter;
-    handler.m_painter->setWorldTransform(QTransform().scale((qreal)painter->device()->width() / size().width(), (qreal)painter->device()->height() / size().height()));
     QXmlSimpleReader parser;
     parser.setContentHandler(&handler);
     parser.setErrorHandler(&handler);
@@ -1391,7 +1483,18 @@ bool XpsPage::renderToPainter(QPainter *painter)
     bool ok = parser.parse(source);
     qCWarning(OkularXpsDebug) << "Parse result: " << ok;
 
-    return true;
+    m_displayList = handler.m_items;
+    m_displayListIsLoaded = true;
+    m_file->useDisplayList(this);
+
+    return m_displayList;
+}
+
+void XpsPage::releaseDisplayList()
+{
+    m_displayList.clear();
+    m_displayList.squeeze();
+    m_displayListIsLoaded = false;
 }
 
 QSizeF XpsPage::size() const
@@ -1484,8 +1587,51 @@ QImage XpsPage::loadImageFromFile(const QString &fileName)
         return QImage();
     }
 
-    QString absoluteFileName = absolutePath(entryPath(m_fileName), fileName);
-    const KArchiveEntry *imageFile = loadEntry(m_file->xpsArchive(), absoluteFileName, Qt::CaseInsensitive);
+    return m_file->getImageByName(absolutePath(entryPath(m_fileName), fileName));
+}
+
+QImage XpsFile::getImageByName(const QString &absoluteFileName)
+{
+    const QString key = absoluteFileName.toLower();
+    const QImage *cachedImage = m_imageCache.object(key);
+    if (cachedImage) {
+        return *cachedImage;
+    }
+
+    const QImage image = loadImageByName(absoluteFileName);
+    // QCache deletes what doesn't fit
+    m_imageCache.insert(key, new QImage(image), qMax(1, int(image.sizeInBytes() / 1024)));
+    return image;
+}
+
+int XpsFile::cachedImagesCost() const
+{
+    return m_imageCache.totalCost();
+}
+
+void XpsFile::releaseCachedImages(int cost)
+{
+    // QCache drops the least recently used images to fit a smaller cost
+    const int maxCost = m_imageCache.maxCost();
+    m_imageCache.setMaxCost(qMax(0, m_imageCache.totalCost() - cost));
+    m_imageCache.setMaxCost(maxCost);
+}
+
+void XpsFile::useDisplayList(XpsPage *page)
+{
+    // only the display lists of the last used pages are kept
+    static const int maxDisplayLists = 32;
+
+    m_displayListPages.removeOne(page);
+    m_displayListPages.prepend(page);
+    while (m_displayListPages.count() > maxDisplayLists) {
+        m_displayListPages.takeLast()->releaseDisplayList();
+    }
+}
+
+QImage XpsFile::loadImageByName(const QString &absoluteFileName)
+{
+    const KArchiveEntry *imageFile = loadEntry(m_xpsArchive, absoluteFileName, Qt::CaseInsensitive);
     if (!imageFile) {
         // image not found
         return QImage();
@@ -1495,27 +1641,25 @@ QImage XpsPage::loadImageFromFile(const QString &fileName)
         XPS standard requires to use 96dpi for images which doesn't have dpi specified (in file). When Qt loads such an image,
         it sets its dpi to qt_defaultDpi and doesn't allow to find out that it happend.
 
-        To workaround this I used this procedure: load image, set its dpi to 96, load image again. When dpi isn't set in file,
-        dpi set by me stays unchanged.
+        To workaround this the image is read into an image of the same size and format that has its dpi set to 96 already:
+        the image handlers keep it then, unless the file specifies one.
 
         Trolltech task ID: 159527.
 
     */
 
-    QImage image;
     QByteArray data = readFileOrDirectoryParts(imageFile);
 
     QBuffer buffer(&data);
     buffer.open(QBuffer::ReadOnly);
 
     QImageReader reader(&buffer);
-    image = reader.read();
-
-    image.setDotsPerMeterX(qRound(96 / 0.0254));
-    image.setDotsPerMeterY(qRound(96 / 0.0254));
-
-    buffer.seek(0);
-    reader.setDevice(&buffer);
+    QImage image;
+    if (reader.size().isValid() && reader.imageFormat() != QImage::Format_Invalid) {
+        image = QImage(reader.size(), reader.imageFormat());
+        image.setDotsPerMeterX(qRound(96 / 0.0254));
+        image.setDotsPerMeterY(qRound(96 / 0.0254));
+    }
     reader.read(&image);
 
     return image;
@@ -1527,92 +1671,27 @@ Okular::TextPage *XpsPage::textPage()
 
     Okular::TextPage *textPage = new Okular::TextPage();
 
-    const KZipFileEntry *pageFile = static_cast<const KZipFileEntry *>(m_file->xpsArchive()->directory()->entry(m_fileName));
-    QXmlStreamReader xml;
-    xml.addData(readFileOrDirectoryParts(pageFile));
-
-    QTransform matrix = QTransform();
-    QStack<QTransform> matrices;
-    matrices.push(QTransform());
-    bool useMatrix = false;
-    QXmlStreamAttributes glyphsAtts;
-
-    while (!xml.atEnd()) {
-        xml.readNext();
-        if (xml.isStartElement()) {
-            if (xml.name() == QStringLiteral("Canvas")) {
-                matrices.push(matrix);
-
-                QString att = xml.attributes().value(QStringLiteral("RenderTransform")).toString();
-                if (!att.isEmpty()) {
-                    matrix = parseRscRefMatrix(att) * matrix;
-                }
-            } else if ((xml.name() == QStringLiteral("Canvas.RenderTransform")) || (xml.name() == QStringLiteral("Glyphs.RenderTransform"))) {
-                useMatrix = true;
-            } else if (xml.name() == QStringLiteral("MatrixTransform")) {
-                if (useMatrix) {
-                    matrix = attsToMatrix(xml.attributes().value(QStringLiteral("Matrix")).toString()) * matrix;
-                }
-            } else if (xml.name() == QStringLiteral("Glyphs")) {
-                matrices.push(matrix);
-                glyphsAtts = xml.attributes();
-            } else if ((xml.name() == QStringLiteral("Path")) || (xml.name() == QStringLiteral("Path.Fill")) || (xml.name() == QStringLiteral("SolidColorBrush")) || (xml.name() == QStringLiteral("ImageBrush")) ||
-                       (xml.name() == QStringLiteral("ImageBrush.Transform")) || (xml.name() == QStringLiteral("Path.OpacityMask")) || (xml.name() == QStringLiteral("Path.Data")) || (xml.name() == QStringLiteral("PathGeometry")) ||
-                       (xml.name() == QStringLiteral("PathFigure")) || (xml.name() == QStringLiteral("PolyLineSegment"))) {
-                // those are only graphical - no use in text handling
-            } else if ((xml.name() == QStringLiteral("FixedPage")) || (xml.name() == QStringLiteral("FixedPage.Resources"))) {
-                // not useful for text extraction
-            } else {
-                qCWarning(OkularXpsDebug) << "Unhandled element in Text Extraction start: " << xml.name().toString();
-            }
-        } else if (xml.isEndElement()) {
-            if (xml.name() == QStringLiteral("Canvas")) {
-                matrix = matrices.pop();
-            } else if ((xml.name() == QStringLiteral("Canvas.RenderTransform")) || (xml.name() == QStringLiteral("Glyphs.RenderTransform"))) {
-                useMatrix = false;
-            } else if (xml.name() == QStringLiteral("MatrixTransform")) {
-                // not clear if we need to do anything here yet.
-            } else if (xml.name() == QStringLiteral("Glyphs")) {
-                QString att = glyphsAtts.value(QStringLiteral("RenderTransform")).toString();
-                if (!att.isEmpty()) {
-                    matrix = parseRscRefMatrix(att) * matrix;
-                }
-                QString text = unicodeString(glyphsAtts.value(QStringLiteral("UnicodeString")).toString());
-
-                // Get font (doesn't work well because qt doesn't allow to load font from file)
-                const QString absoluteFileName = absolutePath(entryPath(m_fileName), glyphsAtts.value(QStringLiteral("FontUri")).toString());
-                QFont font = m_file->getFontByName(absoluteFileName, glyphsAtts.value(QStringLiteral("FontRenderingEmSize")).toString().toFloat() * 72 / 96);
-                QFontMetrics metrics = QFontMetrics(font);
-                // Origin
-                QPointF origin(glyphsAtts.value(QStringLiteral("OriginX")).toString().toDouble(), glyphsAtts.value(QStringLiteral("OriginY")).toString().toDouble());
+    for (const XpsDisplayItem &item : displayList()) {
+        if (item.type != XpsDisplayItem::Glyphs) {
+            continue;
+        }
 
-                int lastWidth = 0;
-                for (int i = 0; i < text.length(); i++) {
-                    const int width = metrics.horizontalAdvance(text, i + 1);
+        // Get font (doesn't work well because qt doesn't allow to load font from file)
+        QFont font = m_file->getFontByName(item.fontFileName, item.fontSize * 72 / 96);
+        QFontMetrics metrics = QFontMetrics(font);
 
-                    Okular::NormalizedRect *rect =
-                        new Okular::NormalizedRect((origin.x() + lastWidth) / m_pageSize.width(), (origin.y() - metrics.height()) / m_pageSize.height(), (origin.x() + width) / m_pageSize.width(), origin.y() / m_pageSize.height());
-                    rect->transform(matrix);
-                    textPage->append(text.mid(i, 1), rect);
+        int lastWidth = 0;
+        for (int i = 0; i < item.text.length(); i++) {
+            const int width = metrics.horizontalAdvance(item.text, i + 1);
 
-                    lastWidth = width;
-                }
+            Okular::NormalizedRect *rect = new Okular::NormalizedRect(
+                (item.origin.x() + lastWidth) / m_pageSize.width(), (item.origin.y() - metrics.height()) / m_pageSize.height(), (item.origin.x() + width) / m_pageSize.width(), item.origin.y() / m_pageSize.height());
+            rect->transform(item.transform);
+            textPage->append(item.text.mid(i, 1), rect);
 
-                matrix = matrices.pop();
-            } else if ((xml.name() == QStringLiteral("Path")) || (xml.name() == QStringLiteral("Path.Fill")) || (xml.name() == QStringLiteral("SolidColorBrush")) || (xml.name() == QStringLiteral("ImageBrush")) ||
-                       (xml.name() == QStringLiteral("ImageBrush.Transform")) || (xml.name() == QStringLiteral("Path.OpacityMask")) || (xml.name() == QStringLiteral("Path.Data")) || (xml.name() == QStringLiteral("PathGeometry")) ||
-                       (xml.name() == QStringLiteral("PathFigure")) || (xml.name() == QStringLiteral("PolyLineSegment"))) {
-                // those are only graphical - no use in text handling
-            } else if ((xml.name() == QStringLiteral("FixedPage")) || (xml.name() == QStringLiteral("FixedPage.Resources"))) {
-                // not useful for text extraction
-            } else {
-                qCWarning(OkularXpsDebug) << "Unhandled element in Text Extraction end: " << xml.name().toString();
-            }
+            lastWidth = width;
         }
     }
-    if (xml.error()) {
-        qCWarning(OkularXpsDebug) << "Error parsing XpsPage text: " << xml.errorString();
-    }
     return textPage;
 }
 
@@ -1792,6 +1871,8 @@ XpsPage *XpsDocument::page(int pageNum) const
 
 XpsFile::XpsFile()
 {
+    // in KiB
+    m_imageCache.setMaxCost(64 * 1024);
 }
 
 XpsFile::~XpsFile()
@@ -1947,6 +2028,9 @@ bool XpsFile::closeDocument()
     qDeleteAll(m_documents);
     m_documents.clear();
 
+    m_imageCache.clear();
+    m_displayListPages.clear();
+
     delete m_xpsArchive;
 
     return true;
@@ -1980,6 +2064,7 @@ XpsGenerator::XpsGenerator(QObject *parent, const QVariantList &args)
     setFeature(PrintNative);
     setFeature(PrintToFile);
     setFeature(Threaded);
+    setFeature(TiledRendering);
     userMutex();
 }
 
@@ -2013,6 +2098,7 @@ bool XpsGenerator::doCloseDocument()
     m_xpsFile->closeDocument();
     delete m_xpsFile;
     m_xpsFile = nullptr;
+    m_cachedImagesCost.storeRelease(0);
 
     return true;
 }
@@ -2021,12 +2107,42 @@ QImage XpsGenerator::image(Okular::PixmapRequest *request)
 {
     QMutexLocker lock(userMutex());
     QSize size((int)request->width(), (int)request->height());
-    QImage image(size, QImage::Format_RGB32);
     XpsPage *pageToRender = m_xpsFile->page(request->page()->number());
-    pageToRender->renderToImage(&image);
+    QImage image;
+    if (request->isTile()) {
+        const QRect rect = request->normalizedRect().geometry(size.width(), size.height());
+        image = QImage(rect.size(), QImage::Format_RGB32);
+        pageToRender->renderToImage(&image, size, rect.topLeft());
+    } else {
+        image = QImage(size, QImage::Format_RGB32);
+        pageToRender->renderToImage(&image, size);
+    }
+    m_cachedImagesCost.storeRelease(m_xpsFile->cachedImagesCost());
     return image;
 }
 
+QVariant XpsGenerator::metaData(const QString &key, const QVariant &option) const
+{
+    if (key == QLatin1String("CachedMemory")) {
+        return qulonglong(m_cachedImagesCost.loadAcquire()) * 1024;
+    } else if (key == QLatin1String("FreeCachedMemory")) {
+        const_cast<XpsGenerator *>(this)->freeCachedMemory(option.toULongLong());
+    }
+    return QVariant();
+}
+
+void XpsGenerator::freeCachedMemory(qulonglong memory)
+{
+    // don't block the main thread while a page is rendered, the next
+    // memory check will try again
+    if (!m_xpsFile || !userMutex()->tryLock())
+        return;
+
+    m_xpsFile->releaseCachedImages(int(qMin<qulonglong>(memory / 1024 + 1, m_xpsFile->cachedImagesCost())));
+    m_cachedImagesCost.storeRelease(m_xpsFile->cachedImagesCost());
+    userMutex()->unlock();
+}
+
 Okular::TextPage *XpsGenerator::textPage(Okular::TextRequest *request)
 {
     QMutexLocker lock(userMutex());
@@ -2075,7 +2191,12 @@ bool XpsGenerator::exportTo(const QString &fileName, const Okular::ExportFormat
 
         QTextStream ts(&f);
         for (int i = 0; i < m_xpsFile->numPages(); ++i) {
-            Okular::TextPage *textPage = m_xpsFile->page(i)->textPage();
+            Okular::TextPage *textPage;
+            {
+                // the rendering thread may be reading the same page
+                QMutexLocker lock(userMutex());
+                textPage = m_xpsFile->page(i)->textPage();
+            }
             QString text = textPage->text();
             ts << text;
             ts << QLatin1Char('\n');
@@ -2099,9 +2220,12 @@ Okular::Document::PrintError XpsGenerator::print(QPrinter &printer)
         if (i != 0)
             printer.newPage();
 
+        // the display lists and images are shared with the rendering thread
+        QMutexLocker lock(userMutex());
         const int page = pageList.at(i) - 1;
         XpsPage *pageToRender = m_xpsFile->page(page);
         pageToRender->renderToPainter(&painter);
+        m_cachedImagesCost.storeRelease(m_xpsFile->cachedImagesCost());
     }
 
     return Okular::Document::NoPrintError;
@@ -10,12 +10,19 @@
 #include <core/generator.h>
 #include <core/textpage.h>
 
+#include <QAtomicInt>
+#include <QCache>
 #include <QColor>
 #include <QDomDocument>
+#include <QFont>
 #include <QFontDatabase>
+#include <QHash>
 #include <QImage>
 #include <QLoggingCategory>
+#include <QPainterPath>
+#include <QPen>
 #include <QStack>
+#include <QTransform>
 #include <QVariant>
 #include <QXmlDefaultHandler>
 #include <QXmlStreamReader>
@@ -97,6 +104,58 @@ struct XpsPathGeometry {
     XpsMatrixTransform transform;
 };
 
+/**
+    A drawing operation of a page, with the painter state it needs, as
+    XpsHandler records it when parsing the page. The page is drawn and its
+    text extracted from these, without parsing it again.
+*/
+struct XpsDisplayItem {
+    enum Type { Path, Glyphs };
+
+    explicit XpsDisplayItem(Type _type = Path)
+        : type(_type)
+        , opacity(1.0)
+        , visible(true)
+        , fontSize(0)
+        , layoutDirection(Qt::LeftToRight)
+    {
+    }
+
+    Type type;
+    // relative to the page, in drawing units
+    QTransform transform;
+    qreal opacity;
+    QPainterPath clipPath;
+    QBrush brush;
+    QPen pen;
+    // the ImageSource of an ImageBrush brush or pen, whose image is taken
+    // from the cache of the XpsFile when drawing instead of being kept here
+    QString brushImage;
+    QString penImage;
+    // whether there is anything to draw, glyphs are kept for their text anyway
+    bool visible;
+
+    // Path
+    QList<XpsPathFigure> figures;
+
+    // Glyphs
+    QFont font;
+    QString fontFileName;
+    float fontSize;
+    QPointF origin;
+    QString text;
+    QList<qreal> advanceWidths;
+    Qt::LayoutDirection layoutDirection;
+};
+
+/**
+    The state of the canvases while parsing a page
+*/
+struct XpsRenderState {
+    QTransform transform;
+    qreal opacity = 1.0;
+};
+
 class XpsPage;
 class XpsFile;
 
@@ -126,11 +185,14 @@ protected:
     void processPathGeometry(XpsRenderNode &node);
     void processPathFigure(XpsRenderNode &node);
 
-    QPainter *m_painter;
-
-    QImage m_image;
+    void appendItem(XpsDisplayItem &item);
 
     QStack<XpsRenderNode> m_nodes;
+    QStack<XpsRenderState> m_states;
+
+    QVector<XpsDisplayItem> m_items;
+    // the ImageSource of the images of the image brushes, by cache key
+    QHash<qint64, QString> m_imageSources;
 
     friend class XpsPage;
 };
@@ -145,10 +207,21 @@ public:
     XpsPage &operator=(const XpsPage &) = delete;
 
     QSizeF size() const;
-    bool renderToImage(QImage *p);
+    /**
+       render the page scaled to \p pageSize into \p p, whose top left
+       corner is at \p offset of the page
+    */
+    bool renderToImage(QImage *p, const QSize &pageSize, const QPoint &offset = QPoint());
     bool renderToPainter(QPainter *painter);
+    bool renderToPainter(QPainter *painter, const QSizeF &pageSize);
     Okular::TextPage *textPage();
 
+    /**
+       the drawing operations of the page, it is parsed the first time
+    */
+    const QVector<XpsDisplayItem> &displayList();
+    void releaseDisplayList();
+
     QImage loadImageFromFile(const QString &filename);
     QString fileName() const
     {
@@ -156,6 +229,8 @@ public:
     }
 
 private:
+    QBrush withImage(const QBrush &brush, const QString &imageSource);
+
     XpsFile *m_file;
     const QString m_fileName;
 
@@ -166,11 +241,10 @@ private:
     QImage m_thumbnail;
     bool m_thumbnailIsLoaded;
 
-    QImage *m_pageImage;
-    bool m_pageIsRendered;
+    QVector<XpsDisplayItem> m_displayList;
+    bool m_displayListIsLoaded;
 
     friend class XpsHandler;
-    friend class XpsTextExtractionHandler;
 };
 
 /**
@@ -273,10 +347,33 @@ public:
 
     QFont getFontByName(const QString &absoluteFileName, float size);
 
+    /**
+       the image in the part \p absoluteFileName, which is decoded once for
+       the document as long as it fits in the image cache
+    */
+    QImage getImageByName(const QString &absoluteFileName);
+
+    /**
+       the memory used by the decoded images, in KiB
+    */
+    int cachedImagesCost() const;
+
+    /**
+       release the least recently used decoded images, about \p cost KiB of them
+    */
+    void releaseCachedImages(int cost);
+
+    /**
+       keeps the display list of \p page as the most recently used one,
+       releasing the ones of the pages that weren't used for the longest
+    */
+    void useDisplayList(XpsPage *page);
+
     KZip *xpsArchive();
 
 private:
     int loadFontByName(const QString &absoluteFileName);
+    QImage loadImageByName(const QString &absoluteFileName);
 
     QList<XpsDocument *> m_documents;
     QList<XpsPage *> m_pages;
@@ -294,6 +391,11 @@ private:
 
     QMap<QString, int> m_fontCache;
     QFontDatabase m_fontDatabase;
+
+    // the decoded images by part name, their cost is in KiB
+    QCache<QString, QImage> m_imageCache;
+    // the pages that have a display list, the most recently used first
+    QList<XpsPage *> m_displayListPages;
 };
 
 class XpsGenerator : public Okular::Generator
@@ -314,13 +416,20 @@ public:
 
     Okular::Document::PrintError print(QPrinter &printer) override;
 
+    QVariant metaData(const QString &key, const QVariant &option) const override;
+
 protected:
     bool doCloseDocument() override;
     QImage image(Okular::PixmapRequest *request) override;
     Okular::TextPage *textPage(Okular::TextRequest *request) override;
 
 private:
+    // frees about memory bytes of the cached images, for the FreeCachedMemory meta data
+    void freeCachedMemory(qulonglong memory);
+
     XpsFile *m_xpsFile;
+    // in KiB, to be read without waiting for the rendering thread
+    QAtomicInt m_cachedImagesCost;
 };
 
 Q_DECLARE_LOGGING_CATEGORY(OkularXpsDebug)
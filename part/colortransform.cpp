@@ -0,0 +1,743 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "colortransform.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OKULAR_COLORTRANSFORM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// AVX2 is not part of any baseline, so its functions are compiled for it
+// one by one and only called after checking the CPU
+#if defined(OKULAR_COLORTRANSFORM_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OKULAR_COLORTRANSFORM_AVX2 1
+#define OKULAR_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define OKULAR_COLORTRANSFORM_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace ColorTransform
+{
+static const quint32 alphaMask = 0xff000000;
+static const quint32 colorMask = 0x00ffffff;
+
+// BEGIN Implementation selection
+static bool isAvailable(Implementation implementation)
+{
+    switch (implementation) {
+    case Scalar:
+        return true;
+    case SSE2:
+#ifdef OKULAR_COLORTRANSFORM_SSE2
+        return true;
+#else
+        return false;
+#endif
+    case AVX2:
+#ifdef OKULAR_COLORTRANSFORM_AVX2
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    case NEON:
+#ifdef OKULAR_COLORTRANSFORM_NEON
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+static Implementation &currentImplementation()
+{
+    static Implementation current = availableImplementations().constLast();
+    return current;
+}
+
+QVector<Implementation> availableImplementations()
+{
+    QVector<Implementation> implementations;
+    for (Implementation candidate : {Scalar, SSE2, AVX2, NEON}) {
+        if (isAvailable(candidate))
+            implementations.append(candidate);
+    }
+    return implementations;
+}
+
+Implementation implementation()
+{
+    return currentImplementation();
+}
+
+void setImplementation(Implementation implementation)
+{
+    Q_ASSERT(isAvailable(implementation));
+    if (isAvailable(implementation))
+        currentImplementation() = implementation;
+}
+
+const char *implementationName(Implementation implementation)
+{
+    switch (implementation) {
+    case Scalar:
+        return "Scalar";
+    case SSE2:
+        return "SSE2";
+    case AVX2:
+        return "AVX2";
+    case NEON:
+        return "NEON";
+    }
+    return "";
+}
+// END Implementation selection
+
+// BEGIN Gray table kernels
+// recolor() and blackWhite() only depend on qGray() of the pixel, so they are
+// a lookup in a table of 256 colors (without alpha). qGray() is
+// (r * 11 + g * 16 + b * 5) / 32, computed here on all the lanes at once.
+
+static void applyGrayTableScalar(QRgb *data, int pixels, const quint32 *table)
+{
+    for (int i = 0; i < pixels; ++i)
+        data[i] = (data[i] & alphaMask) | table[qGray(data[i])];
+}
+
+#ifdef OKULAR_COLORTRANSFORM_SSE2
+static inline __m128i grayIndexSSE2(__m128i pixels)
+{
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask);
+    const __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask);
+    const __m128i b = _mm_and_si128(pixels, byteMask);
+    // the products fit in the low 16 bits of each lane and the high ones are 0
+    const __m128i sum = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(11)), _mm_slli_epi32(g, 4)), _mm_mullo_epi16(b, _mm_set1_epi32(5)));
+    return _mm_srli_epi32(sum, 5);
+}
+
+static void applyGrayTableSSE2(QRgb *data, int pixels, const quint32 *table)
+{
+    const __m128i alpha = _mm_set1_epi32(alphaMask);
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i);
+        const __m128i px = _mm_loadu_si128(p);
+        alignas(16) quint32 index[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(index), grayIndexSSE2(px));
+        const __m128i colors = _mm_setr_epi32(table[index[0]], table[index[1]], table[index[2]], table[index[3]]);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(px, alpha), colors));
+    }
+    applyGrayTableScalar(data + i, pixels - i, table);
+}
+#endif
+
+#ifdef OKULAR_COLORTRANSFORM_AVX2
+OKULAR_TARGET_AVX2 static void applyGrayTableAVX2(QRgb *data, int pixels, const quint32 *table)
+{
+    const __m256i alpha = _mm256_set1_epi32(alphaMask);
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(data + i);
+        const __m256i px = _mm256_loadu_si256(p);
+        const __m256i r = _mm256_and_si256(_mm256_srli_epi32(px, 16), byteMask);
+        const __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), byteMask);
+        const __m256i b = _mm256_and_si256(px, byteMask);
+        const __m256i sum = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi16(r, _mm256_set1_epi32(11)), _mm256_slli_epi32(g, 4)), _mm256_mullo_epi16(b, _mm256_set1_epi32(5)));
+        const __m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table), _mm256_srli_epi32(sum, 5), 4);
+        _mm256_storeu_si256(p, _mm256_or_si256(_mm256_and_si256(px, alpha), colors));
+    }
+    applyGrayTableScalar(data + i, pixels - i, table);
+}
+#endif
+
+#ifdef OKULAR_COLORTRANSFORM_NEON
+static void applyGrayTableNEON(QRgb *data, int pixels, const quint32 *table)
+{
+    const uint32x4_t alpha = vdupq_n_u32(alphaMask);
+    const uint32x4_t byteMask = vdupq_n_u32(0xff);
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        const uint32x4_t px = vld1q_u32(data + i);
+        const uint32x4_t r = vandq_u32(vshrq_n_u32(px, 16), byteMask);
+        const uint32x4_t g = vandq_u32(vshrq_n_u32(px, 8), byteMask);
+        const uint32x4_t b = vandq_u32(px, byteMask);
+        const uint32x4_t sum = vaddq_u32(vaddq_u32(vmulq_n_u32(r, 11), vshlq_n_u32(g, 4)), vmulq_n_u32(b, 5));
+        quint32 index[4];
+        vst1q_u32(index, vshrq_n_u32(sum, 5));
+        const quint32 colorsArray[4] = {table[index[0]], table[index[1]], table[index[2]], table[index[3]]};
+        vst1q_u32(data + i, vorrq_u32(vandq_u32(px, alpha), vld1q_u32(colorsArray)));
+    }
+    applyGrayTableScalar(data + i, pixels - i, table);
+}
+#endif
+
+static void applyGrayTable(QRgb *data, int pixels, const quint32 *table)
+{
+    switch (implementation()) {
+#ifdef OKULAR_COLORTRANSFORM_SSE2
+    case SSE2:
+        applyGrayTableSSE2(data, pixels, table);
+        return;
+#endif
+#ifdef OKULAR_COLORTRANSFORM_AVX2
+    case AVX2:
+        applyGrayTableAVX2(data, pixels, table);
+        return;
+#endif
+#ifdef OKULAR_COLORTRANSFORM_NEON
+    case NEON:
+        applyGrayTableNEON(data, pixels, table);
+        return;
+#endif
+    default:
+        applyGrayTableScalar(data, pixels, table);
+    }
+}
+
+void recolor(QRgb *data, int pixels, const QColor &foreground, const QColor &background)
+{
+    const float scaleRed = background.redF() - foreground.redF();
+    const float scaleGreen = background.greenF() - foreground.greenF();
+    const float scaleBlue = background.blueF() - foreground.blueF();
+
+    const int foreground_red = foreground.red();
+    const int foreground_green = foreground.green();
+    const int foreground_blue = foreground.blue();
+
+    quint32 table[256];
+    for (int lightness = 0; lightness < 256; ++lightness) {
+        const float r = scaleRed * lightness + foreground_red;
+        const float g = scaleGreen * lightness + foreground_green;
+        const float b = scaleBlue * lightness + foreground_blue;
+
+        table[lightness] = qRgba(r, g, b, 0);
+    }
+
+    applyGrayTable(data, pixels, table);
+}
+
+void blackWhite(QRgb *data, int pixels, int contrast, int threshold)
+{
+    const int con = contrast;
+    const int thr = 255 - threshold;
+
+    quint32 table[256];
+    for (int gray = 0; gray < 256; ++gray) {
+        // Piecewise linear function of val, through (0, 0), (thr, 128), (255, 255)
+        int val = gray;
+        if (val > thr)
+            val = 128 + (127 * (val - thr)) / (255 - thr);
+        else if (val < thr)
+            val = (128 * val) / thr;
+
+        // Linear contrast stretching through (thr, thr)
+        if (con > 2) {
+            val = thr + (val - thr) * con / 2;
+            val = qBound(0, val, 255);
+        }
+
+        table[gray] = qRgba(val, val, val, 0);
+    }
+
+    applyGrayTable(data, pixels, table);
+}
+// END Gray table kernels
+
+// BEGIN Invert lightness kernels
+static void invertLightnessScalar(QRgb *data, int pixels)
+{
+    for (int i = 0; i < pixels; ++i) {
+        // Invert lightness of the pixel using the cylindric HSL color model.
+        // Algorithm is based on https://en.wikipedia.org/wiki/HSL_and_HSV#HSL_to_RGB (2019-03-17).
+        // Important simplifications are that inverting lightness does not change chroma and hue.
+        // This means the sector (of the chroma/hue plane) is not changed,
+        // so we can use a linear calculation after determining the sector using qMin() and qMax().
+        uchar R = qRed(data[i]);
+        uchar G = qGreen(data[i]);
+        uchar B = qBlue(data[i]);
+
+        // Get only the needed HSL components. These are chroma C and the common component m.
+        // Get common component m
+        uchar m = qMin(R, qMin(G, B));
+        // Remove m from color components
+        R -= m;
+        G -= m;
+        B -= m;
+        // Get chroma C
+        uchar C = qMax(R, qMax(G, B));
+
+        // Get common component m' after inverting lightness L.
+        // Hint: Lightness L = m + C / 2; L' = 255 - L = 255 - (m + C / 2) => m' = 255 - C - m
+        uchar m_ = 255 - C - m;
+
+        // Add m' to color compontents
+        R += m_;
+        G += m_;
+        B += m_;
+
+        // Save new color
+        const unsigned A = qAlpha(data[i]);
+        data[i] = qRgba(R, G, B, A);
+    }
+}
+
+// The vector versions use that m' - m = 255 - max(R, G, B) - min(R, G, B),
+// so every color byte becomes R - min + (255 - max). Neither step wraps
+// around, and alpha gets 0 subtracted and added.
+
+#ifdef OKULAR_COLORTRANSFORM_SSE2
+static inline __m128i spreadLowByteSSE2(__m128i v)
+{
+    return _mm_or_si128(_mm_or_si128(v, _mm_slli_epi32(v, 8)), _mm_slli_epi32(v, 16));
+}
+
+static void invertLightnessSSE2(QRgb *data, int pixels)
+{
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    const __m128i color = _mm_set1_epi32(colorMask);
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i);
+        const __m128i px = _mm_loadu_si128(p);
+        const __m128i g = _mm_srli_epi32(px, 8);
+        const __m128i r = _mm_srli_epi32(px, 16);
+        const __m128i maximum = spreadLowByteSSE2(_mm_and_si128(_mm_max_epu8(_mm_max_epu8(px, g), r), byteMask));
+        const __m128i minimum = spreadLowByteSSE2(_mm_and_si128(_mm_min_epu8(_mm_min_epu8(px, g), r), byteMask));
+        _mm_storeu_si128(p, _mm_add_epi8(_mm_sub_epi8(px, minimum), _mm_xor_si128(maximum, color)));
+    }
+    invertLightnessScalar(data + i, pixels - i);
+}
+#endif
+
+#ifdef OKULAR_COLORTRANSFORM_AVX2
+OKULAR_TARGET_AVX2 static inline __m256i spreadLowByteAVX2(__m256i v)
+{
+    return _mm256_or_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 8)), _mm256_slli_epi32(v, 16));
+}
+
+OKULAR_TARGET_AVX2 static void invertLightnessAVX2(QRgb *data, int pixels)
+{
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    const __m256i color = _mm256_set1_epi32(colorMask);
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(data + i);
+        const __m256i px = _mm256_loadu_si256(p);
+        const __m256i g = _mm256_srli_epi32(px, 8);
+        const __m256i r = _mm256_srli_epi32(px, 16);
+        const __m256i maximum = spreadLowByteAVX2(_mm256_and_si256(_mm256_max_epu8(_mm256_max_epu8(px, g), r), byteMask));
+        const __m256i minimum = spreadLowByteAVX2(_mm256_and_si256(_mm256_min_epu8(_mm256_min_epu8(px, g), r), byteMask));
+        _mm256_storeu_si256(p, _mm256_add_epi8(_mm256_sub_epi8(px, minimum), _mm256_xor_si256(maximum, color)));
+    }
+    invertLightnessScalar(data + i, pixels - i);
+}
+#endif
+
+#ifdef OKULAR_COLORTRANSFORM_NEON
+static inline uint32x4_t spreadLowByteNEON(uint32x4_t v)
+{
+    return vorrq_u32(vorrq_u32(v, vshlq_n_u32(v, 8)), vshlq_n_u32(v, 16));
+}
+
+static void invertLightnessNEON(QRgb *data, int pixels)
+{
+    const uint32x4_t byteMask = vdupq_n_u32(0xff);
+    const uint32x4_t color = vdupq_n_u32(colorMask);
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        const uint32x4_t px = vld1q_u32(data + i);
+        const uint8x16_t b8 = vreinterpretq_u8_u32(px);
+        const uint8x16_t g8 = vreinterpretq_u8_u32(vshrq_n_u32(px, 8));
+        const uint8x16_t r8 = vreinterpretq_u8_u32(vshrq_n_u32(px, 16));
+        const uint32x4_t maximum = spreadLowByteNEON(vandq_u32(vreinterpretq_u32_u8(vmaxq_u8(vmaxq_u8(b8, g8), r8)), byteMask));
+        const uint32x4_t minimum = spreadLowByteNEON(vandq_u32(vreinterpretq_u32_u8(vminq_u8(vminq_u8(b8, g8), r8)), byteMask));
+        const uint8x16_t result = vaddq_u8(vsubq_u8(b8, vreinterpretq_u8_u32(minimum)), vreinterpretq_u8_u32(veorq_u32(maximum, color)));
+        vst1q_u32(data + i, vreinterpretq_u32_u8(result));
+    }
+    invertLightnessScalar(data + i, pixels - i);
+}
+#endif
+
+void invertLightness(QRgb *data, int pixels)
+{
+    switch (implementation()) {
+#ifdef OKULAR_COLORTRANSFORM_SSE2
+    case SSE2:
+        invertLightnessSSE2(data, pixels);
+        return;
+#endif
+#ifdef OKULAR_COLORTRANSFORM_AVX2
+    case AVX2:
+        invertLightnessAVX2(data, pixels);
+        return;
+#endif
+#ifdef OKULAR_COLORTRANSFORM_NEON
+    case NEON:
+        invertLightnessNEON(data, pixels);
+        return;
+#endif
+    default:
+        invertLightnessScalar(data, pixels);
+    }
+}
+// END Invert lightness kernels
+
+// BEGIN Invert luma kernels
+namespace
+{
+/**
+ * Remembers the colors invertLumaPixel() computed in a small direct mapped
+ * table. Pages mostly use few colors, and the computation is expensive.
+ */
+class InvertedLumaTable
+{
+public:
+    InvertedLumaTable(float Y_R, float Y_G, float Y_B)
+        : m_Y_R(Y_R)
+        , m_Y_G(Y_G)
+        , m_Y_B(Y_B)
+    {
+        // no color has alpha bits set
+        std::fill(m_colors, m_colors + size, alphaMask);
+    }
+
+    QRgb invert(QRgb pixel)
+    {
+        const quint32 color = pixel & colorMask;
+        // the gray ones don't need the table, see invertLumaPixel()
+        if (qRed(pixel) == qGreen(pixel) && qGreen(pixel) == qBlue(pixel))
+            return pixel ^ colorMask;
+
+        const quint32 slot = (color * 2654435761U) >> (32 - sizeBits);
+        if (m_colors[slot] != color) {
+            uchar R = qRed(pixel);
+            uchar G = qGreen(pixel);
+            uchar B = qBlue(pixel);
+            invertLumaPixel(R, G, B, m_Y_R, m_Y_G, m_Y_B);
+            m_colors[slot] = color;
+            m_inverted[slot] = qRgba(R, G, B, 0);
+        }
+        return (pixel & alphaMask) | m_inverted[slot];
+    }
+
+private:
+    static const int sizeBits = 10;
+    static const int size = 1 << sizeBits;
+
+    float m_Y_R, m_Y_G, m_Y_B;
+    quint32 m_colors[size];
+    quint32 m_inverted[size];
+};
+}
+
+static void invertLumaScalar(QRgb *data, int pixels, InvertedLumaTable *table)
+{
+    for (int i = 0; i < pixels; ++i)
+        data[i] = table->invert(data[i]);
+}
+
+// The vector versions invert whole vectors of gray pixels, which most pages
+// mostly are, with a xor and hand the others to the table.
+
+#ifdef OKULAR_COLORTRANSFORM_SSE2
+static void invertLumaSSE2(QRgb *data, int pixels, InvertedLumaTable *table)
+{
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    const __m128i color = _mm_set1_epi32(colorMask);
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i);
+        const __m128i px = _mm_loadu_si128(p);
+        const __m128i gray = spreadLowByteSSE2(_mm_and_si128(px, byteMask));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(px, color), gray)) == 0xffff)
+            _mm_storeu_si128(p, _mm_xor_si128(px, color));
+        else
+            invertLumaScalar(data + i, 4, table);
+    }
+    invertLumaScalar(data + i, pixels - i, table);
+}
+#endif
+
+#ifdef OKULAR_COLORTRANSFORM_AVX2
+OKULAR_TARGET_AVX2 static void invertLumaAVX2(QRgb *data, int pixels, InvertedLumaTable *table)
+{
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    const __m256i color = _mm256_set1_epi32(colorMask);
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(data + i);
+        const __m256i px = _mm256_loadu_si256(p);
+        const __m256i gray = spreadLowByteAVX2(_mm256_and_si256(px, byteMask));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(px, color), gray)) == -1)
+            _mm256_storeu_si256(p, _mm256_xor_si256(px, color));
+        else
+            invertLumaScalar(data + i, 8, table);
+    }
+    invertLumaScalar(data + i, pixels - i, table);
+}
+#endif
+
+#ifdef OKULAR_COLORTRANSFORM_NEON
+static void invertLumaNEON(QRgb *data, int pixels, InvertedLumaTable *table)
+{
+    const uint32x4_t byteMask = vdupq_n_u32(0xff);
+    const uint32x4_t color = vdupq_n_u32(colorMask);
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        const uint32x4_t px = vld1q_u32(data + i);
+        const uint32x4_t gray = spreadLowByteNEON(vandq_u32(px, byteMask));
+        const uint32x4_t equal = vceqq_u32(vandq_u32(px, color), gray);
+        const uint32x2_t allEqual = vand_u32(vget_low_u32(equal), vget_high_u32(equal));
+        if ((vget_lane_u32(allEqual, 0) & vget_lane_u32(allEqual, 1)) == 0xffffffff)
+            vst1q_u32(data + i, veorq_u32(px, color));
+        else
+            invertLumaScalar(data + i, 4, table);
+    }
+    invertLumaScalar(data + i, pixels - i, table);
+}
+#endif
+
+void invertLuma(QRgb *data, int pixels, float Y_R, float Y_G, float Y_B)
+{
+    InvertedLumaTable table(Y_R, Y_G, Y_B);
+
+    switch (implementation()) {
+#ifdef OKULAR_COLORTRANSFORM_SSE2
+    case SSE2:
+        invertLumaSSE2(data, pixels, &table);
+        return;
+#endif
+#ifdef OKULAR_COLORTRANSFORM_AVX2
+    case AVX2:
+        invertLumaAVX2(data, pixels, &table);
+        return;
+#endif
+#ifdef OKULAR_COLORTRANSFORM_NEON
+    case NEON:
+        invertLumaNEON(data, pixels, &table);
+        return;
+#endif
+    default:
+        invertLumaScalar(data, pixels, &table);
+    }
+}
+
+void invertLumaPixel(uchar &R, uchar &G, uchar &B, float Y_R, float Y_G, float Y_B)
+{
+    // Invert luma of the pixel using the bicone HCY color model, stretched to cylindric HSY.
+    // Algorithm is based on https://en.wikipedia.org/wiki/HSL_and_HSV#Luma,_chroma_and_hue_to_RGB (2019-03-19).
+    // For an illustration see https://experilous.com/1/product/make-it-colorful/ (2019-03-19).
+
+    // Special case: The algorithm does not work when hue is undefined.
+    if (R == G && G == B) {
+        R = 255 - R;
+        G = 255 - G;
+        B = 255 - B;
+        return;
+    }
+
+    // Get input and output luma Y, Y_inv in range 0..255
+    float Y = R * Y_R + G * Y_G + B * Y_B;
+    float Y_inv = 255 - Y;
+
+    // Get common component m and remove from color components.
+    // This moves us to the bottom faces of the HCY bicone, i. e. we get C and X in R, G, B.
+    uint_fast8_t m = qMin(R, qMin(G, B));
+    R -= m;
+    G -= m;
+    B -= m;
+
+    // We operate in a hue plane of the luma/chroma/hue bicone.
+    // The hue plane is a triangle.
+    // This bicone is distorted, so we can not simply mirror the triangle.
+    // We need to stretch it to a luma/saturation rectangle, so we need to stretch chroma C and the proportional X.
+
+    // First, we need to calculate luma Y_full_C for the outer corner of the triangle.
+    // Then we can interpolate the max chroma C_max, C_inv_max for our luma Y, Y_inv.
+    // Then we calculate C_inv and X_inv by scaling them by the ratio of C_max and C_inv_max.
+
+    // Calculate luma Y_full_C (in range equivalent to gray 0..255) for chroma = 1 at this hue.
+    // Piecewise linear, with the corners of the bicone at the sum of one or two luma coefficients.
+    float Y_full_C;
+    if (R >= B && B >= G) {
+        Y_full_C = 255 * Y_R + 255 * Y_B * B / R;
+    } else if (R >= G && G >= B) {
+        Y_full_C = 255 * Y_R + 255 * Y_G * G / R;
+    } else if (G >= R && R >= B) {
+        Y_full_C = 255 * Y_G + 255 * Y_R * R / G;
+    } else if (G >= B && B >= R) {
+        Y_full_C = 255 * Y_G + 255 * Y_B * B / G;
+    } else if (B >= G && G >= R) {
+        Y_full_C = 255 * Y_B + 255 * Y_G * G / B;
+    } else {
+        Y_full_C = 255 * Y_B + 255 * Y_R * R / B;
+    }
+
+    // Calculate C_max, C_inv_max, to scale C and X.
+    float C_max, C_inv_max;
+    if (Y >= Y_full_C) {
+        C_max = Y_inv / (255 - Y_full_C);
+    } else {
+        C_max = Y / Y_full_C;
+    }
+    if (Y_inv >= Y_full_C) {
+        C_inv_max = Y / (255 - Y_full_C);
+    } else {
+        C_inv_max = Y_inv / Y_full_C;
+    }
+
+    // Scale C and X. C and X already lie in R, G, B.
+    float C_scale = C_inv_max / C_max;
+    float R_ = R * C_scale;
+    float G_ = G * C_scale;
+    float B_ = B * C_scale;
+
+    // Calculate missing luma (in range 0..255), to get common component m_inv
+    float m_inv = Y_inv - (Y_R * R_ + Y_G * G_ + Y_B * B_);
+
+    // Add m_inv to color compontents
+    R_ += m_inv;
+    G_ += m_inv;
+    B_ += m_inv;
+
+    // Return colors rounded
+    R = R_ + 0.5;
+    G = G_ + 0.5;
+    B = B_ + 0.5;
+}
+// END Invert luma kernels
+
+// BEGIN Hue shift kernels
+// Rotating the color bytes: qRgba(B, R, G, A) and qRgba(G, B, R, A).
+
+static void hueShiftPositiveScalar(QRgb *data, int pixels)
+{
+    for (int i = 0; i < pixels; ++i)
+        data[i] = (data[i] & alphaMask) | ((data[i] & 0xff) << 16) | ((data[i] >> 8) & 0xffff);
+}
+
+static void hueShiftNegativeScalar(QRgb *data, int pixels)
+{
+    for (int i = 0; i < pixels; ++i)
+        data[i] = (data[i] & alphaMask) | ((data[i] & 0xffff) << 8) | ((data[i] >> 16) & 0xff);
+}
+
+#ifdef OKULAR_COLORTRANSFORM_SSE2
+static void hueShiftSSE2(QRgb *data, int pixels, bool positive)
+{
+    const __m128i alpha = _mm_set1_epi32(alphaMask);
+    const __m128i lowByte = _mm_set1_epi32(0xff);
+    const __m128i lowWord = _mm_set1_epi32(0xffff);
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i);
+        const __m128i px = _mm_loadu_si128(p);
+        __m128i shifted;
+        if (positive)
+            shifted = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(px, lowByte), 16), _mm_and_si128(_mm_srli_epi32(px, 8), lowWord));
+        else
+            shifted = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(px, lowWord), 8), _mm_and_si128(_mm_srli_epi32(px, 16), lowByte));
+        _mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(px, alpha), shifted));
+    }
+    if (positive)
+        hueShiftPositiveScalar(data + i, pixels - i);
+    else
+        hueShiftNegativeScalar(data + i, pixels - i);
+}
+#endif
+
+#ifdef OKULAR_COLORTRANSFORM_AVX2
+OKULAR_TARGET_AVX2 static void hueShiftAVX2(QRgb *data, int pixels, bool positive)
+{
+    const __m256i alpha = _mm256_set1_epi32(alphaMask);
+    const __m256i lowByte = _mm256_set1_epi32(0xff);
+    const __m256i lowWord = _mm256_set1_epi32(0xffff);
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(data + i);
+        const __m256i px = _mm256_loadu_si256(p);
+        __m256i shifted;
+        if (positive)
+            shifted = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(px, lowByte), 16), _mm256_and_si256(_mm256_srli_epi32(px, 8), lowWord));
+        else
+            shifted = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(px, lowWord), 8), _mm256_and_si256(_mm256_srli_epi32(px, 16), lowByte));
+        _mm256_storeu_si256(p, _mm256_or_si256(_mm256_and_si256(px, alpha), shifted));
+    }
+    if (positive)
+        hueShiftPositiveScalar(data + i, pixels - i);
+    else
+        hueShiftNegativeScalar(data + i, pixels - i);
+}
+#endif
+
+#ifdef OKULAR_COLORTRANSFORM_NEON
+static void hueShiftNEON(QRgb *data, int pixels, bool positive)
+{
+    const uint32x4_t alpha = vdupq_n_u32(alphaMask);
+    const uint32x4_t lowByte = vdupq_n_u32(0xff);
+    const uint32x4_t lowWord = vdupq_n_u32(0xffff);
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        const uint32x4_t px = vld1q_u32(data + i);
+        uint32x4_t shifted;
+        if (positive)
+            shifted = vorrq_u32(vshlq_n_u32(vandq_u32(px, lowByte), 16), vandq_u32(vshrq_n_u32(px, 8), lowWord));
+        else
+            shifted = vorrq_u32(vshlq_n_u32(vandq_u32(px, lowWord), 8), vandq_u32(vshrq_n_u32(px, 16), lowByte));
+        vst1q_u32(data + i, vorrq_u32(vandq_u32(px, alpha), shifted));
+    }
+    if (positive)
+        hueShiftPositiveScalar(data + i, pixels - i);
+    else
+        hueShiftNegativeScalar(data + i, pixels - i);
+}
+#endif
+
+static void hueShift(QRgb *data, int pixels, bool positive)
+{
+    switch (implementation()) {
+#ifdef OKULAR_COLORTRANSFORM_SSE2
+    case SSE2:
+        hueShiftSSE2(data, pixels, positive);
+        return;
+#endif
+#ifdef OKULAR_COLORTRANSFORM_AVX2
+    case AVX2:
+        hueShiftAVX2(data, pixels, positive);
+        return;
+#endif
+#ifdef OKULAR_COLORTRANSFORM_NEON
+    case NEON:
+        hueShiftNEON(data, pixels, positive);
+        return;
+#endif
+    default:
+        if (positive)
+            hueShiftPositiveScalar(data, pixels);
+        else
+            hueShiftNegativeScalar(data, pixels);
+    }
+}
+
+void hueShiftPositive(QRgb *data, int pixels)
+{
+    hueShift(data, pixels, true);
+}
+
+void hueShiftNegative(QRgb *data, int pixels)
+{
+    hueShift(data, pixels, false);
+}
+// END Hue shift kernels
+}
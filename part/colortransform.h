@@ -0,0 +1,91 @@
+/*
+    SPDX-FileCopyrightText: 2021 Okular developers
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef _OKULAR_COLORTRANSFORM_H_
+#define _OKULAR_COLORTRANSFORM_H_
+
+#include <QColor>
+#include <QVector>
+#include <QtGlobal>
+
+/**
+ * The per pixel kernels behind the color change modes of PagePainter.
+ *
+ * They work in place on premultiplied ARGB32 pixels and keep alpha as is.
+ * Every kernel has a plain C++ version and, where the build and the CPU
+ * allow, SSE2, AVX2 and NEON ones; the fastest available one is picked at
+ * runtime. All of them give exactly the same result as the plain one: the
+ * modes that depend on the gray value of the pixel only compute it in vector
+ * registers and look the colors up in a table filled with the plain formula,
+ * invertLuma() only vectorizes the gray pixels.
+ */
+namespace ColorTransform
+{
+enum Implementation {
+    Scalar, ///< Plain C++
+    SSE2,   ///< x86 SSE2
+    AVX2,   ///< x86 AVX2, only if the CPU supports it
+    NEON    ///< ARM NEON
+};
+
+/**
+ * The implementations this build supports on this CPU, Scalar first.
+ */
+QVector<Implementation> availableImplementations();
+
+/**
+ * The implementation the kernels use, by default the fastest available one.
+ */
+Implementation implementation();
+
+/**
+ * Makes the kernels use @p implementation, which must be available.
+ * Meant for testing and benchmarking, it's not thread safe.
+ */
+void setImplementation(Implementation implementation);
+
+const char *implementationName(Implementation implementation);
+
+/**
+ * Collapse color space (from white to black) to a line from @p foreground to @p background.
+ */
+void recolor(QRgb *data, int pixels, const QColor &foreground, const QColor &background);
+
+/**
+ * Collapse color space to a line from white to black,
+ * then move from @p threshold to 128 and stretch the line by @p contrast.
+ */
+void blackWhite(QRgb *data, int pixels, int contrast, int threshold);
+
+/**
+ * Invert the lightness axis of the HSL color cone.
+ */
+void invertLightness(QRgb *data, int pixels);
+
+/**
+ * Inverts luma using the luma coefficients @p Y_R, @p Y_G, @p Y_B (should sum up to 1),
+ * and assuming linear 8bit RGB color space.
+ */
+void invertLuma(QRgb *data, int pixels, float Y_R, float Y_G, float Y_B);
+
+/**
+ * Inverts luma of a pixel given in @p R, @p G, @p B,
+ * using the luma coefficients @p Y_R, @p Y_G, @p Y_B (should sum up to 1),
+ * and assuming linear 8bit RGB color space.
+ */
+void invertLumaPixel(uchar &R, uchar &G, uchar &B, float Y_R, float Y_G, float Y_B);
+
+/**
+ * Shifts hue of each pixel by 120 degrees, by simply swapping channels.
+ */
+void hueShiftPositive(QRgb *data, int pixels);
+
+/**
+ * Shifts hue of each pixel by 240 degrees, by simply swapping channels.
+ */
+void hueShiftNegative(QRgb *data, int pixels);
+}
+
+#endif
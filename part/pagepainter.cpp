@@ -9,6 +9,7 @@
 // qt / kde includes
 #include <KIconLoader>
 #include <QApplication>
+#include <QCache>
 #include <QDebug>
 #include <QIcon>
 #include <QPainter>
@@ -22,6 +23,7 @@
 #include <math.h>
 
 // local includes
+#include "colortransform.h"
 #include "core/annotations.h"
 #include "core/observer.h"
 #include "core/page.h"
@@ -35,6 +37,29 @@
 
 Q_GLOBAL_STATIC_WITH_ARGS(QPixmap, busyPixmap, (QIcon::fromTheme(QLatin1String("okular")).pixmap(KIconLoader::SizeLarge)))
 
+// page and tile pixmaps with the accessibility color change applied, keyed
+// by the QPixmap::cacheKey() of the original one, which changes with its contents
+struct AccessiblePixmap {
+    QString settings;
+    QPixmap pixmap;
+};
+
+typedef QCache<qint64, AccessiblePixmap> AccessiblePixmapCache;
+Q_GLOBAL_STATIC(AccessiblePixmapCache, accessiblePixmapCache)
+
+// in KiB, nothing is kept with the low memory profile
+static int accessiblePixmapCacheSize()
+{
+    switch (Okular::SettingsCore::memoryLevel()) {
+    case Okular::SettingsCore::EnumMemoryLevel::Low:
+        return 0;
+    case Okular::SettingsCore::EnumMemoryLevel::Normal:
+        return 32 * 1024;
+    default:
+        return 128 * 1024;
+    }
+}
+
 #define TEXTANNOTATION_ICONSIZE 24
 
 inline QPen buildPen(const Okular::Annotation *ann, double width, const QColor &color)
@@ -99,13 +124,16 @@ void PagePainter::paintCroppedPageOnPainter(QPainter *destPainter,
     destPainter->fillRect(limits, backgroundColor);
 
     const bool hasTilesManager = page->hasTilesManager(observer);
+    const bool changeColors = (flags & Accessibility) && Okular::SettingsCore::changeColors() && (Okular::SettingsCore::renderMode() != Okular::SettingsCore::EnumRenderMode::Paper);
     QPixmap pixmap;
+    qint64 pixmapKey = 0;
 
     if (!hasTilesManager) {
         /** 1 - RETRIEVE THE 'PAGE+ID' PIXMAP OR A SIMILAR 'PAGE' ONE **/
         const QPixmap *p = page->_o_nearestPixmap(observer, dScaledWidth, dScaledHeight);
 
         if (p != nullptr) {
+            pixmapKey = p->cacheKey();
             pixmap = *p;
             pixmap.setDevicePixelRatio(dpr);
         }
@@ -227,7 +255,22 @@ void PagePainter::paintCroppedPageOnPainter(QPainter *destPainter,
     }
 
     /** 3 - ENABLE BACKBUFFERING IF DIRECT IMAGE MANIPULATION IS NEEDED **/
-    bool bufferAccessibility = (flags & Accessibility) && Okular::SettingsCore::changeColors() && (Okular::SettingsCore::renderMode() != Okular::SettingsCore::EnumRenderMode::Paper);
+    // the color change is applied once to the whole pixmaps and cached, unless they are too big
+    // for the cache, then it is applied to the painted area of each paint like for the annotations.
+    // It goes after the scaling, so that is done too while a pixmap of another size is shown
+    bool bufferAccessibility = false;
+    if (changeColors) {
+        if (hasTilesManager)
+            bufferAccessibility = accessiblePixmapCacheSize() == 0;
+        else
+            bufferAccessibility = !fitsAccessiblePixmapCache(pixmap) || pixmap.width() != dScaledWidth || pixmap.height() != dScaledHeight;
+    }
+    if (changeColors && !bufferAccessibility) {
+        paperColor = accessibleColor(paperColor);
+        if (!hasTilesManager)
+            pixmap = accessiblePixmap(pixmap, pixmapKey);
+    }
+    const bool tilesChangeColors = changeColors && hasTilesManager && !bufferAccessibility;
     bool useBackBuffer = bufferAccessibility || bufferedHighlights || bufferedAnnotations || viewPortPoint;
     QPixmap *backPixmap = nullptr;
     QPainter *mixedPainter = nullptr;
@@ -250,21 +293,19 @@ void PagePainter::paintCroppedPageOnPainter(QPainter *destPainter,
                 QRectF dLimitsInTile = dLimits & dTileRect;
 
                 if (!limitsInTile.isEmpty()) {
-                    QPixmap *tilePixmap = tile.pixmap();
-                    tilePixmap->setDevicePixelRatio(dpr);
+                    tile.pixmap()->setDevicePixelRatio(dpr);
+                    const QPixmap tilePixmap = tilesChangeColors ? accessibleTilePixmap(*tile.pixmap(), dTileRect.size()) : *tile.pixmap();
 
-                    if (tilePixmap->width() == dTileRect.width() && tilePixmap->height() == dTileRect.height()) {
-                        destPainter->drawPixmap(limitsInTile.topLeft(), *tilePixmap, dLimitsInTile.translated(-dTileRect.topLeft()));
+                    if (tilePixmap.width() == dTileRect.width() && tilePixmap.height() == dTileRect.height()) {
+                        destPainter->drawPixmap(limitsInTile.topLeft(), tilePixmap, dLimitsInTile.translated(-dTileRect.topLeft()));
                     } else {
-                        destPainter->drawPixmap(tileRect, *tilePixmap);
+                        destPainter->drawPixmap(tileRect, tilePixmap);
                     }
                 }
                 tIt++;
             }
         } else {
-            QPixmap scaledCroppedPixmap = pixmap.scaled(dScaledWidth, dScaledHeight).copy(dLimitsInPixmap);
-            scaledCroppedPixmap.setDevicePixelRatio(dpr);
-            destPainter->drawPixmap(limits.topLeft(), scaledCroppedPixmap, QRectF(0, 0, dLimits.width(), dLimits.height()));
+            drawScaledPixmapPart(destPainter, limits.topLeft(), pixmap, QSize(dScaledWidth, dScaledHeight), dLimitsInPixmap);
         }
 
         // 4A.2. active painter is the one passed to this method
@@ -290,59 +331,30 @@ void PagePainter::paintCroppedPageOnPainter(QPainter *destPainter,
                 QRect dLimitsInTile = dLimits & dTileRect;
 
                 if (!limitsInTile.isEmpty()) {
-                    QPixmap *tilePixmap = tile.pixmap();
-                    tilePixmap->setDevicePixelRatio(dpr);
+                    tile.pixmap()->setDevicePixelRatio(dpr);
+                    const QPixmap tilePixmap = tilesChangeColors ? accessibleTilePixmap(*tile.pixmap(), dTileRect.size()) : *tile.pixmap();
 
-                    if (tilePixmap->width() == dTileRect.width() && tilePixmap->height() == dTileRect.height()) {
-                        p.drawPixmap(limitsInTile.translated(-limits.topLeft()).topLeft(), *tilePixmap, dLimitsInTile.translated(-dTileRect.topLeft()));
+                    if (tilePixmap.width() == dTileRect.width() && tilePixmap.height() == dTileRect.height()) {
+                        p.drawPixmap(limitsInTile.translated(-limits.topLeft()).topLeft(), tilePixmap, dLimitsInTile.translated(-dTileRect.topLeft()));
                     } else {
-                        double xScale = tilePixmap->width() / (double)dTileRect.width();
-                        double yScale = tilePixmap->height() / (double)dTileRect.height();
+                        double xScale = tilePixmap.width() / (double)dTileRect.width();
+                        double yScale = tilePixmap.height() / (double)dTileRect.height();
                         QTransform transform(xScale, 0, 0, yScale, 0, 0);
-                        p.drawPixmap(limitsInTile.translated(-limits.topLeft()), *tilePixmap, transform.mapRect(dLimitsInTile).translated(-transform.mapRect(dTileRect).topLeft()));
+                        p.drawPixmap(limitsInTile.translated(-limits.topLeft()), tilePixmap, transform.mapRect(dLimitsInTile).translated(-transform.mapRect(dTileRect).topLeft()));
                     }
                 }
                 ++tIt;
             }
         } else {
             // 4B.1. draw the page pixmap: normal or scaled
-            QPixmap scaledCroppedPixmap = pixmap.scaled(dScaledWidth, dScaledHeight).copy(dLimitsInPixmap);
-            scaledCroppedPixmap.setDevicePixelRatio(dpr);
-            p.drawPixmap(0, 0, scaledCroppedPixmap);
+            drawScaledPixmapPart(&p, QPointF(0, 0), pixmap, QSize(dScaledWidth, dScaledHeight), dLimitsInPixmap);
         }
 
         p.end();
 
         // 4B.2. modify pixmap following accessibility settings
-        if (bufferAccessibility) {
-            switch (Okular::SettingsCore::renderMode()) {
-            case Okular::SettingsCore::EnumRenderMode::Inverted:
-                // Invert image pixels using QImage internal function
-                backImage.invertPixels(QImage::InvertRgb);
-                break;
-            case Okular::SettingsCore::EnumRenderMode::Recolor:
-                recolor(&backImage, Okular::Settings::recolorForeground(), Okular::Settings::recolorBackground());
-                break;
-            case Okular::SettingsCore::EnumRenderMode::BlackWhite:
-                blackWhite(&backImage, Okular::Settings::bWContrast(), Okular::Settings::bWThreshold());
-                break;
-            case Okular::SettingsCore::EnumRenderMode::InvertLightness:
-                invertLightness(&backImage);
-                break;
-            case Okular::SettingsCore::EnumRenderMode::InvertLuma:
-                invertLuma(&backImage, 0.2126, 0.7152, 0.0722); // sRGB / Rec. 709 luma coefficients
-                break;
-            case Okular::SettingsCore::EnumRenderMode::InvertLumaSymmetric:
-                invertLuma(&backImage, 0.3333, 0.3334, 0.3333); // Symmetric coefficients, to keep colors saturated.
-                break;
-            case Okular::SettingsCore::EnumRenderMode::HueShiftPositive:
-                hueShiftPositive(&backImage);
-                break;
-            case Okular::SettingsCore::EnumRenderMode::HueShiftNegative:
-                hueShiftNegative(&backImage);
-                break;
-            }
-        }
+        if (bufferAccessibility)
+            changeImageColors(&backImage);
 
         // 4B.3. highlight rects in page
         if (bufferedHighlights) {
@@ -690,65 +702,128 @@ void PagePainter::paintCroppedPageOnPainter(QPainter *destPainter,
     delete unbufferedAnnotations;
 }
 
-void PagePainter::recolor(QImage *image, const QColor &foreground, const QColor &background)
+void PagePainter::drawScaledPixmapPart(QPainter *painter, const QPointF &position, const QPixmap &pixmap, const QSize &dScaledSize, const QRect &dLimitsInPixmap)
 {
-    if (image->format() != QImage::Format_ARGB32_Premultiplied) {
-        qCWarning(OkularUiDebug) << "Wrong image format! Converting...";
-        *image = image->convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const QRectF target(position, QSizeF(dLimitsInPixmap.size()) / pixmap.devicePixelRatio());
+
+    if (pixmap.size() == dScaledSize) {
+        painter->drawPixmap(target, pixmap, dLimitsInPixmap);
+        return;
     }
 
-    Q_ASSERT(image->format() == QImage::Format_ARGB32_Premultiplied);
+    // map the painted part back to the pixmap, so that the cost
+    // depends on the painted area instead of on the page size
+    const double xScale = pixmap.width() / (double)dScaledSize.width();
+    const double yScale = pixmap.height() / (double)dScaledSize.height();
+    const QRectF source(dLimitsInPixmap.x() * xScale, dLimitsInPixmap.y() * yScale, dLimitsInPixmap.width() * xScale, dLimitsInPixmap.height() * yScale);
 
-    const float scaleRed = background.redF() - foreground.redF();
-    const float scaleGreen = background.greenF() - foreground.greenF();
-    const float scaleBlue = background.blueF() - foreground.blueF();
+    const bool smoothPixmapTransform = painter->testRenderHint(QPainter::SmoothPixmapTransform);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter->drawPixmap(target, pixmap, source);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, smoothPixmapTransform);
+}
+
+void PagePainter::changeImageColors(QImage *image)
+{
+    switch (Okular::SettingsCore::renderMode()) {
+    case Okular::SettingsCore::EnumRenderMode::Inverted:
+        // Invert image pixels using QImage internal function
+        image->invertPixels(QImage::InvertRgb);
+        break;
+    case Okular::SettingsCore::EnumRenderMode::Recolor:
+        recolor(image, Okular::Settings::recolorForeground(), Okular::Settings::recolorBackground());
+        break;
+    case Okular::SettingsCore::EnumRenderMode::BlackWhite:
+        blackWhite(image, Okular::Settings::bWContrast(), Okular::Settings::bWThreshold());
+        break;
+    case Okular::SettingsCore::EnumRenderMode::InvertLightness:
+        invertLightness(image);
+        break;
+    case Okular::SettingsCore::EnumRenderMode::InvertLuma:
+        invertLuma(image, 0.2126, 0.7152, 0.0722); // sRGB / Rec. 709 luma coefficients
+        break;
+    case Okular::SettingsCore::EnumRenderMode::InvertLumaSymmetric:
+        invertLuma(image, 0.3333, 0.3334, 0.3333); // Symmetric coefficients, to keep colors saturated.
+        break;
+    case Okular::SettingsCore::EnumRenderMode::HueShiftPositive:
+        hueShiftPositive(image);
+        break;
+    case Okular::SettingsCore::EnumRenderMode::HueShiftNegative:
+        hueShiftNegative(image);
+        break;
+    }
+}
 
-    const int foreground_red = foreground.red();
-    const int foreground_green = foreground.green();
-    const int foreground_blue = foreground.blue();
+QColor PagePainter::accessibleColor(const QColor &color)
+{
+    QImage image(1, 1, QImage::Format_ARGB32_Premultiplied);
+    image.fill(color);
+    changeImageColors(&image);
+    return image.pixelColor(0, 0);
+}
 
-    QRgb *data = reinterpret_cast<QRgb *>(image->bits());
-    const int pixels = image->width() * image->height();
+bool PagePainter::fitsAccessiblePixmapCache(const QPixmap &pixmap)
+{
+    // leave room for the other visible pixmaps
+    return qint64(pixmap.width()) * pixmap.height() * 4 / 1024 <= accessiblePixmapCacheSize() / 4;
+}
 
-    for (int i = 0; i < pixels; ++i) {
-        const int lightness = qGray(data[i]);
+void PagePainter::clearAccessiblePixmapCache()
+{
+    accessiblePixmapCache->clear();
+}
 
-        const float r = scaleRed * lightness + foreground_red;
-        const float g = scaleGreen * lightness + foreground_green;
-        const float b = scaleBlue * lightness + foreground_blue;
+QPixmap PagePainter::accessibleTilePixmap(const QPixmap &pixmap, const QSize &size)
+{
+    if (pixmap.size() == size)
+        return accessiblePixmap(pixmap, pixmap.cacheKey());
 
-        const unsigned a = qAlpha(data[i]);
-        data[i] = qRgba(r, g, b, a);
-    }
+    // a tile of the previous zoom level, scale it first like the back buffer does
+    QPixmap scaled = pixmap.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    scaled.setDevicePixelRatio(pixmap.devicePixelRatio());
+    return accessiblePixmap(scaled, 0);
 }
 
-void PagePainter::blackWhite(QImage *image, int contrast, int threshold)
+QPixmap PagePainter::accessiblePixmap(const QPixmap &pixmap, qint64 key)
 {
-    unsigned int *data = reinterpret_cast<unsigned int *>(image->bits());
-    int con = contrast;
-    int thr = 255 - threshold;
-
-    int pixels = image->width() * image->height();
-    for (int i = 0; i < pixels; ++i) {
-        // Piecewise linear function of val, through (0, 0), (thr, 128), (255, 255)
-        int val = qGray(data[i]);
-        if (val > thr)
-            val = 128 + (127 * (val - thr)) / (255 - thr);
-        else if (val < thr)
-            val = (128 * val) / thr;
-
-        // Linear contrast stretching through (thr, thr)
-        if (con > 2) {
-            val = thr + (val - thr) * con / 2;
-            val = qBound(0, val, 255);
-        }
+    // everything changeImageColors() depends on
+    const QString settings = QStringLiteral("%1 %2 %3 %4 %5")
+                                 .arg(Okular::SettingsCore::renderMode())
+                                 .arg(Okular::Settings::recolorForeground().name(QColor::HexArgb), Okular::Settings::recolorBackground().name(QColor::HexArgb))
+                                 .arg(Okular::Settings::bWContrast())
+                                 .arg(Okular::Settings::bWThreshold());
+
+    // follow changes of the memory profile
+    accessiblePixmapCache->setMaxCost(accessiblePixmapCacheSize());
+
+    const AccessiblePixmap *cached = key ? accessiblePixmapCache->object(key) : nullptr;
+    if (cached && cached->settings == settings) {
+        QPixmap result = cached->pixmap;
+        result.setDevicePixelRatio(pixmap.devicePixelRatio());
+        return result;
+    }
 
-        const unsigned a = qAlpha(data[i]);
-        data[i] = qRgba(val, val, val, a);
+    // transparent areas are painted over the paper, like in the back buffer
+    QImage image(pixmap.size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+    {
+        QPixmap source = pixmap;
+        source.setDevicePixelRatio(1);
+        QPainter p(&image);
+        p.drawPixmap(0, 0, source);
     }
+    changeImageColors(&image);
+
+    const int cost = qMax<qint64>(1, image.sizeInBytes() / 1024);
+    QPixmap result = QPixmap::fromImage(std::move(image));
+    if (key && cost <= accessiblePixmapCache->maxCost())
+        accessiblePixmapCache->insert(key, new AccessiblePixmap {settings, result}, cost);
+
+    result.setDevicePixelRatio(pixmap.devicePixelRatio());
+    return result;
 }
 
-void PagePainter::invertLightness(QImage *image)
+void PagePainter::recolor(QImage *image, const QColor &foreground, const QColor &background)
 {
     if (image->format() != QImage::Format_ARGB32_Premultiplied) {
         qCWarning(OkularUiDebug) << "Wrong image format! Converting...";
@@ -758,43 +833,18 @@ void PagePainter::invertLightness(QImage *image)
     Q_ASSERT(image->format() == QImage::Format_ARGB32_Premultiplied);
 
     QRgb *data = reinterpret_cast<QRgb *>(image->bits());
-    int pixels = image->width() * image->height();
-    for (int i = 0; i < pixels; ++i) {
-        // Invert lightness of the pixel using the cylindric HSL color model.
-        // Algorithm is based on https://en.wikipedia.org/wiki/HSL_and_HSV#HSL_to_RGB (2019-03-17).
-        // Important simplifications are that inverting lightness does not change chroma and hue.
-        // This means the sector (of the chroma/hue plane) is not changed,
-        // so we can use a linear calculation after determining the sector using qMin() and qMax().
-        uchar R = qRed(data[i]);
-        uchar G = qGreen(data[i]);
-        uchar B = qBlue(data[i]);
-
-        // Get only the needed HSL components. These are chroma C and the common component m.
-        // Get common component m
-        uchar m = qMin(R, qMin(G, B));
-        // Remove m from color components
-        R -= m;
-        G -= m;
-        B -= m;
-        // Get chroma C
-        uchar C = qMax(R, qMax(G, B));
-
-        // Get common component m' after inverting lightness L.
-        // Hint: Lightness L = m + C / 2; L' = 255 - L = 255 - (m + C / 2) => m' = 255 - C - m
-        uchar m_ = 255 - C - m;
-
-        // Add m' to color compontents
-        R += m_;
-        G += m_;
-        B += m_;
-
-        // Save new color
-        const unsigned A = qAlpha(data[i]);
-        data[i] = qRgba(R, G, B, A);
-    }
+    const int pixels = image->width() * image->height();
+    ColorTransform::recolor(data, pixels, foreground, background);
 }
 
-void PagePainter::invertLuma(QImage *image, float Y_R, float Y_G, float Y_B)
+void PagePainter::blackWhite(QImage *image, int contrast, int threshold)
+{
+    QRgb *data = reinterpret_cast<QRgb *>(image->bits());
+    const int pixels = image->width() * image->height();
+    ColorTransform::blackWhite(data, pixels, contrast, threshold);
+}
+
+void PagePainter::invertLightness(QImage *image)
 {
     if (image->format() != QImage::Format_ARGB32_Premultiplied) {
         qCWarning(OkularUiDebug) << "Wrong image format! Converting...";
@@ -804,102 +854,22 @@ void PagePainter::invertLuma(QImage *image, float Y_R, float Y_G, float Y_B)
     Q_ASSERT(image->format() == QImage::Format_ARGB32_Premultiplied);
 
     QRgb *data = reinterpret_cast<QRgb *>(image->bits());
-    int pixels = image->width() * image->height();
-    for (int i = 0; i < pixels; ++i) {
-        uchar R = qRed(data[i]);
-        uchar G = qGreen(data[i]);
-        uchar B = qBlue(data[i]);
-
-        invertLumaPixel(R, G, B, Y_R, Y_G, Y_B);
-
-        // Save new color
-        const unsigned A = qAlpha(data[i]);
-        data[i] = qRgba(R, G, B, A);
-    }
+    const int pixels = image->width() * image->height();
+    ColorTransform::invertLightness(data, pixels);
 }
 
-void PagePainter::invertLumaPixel(uchar &R, uchar &G, uchar &B, float Y_R, float Y_G, float Y_B)
+void PagePainter::invertLuma(QImage *image, float Y_R, float Y_G, float Y_B)
 {
-    // Invert luma of the pixel using the bicone HCY color model, stretched to cylindric HSY.
-    // Algorithm is based on https://en.wikipedia.org/wiki/HSL_and_HSV#Luma,_chroma_and_hue_to_RGB (2019-03-19).
-    // For an illustration see https://experilous.com/1/product/make-it-colorful/ (2019-03-19).
-
-    // Special case: The algorithm does not work when hue is undefined.
-    if (R == G && G == B) {
-        R = 255 - R;
-        G = 255 - G;
-        B = 255 - B;
-        return;
-    }
-
-    // Get input and output luma Y, Y_inv in range 0..255
-    float Y = R * Y_R + G * Y_G + B * Y_B;
-    float Y_inv = 255 - Y;
-
-    // Get common component m and remove from color components.
-    // This moves us to the bottom faces of the HCY bicone, i. e. we get C and X in R, G, B.
-    uint_fast8_t m = qMin(R, qMin(G, B));
-    R -= m;
-    G -= m;
-    B -= m;
-
-    // We operate in a hue plane of the luma/chroma/hue bicone.
-    // The hue plane is a triangle.
-    // This bicone is distorted, so we can not simply mirror the triangle.
-    // We need to stretch it to a luma/saturation rectangle, so we need to stretch chroma C and the proportional X.
-
-    // First, we need to calculate luma Y_full_C for the outer corner of the triangle.
-    // Then we can interpolate the max chroma C_max, C_inv_max for our luma Y, Y_inv.
-    // Then we calculate C_inv and X_inv by scaling them by the ratio of C_max and C_inv_max.
-
-    // Calculate luma Y_full_C (in range equivalent to gray 0..255) for chroma = 1 at this hue.
-    // Piecewise linear, with the corners of the bicone at the sum of one or two luma coefficients.
-    float Y_full_C;
-    if (R >= B && B >= G) {
-        Y_full_C = 255 * Y_R + 255 * Y_B * B / R;
-    } else if (R >= G && G >= B) {
-        Y_full_C = 255 * Y_R + 255 * Y_G * G / R;
-    } else if (G >= R && R >= B) {
-        Y_full_C = 255 * Y_G + 255 * Y_R * R / G;
-    } else if (G >= B && B >= R) {
-        Y_full_C = 255 * Y_G + 255 * Y_B * B / G;
-    } else if (B >= G && G >= R) {
-        Y_full_C = 255 * Y_B + 255 * Y_G * G / B;
-    } else {
-        Y_full_C = 255 * Y_B + 255 * Y_R * R / B;
-    }
-
-    // Calculate C_max, C_inv_max, to scale C and X.
-    float C_max, C_inv_max;
-    if (Y >= Y_full_C) {
-        C_max = Y_inv / (255 - Y_full_C);
-    } else {
-        C_max = Y / Y_full_C;
-    }
-    if (Y_inv >= Y_full_C) {
-        C_inv_max = Y / (255 - Y_full_C);
-    } else {
-        C_inv_max = Y_inv / Y_full_C;
+    if (image->format() != QImage::Format_ARGB32_Premultiplied) {
+        qCWarning(OkularUiDebug) << "Wrong image format! Converting...";
+        *image = image->convertToFormat(QImage::Format_ARGB32_Premultiplied);
     }
 
-    // Scale C and X. C and X already lie in R, G, B.
-    float C_scale = C_inv_max / C_max;
-    float R_ = R * C_scale;
-    float G_ = G * C_scale;
-    float B_ = B * C_scale;
-
-    // Calculate missing luma (in range 0..255), to get common component m_inv
-    float m_inv = Y_inv - (Y_R * R_ + Y_G * G_ + Y_B * B_);
-
-    // Add m_inv to color compontents
-    R_ += m_inv;
-    G_ += m_inv;
-    B_ += m_inv;
+    Q_ASSERT(image->format() == QImage::Format_ARGB32_Premultiplied);
 
-    // Return colors rounded
-    R = R_ + 0.5;
-    G = G_ + 0.5;
-    B = B_ + 0.5;
+    QRgb *data = reinterpret_cast<QRgb *>(image->bits());
+    const int pixels = image->width() * image->height();
+    ColorTransform::invertLuma(data, pixels, Y_R, Y_G, Y_B);
 }
 
 void PagePainter::hueShiftPositive(QImage *image)
@@ -912,16 +882,8 @@ void PagePainter::hueShiftPositive(QImage *image)
     Q_ASSERT(image->format() == QImage::Format_ARGB32_Premultiplied);
 
     QRgb *data = reinterpret_cast<QRgb *>(image->bits());
-    int pixels = image->width() * image->height();
-    for (int i = 0; i < pixels; ++i) {
-        uchar R = qRed(data[i]);
-        uchar G = qGreen(data[i]);
-        uchar B = qBlue(data[i]);
-
-        // Save new color
-        const unsigned A = qAlpha(data[i]);
-        data[i] = qRgba(B, R, G, A);
-    }
+    const int pixels = image->width() * image->height();
+    ColorTransform::hueShiftPositive(data, pixels);
 }
 
 void PagePainter::hueShiftNegative(QImage *image)
@@ -934,16 +896,8 @@ void PagePainter::hueShiftNegative(QImage *image)
     Q_ASSERT(image->format() == QImage::Format_ARGB32_Premultiplied);
 
     QRgb *data = reinterpret_cast<QRgb *>(image->bits());
-    int pixels = image->width() * image->height();
-    for (int i = 0; i < pixels; ++i) {
-        uchar R = qRed(data[i]);
-        uchar G = qGreen(data[i]);
-        uchar B = qBlue(data[i]);
-
-        // Save new color
-        const unsigned A = qAlpha(data[i]);
-        data[i] = qRgba(G, B, R, A);
-    }
+    const int pixels = image->width() * image->height();
+    ColorTransform::hueShiftNegative(data, pixels);
 }
 
 void PagePainter::drawShapeOnImage(QImage &image, const NormalizedPath &normPath, bool closeShape, const QPen &pen, const QBrush &brush, double penWidthMultiplier, RasterOperation op
@@ -15,7 +15,10 @@
 #include "core/area.h" // for NormalizedPoint
 
 class QPainter;
+class QPixmap;
+class QPointF;
 class QRect;
+class QSize;
 namespace Okular
 {
 class DocumentObserver;
@@ -68,8 +71,48 @@ public:
                                           const Okular::NormalizedRect &crop,
                                           Okular::NormalizedPoint *viewPortPoint);
 
+    /**
+     * Empties the cache of color changed pixmaps, to be called when memory is low.
+     */
+    static void clearAccessiblePixmapCache();
+
 private:
+    /**
+     * Draws the @p dLimitsInPixmap part of @p pixmap, scaled to @p dScaledSize, at @p position of @p painter.
+     * Only that part of @p pixmap is scaled, with the nearest pixel like QPixmap::scaled() does by default.
+     */
+    static void drawScaledPixmapPart(QPainter *painter, const QPointF &position, const QPixmap &pixmap, const QSize &dScaledSize, const QRect &dLimitsInPixmap);
+
     // BEGIN Change Colors feature
+    /**
+     * Applies the color change selected in the settings to @p image.
+     */
+    static void changeImageColors(QImage *image);
+
+    /**
+     * The color change selected in the settings applied to @p color.
+     */
+    static QColor accessibleColor(const QColor &color);
+
+    /**
+     * Whether the color changed copy of @p pixmap is small enough to be cached.
+     */
+    static bool fitsAccessiblePixmapCache(const QPixmap &pixmap);
+
+    /**
+     * @p pixmap with the color change selected in the settings applied. The result
+     * is cached under @p key, which must change whenever the contents of @p pixmap do,
+     * unless @p key is 0.
+     */
+    static QPixmap accessiblePixmap(const QPixmap &pixmap, qint64 key);
+
+    /**
+     * The tile @p pixmap scaled to @p size, which it is painted at, and with the
+     * color change selected in the settings applied. Only tiles painted at their
+     * own size are cached.
+     */
+    static QPixmap accessibleTilePixmap(const QPixmap &pixmap, const QSize &size);
+
     /**
      * Collapse color space (from white to black) to a line from @p foreground to @p background.
      */
@@ -88,12 +131,6 @@ private:
      * and assuming linear 8bit RGB color space.
      */
     static void invertLuma(QImage *image, float Y_R, float Y_G, float Y_B);
-    /**
-     * Inverts luma of a pixel given in @p R, @p G, @p B,
-     * using the luma coefficients @p Y_R, @p Y_G, @p Y_B (should sum up to 1),
-     * and assuming linear 8bit RGB color space.
-     */
-    static void invertLumaPixel(uchar &R, uchar &G, uchar &B, float Y_R, float Y_G, float Y_B);
     /**
      * Shifts hue of each pixel by 120 degrees, by simply swapping channels.
      */
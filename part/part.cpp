@@ -103,6 +103,7 @@
 #include "layers.h"
 #include "minibar.h"
 #include "okmenutitle.h"
+#include "pagepainter.h"
 #include "pagesizelabel.h"
 #include "pageview.h"
 #include "preferencesdialog.h"
@@ -360,6 +361,7 @@ Part::Part(QWidget *parentWidget, QObject *parent, const QVariantList &args)
     connect(m_document->bookmarkManager(), &BookmarkManager::openUrl, this, &Part::openUrlFromBookmarks);
     connect(m_document, &Document::close, this, &Part::close);
     connect(m_document, &Document::requestPrint, this, &Part::slotPrint);
+    connect(m_document, &Document::freeCachedMemoryRequested, this, &PagePainter::clearAccessiblePixmapCache);
     connect(m_document, &Document::undoHistoryCleanChanged, this, [this](bool clean) {
         setModified(!clean);
         setWindowTitleFromDocument();